@@ -19,6 +19,10 @@
 #define GL_CLAMP_TO_EDGE 0x812F // We use this magic number because Microsoft's GL.h does not have it. It is ancient.
 #endif
 
+#ifndef GL_TEXTURE_MAX_LEVEL
+#define GL_TEXTURE_MAX_LEVEL 0x813D // Same story, OpenGL 1.2
+#endif
+
 #define GLFW_EXPOSE_NATIVE_WIN32
 #include <GLFW/glfw3native.h> // For hwndOwner for File Dialog
 
@@ -101,16 +105,38 @@ void SaveImageByExtension(const std::string& filepath, const Image& image) {
     }
 }
 
+// Uploads the image and its mip levels to the bound texture. The view mostly shows the image zoomed out,
+// the levels let the GPU sample averaged pixels there instead of skipping most of them.
+void UploadTextureLevels(Filter_Engine engine, Image* image) {
+    GLenum format = image->channels == 4 ? GL_RGBA : GL_RGB;
+    size_t count = filter_pyramid_level_count(image->width, image->height) - 1;
+    Image* levels = (Image*)calloc(count + 1, sizeof(Image));
+    for (size_t k = 0; k < count; ++k) {
+        filter_pyramid_level_size(image->width, image->height, k + 1, &levels[k].width, &levels[k].height);
+        levels[k].channels = image->channels;
+        levels[k].data = (unsigned char*)malloc((size_t)levels[k].width * levels[k].height * image->channels);
+    }
+    filter_engine_build_pyramid(engine, image, levels, count);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // Rows of RGB levels are rarely a multiple of 4 bytes
+    glTexImage2D(GL_TEXTURE_2D, 0, format, image->width, image->height, 0, format, GL_UNSIGNED_BYTE, image->data);
+    for (size_t k = 0; k < count; ++k) {
+        glTexImage2D(GL_TEXTURE_2D, (GLint)(k + 1), format, levels[k].width, levels[k].height, 0, format, GL_UNSIGNED_BYTE, levels[k].data);
+        free(levels[k].data);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)count);
+    free(levels);
+}
+
 // Updates image data in existing OpenGL texture
-void UpdateTexture(GLuint textureID, Image* image) {
+void UpdateTexture(Filter_Engine engine, GLuint textureID, Image* image) {
     glBindTexture(GL_TEXTURE_2D, textureID);
-    if (image->channels == 3) glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image->width, image->height, GL_RGB, GL_UNSIGNED_BYTE, image->data);
-    else if (image->channels == 4) glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image->width, image->height, GL_RGBA, GL_UNSIGNED_BYTE, image->data);
+    UploadTextureLevels(engine, image);
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 // Load initial image from disk
-void LoadImageToTexture(AppState* appState, Image* image) {
+void LoadImageToTexture(Filter_Engine engine, AppState* appState, Image* image) {
     appState->image.width = image->width;
     appState->image.height = image->height;
     appState->image.channels = image->channels;
@@ -128,14 +154,13 @@ void LoadImageToTexture(AppState* appState, Image* image) {
     glBindTexture(GL_TEXTURE_2D, appState->textureID);
 
     // Setup filtering parameters for display
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
     // Upload pixels
-    if (appState->image.channels == 3) glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, appState->image.width, appState->image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, appState->image.data);
-	else if (appState->image.channels == 4) glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, appState->image.width, appState->image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, appState->image.data);
+    UploadTextureLevels(engine, &appState->image);
     glBindTexture(GL_TEXTURE_2D, 0);
 
     return;
@@ -174,7 +199,7 @@ void ApplyFilter(Filter_Engine engine, AppState* appState, Work_Type type) {
     appState->image.data = outputImg.data; 
 
     // Update OpenGL Texture so we see the result
-    UpdateTexture(appState->textureID, &appState->image);
+    UpdateTexture(engine, appState->textureID, &appState->image);
 }
 
 
@@ -236,7 +261,7 @@ int main(void) {
                     statusColor = ImVec4(1, 0, 0, 1); 
                 }
                 else {
-                    LoadImageToTexture(&appState, &image);
+                    LoadImageToTexture(engine, &appState, &image);
 
                     statusMessage = "Loaded: " + selectedPath;
                     statusColor = ImVec4(0, 1, 0, 1); 
@@ -3,337 +3,1238 @@
 #include <stdlib.h> // for calloc, free
 #include <stdint.h>
 #include <string.h>
-#include <Windows.h> // for threading and synchronization
+#include "platform.h" // for threading and synchronization
+#include "filter_kernels.h" // for Work_Item and the point filter kernels
 #include <assert.h>
 
 const size_t DEFAULT_ARENA_SIZE = 64;
 
+const size_t MAX_ARENA_SLABS = 4096; // Hard cap for unbounded arenas, 4096 slabs of DEFAULT_ARENA_SIZE is 256k queued jobs
+
+const size_t MIN_SUBMIT_QUEUE_SIZE = 1024;
+
 const size_t MAX_THREADS = 128;
 
-const uint32_t THRESHOLD = 100;
+// Partitioning cost model. Jobs are cut into MIN_CHUNKS_PER_WORKER..MAX_CHUNKS_PER_WORKER chunks per worker,
+// heavier filters getting more chunks. A chunk is never smaller than min_chunk_bytes of input divided by the
+// filter's relative cost, so an expensive kernel may use smaller chunks than invert. A single chunk runs on the caller.
+const uint32_t MIN_CHUNKS_PER_WORKER = 4;
 
-const uint32_t WORK_ITEM_ROWS = 50;
+const uint32_t MAX_CHUNKS_PER_WORKER = 8;
 
+const size_t DEFAULT_MIN_CHUNK_BYTES = 256 * 1024;
 
-struct Work_Item;
-// Generic filter function type
-typedef void (*Filter_Function)(Work_Item* work);
+// Idle workers spin, then yield, then park. Long enough to catch the next image of an interactive
+// session or a batch without an OS wakeup, short enough that an idle engine costs next to no CPU.
+const size_t DEFAULT_IDLE_SPIN_MICROSECONDS = 20;
 
-// Structures for threading and work management
-typedef struct Thread_Context {
-	HANDLE* threads;
-	size_t thread_count;
-} Thread_Context;
+const size_t DEFAULT_IDLE_YIELD_MICROSECONDS = 50;
+
+const uint32_t IDLE_SPIN_BATCH = 64; // Pause instructions between two looks at the queue
+
+const uint32_t WORK_DEQUE_INITIAL_CAPACITY = 64;
+
+#define CACHE_LINE_SIZE 64
 
-typedef struct Work_Item {
-	unsigned char* image;
-	unsigned char* output;
-	uint32_t width, height;
-	Filter_Function function;
-} Work_Item;
 
 typedef struct Work_Context {
 	Work_Item* works;
 	uint32_t work_count;
 	volatile uint32_t work_done;
-	volatile uint32_t work_index;
 } Work_Context;
 
+// Per-worker double ended queue of work items. The owner pops from the front so it walks rows in
+// memory order, thieves take from the back so they stay away from the cache lines the owner is on.
+typedef struct Work_Deque {
+	Platform_Mutex lock;
+	Work_Item** items;
+	uint32_t capacity; // Always a power of two
+	uint32_t front;
+	volatile uint32_t count; // Read without the lock to skip empty victims
+} Work_Deque;
+
+typedef struct Worker {
+	Work_Deque deques[PRIORITY_COUNT]; // One per priority class, interactive items never queue behind batch ones
+	Filter_Engine engine;
+	uint32_t index;
+	uint32_t node; // NUMA node the worker runs on, always 0 unless workers are pinned
+	uint32_t seed; // Victim selection state, only touched by the owning thread
+	char padding[CACHE_LINE_SIZE]; // Keeps neighbouring workers' deques off the same cache line
+} Worker;
+
+// Structures for threading and work management
+typedef struct Thread_Context {
+	Platform_Thread* threads;
+	Worker* workers;
+	size_t thread_count;
+	uint32_t* node_workers; // Worker indices grouped by node, node n owns [node_worker_offset[n], node_worker_offset[n + 1])
+	uint32_t* node_worker_offset;
+} Thread_Context;
+
 typedef struct Work_Context_Node {
 	Work_Context context;
-	Work_Context_Node* next;
+	volatile uint32_t next_free; // Free list link while the node sits in the arena, index + 1 and 0 ends the list
+	uint32_t index;
+	uint32_t numa_node; // Queue the job goes to, the node that first touched the input
+	uint32_t priority;
+	uint64_t submit_time; // Microseconds, for the queueing statistics
+	volatile uint32_t ticket; // Bumped every time the node is recycled, a Filter_Job is done once its ticket is stale
+	volatile uint32_t cancel_ticket; // The job is cancelled while this matches ticket, a late cancel of an older job never does
+	uint32_t cancel_epoch; // filter_engine_cancel_all cancels every job from an older epoch
+	Work_Item* items; // Pooled storage that is recycled with the node, big enough for any single image job
+	Filter_Params params; // Copy of the caller's filter parameters, the job's items point here
+	unsigned char* source; // Copy of the input when an area filter writes over it, the items read this instead
+	Work_Type type; // work_context_destroy releases what the job's parameters hold
 } Work_Context_Node;
 
+// Node arena that grows in fixed size slabs. Nodes are addressed by index so the free list head can carry
+// an ABA tag next to it in one 64-bit word, allocate and free are lock-free and only growing takes grow_lock.
 typedef struct Work_Context_Node_Arena {
-	Work_Context_Node* nodes;
-	Work_Context_Node* free_list;
-	size_t size;
+	Work_Context_Node** slabs; // Slab i holds the nodes with index [i * slab_size, (i + 1) * slab_size)
+	uint32_t slab_size;
+	volatile uint32_t slab_count;
+	uint32_t max_slabs;
+	volatile uint64_t free_head; // (tag << 32) | (index + 1)
+	Platform_Mutex grow_lock;
+	Work_Item** item_slabs; // Work item storage for slab i, items_per_node items per node in one block
+	uint32_t items_per_node;
 } Work_Context_Node_Arena;
 
+// Bounded lock-free multi-producer multi-consumer queue of submitted contexts (Vyukov's sequence ring).
+// A slot's sequence says whose turn it is: == position means free for a producer, == position + 1 means filled.
+typedef struct Submit_Slot {
+	volatile uint32_t sequence;
+	Work_Context_Node* node;
+} Submit_Slot;
+
+typedef struct Submit_Queue {
+	Submit_Slot* slots;
+	uint32_t mask;
+	char padding_0[CACHE_LINE_SIZE];
+	volatile uint32_t enqueue_position;
+	char padding_1[CACHE_LINE_SIZE];
+	volatile uint32_t dequeue_position;
+	char padding_2[CACHE_LINE_SIZE];
+} Submit_Queue;
+
+// Producers never take cs. It only backs the two condition variables, workers park on cv_start and
+// job waiters on cv_done, and both sides use the Dekker style counters below to skip the lock when nobody sleeps.
 typedef struct Work_Context_Controller {
 	Work_Context_Node_Arena arena;
-	Work_Context_Node* head;
-	Work_Context_Node* tail;
-	CRITICAL_SECTION cs;
-	CONDITION_VARIABLE cv_start;
-	CONDITION_VARIABLE cv_done;
-	BOOL shutdown;
+	Submit_Queue* queues; // One per priority class and NUMA node, see submit_queue_of
+	uint32_t node_count;
+	volatile uint32_t cancel_epoch;
+	volatile uint64_t stats_jobs[PRIORITY_COUNT];
+	volatile uint64_t stats_queue_us_total[PRIORITY_COUNT];
+	volatile uint64_t stats_queue_us_max[PRIORITY_COUNT];
+	volatile uint32_t queued_items; // Work items not yet picked up by a worker, in the queue or in deques
+	volatile uint32_t jobs_in_flight; // Submitted contexts that are not complete yet
+	volatile uint32_t sleeping_workers;
+	volatile uint32_t done_waiters; // Threads sleeping on cv_done, completions only broadcast when someone listens
+	Platform_Mutex cs;
+	Platform_Condition cv_start;
+	Platform_Condition cv_done;
+	volatile uint32_t shutdown; // Read without the lock by spinning workers
+	Idle_Policy idle_policy;
+	uint64_t idle_spin_us;
+	uint64_t idle_yield_us;
 } Work_Context_Controller;
 
+// Predicate for engine_wait_until, checked again under cs before the caller sleeps
+typedef bool (*Wait_Condition)(Filter_Engine engine, const void* params);
+
+typedef struct Wait_Any_Params {
+	const Filter_Job* jobs;
+	size_t count;
+} Wait_Any_Params;
+
 struct _Filter_Engine {
 	Thread_Context t_context;
 	Work_Context_Controller wc_controller;
+	Platform_Topology topology;
+	uint64_t min_chunk_bytes;
+	Filter_Kernels kernels;
+	Filter_Simd_Level simd_level;
+	Filter_Color_Math color_math;
+	Filter_Params grayscale_params; // GRAYSCALE and SEPIA are fixed color matrices, prepared once
+	Filter_Params sepia_params;
+	Resample_Cache* resample_cache; // Weights of recent resize jobs
 };
 
 // Declarations of internal functions
-static DWORD _stdcall thread_proc(void* params);
-static void work_context_node_arena_initialize(Work_Context_Node_Arena* arena, size_t size);
+static Platform_Thread_Result PLATFORM_THREAD_CALL thread_proc(void* params);
+static void work_context_node_arena_initialize(Work_Context_Node_Arena* arena, size_t size, size_t max_size, uint32_t items_per_node);
 static void work_context_node_arena_destroy(Work_Context_Node_Arena* arena);
+static inline Work_Context_Node* work_context_node_arena_node(Work_Context_Node_Arena* arena, uint32_t index);
+static bool work_context_node_arena_grow(Work_Context_Node_Arena* arena);
+static void work_context_node_arena_push(Work_Context_Node_Arena* arena, Work_Context_Node* first, Work_Context_Node* last);
 static Work_Context_Node* work_context_node_arena_allocate(Work_Context_Node_Arena* arena);
 static void work_context_node_arena_free(Work_Context_Node_Arena* arena, Work_Context_Node* node);
-static void work_context_node_enqueue(Work_Context_Controller* controller, Work_Context_Node* node);
-static void work_context_node_dequeue(Work_Context_Controller* controller);
-static Work_Context work_context_create(Image* input, unsigned char* output, Work_Type type);
-static void work_context_destroy(Work_Context context);
-static void invert_color_work_3channel(Work_Item* work);
-static void grayscale_work_3channel(Work_Item* work);
-static void sepia_work_3channel(Work_Item* work);
-static void invert_color_work_4channel(Work_Item* work);
-static void grayscale_work_4channel(Work_Item* work);
-static void sepia_work_4channel(Work_Item* work);
-static inline Filter_Function get_filter_function(Work_Type type, int channels);
-static void general_filter_helper(Filter_Engine engine, Image* input, Image* output, Work_Type type);
-
-static DWORD _stdcall thread_proc(void* params) {
-	Filter_Engine engine = (Filter_Engine)params;
+static Work_Context_Node* work_context_node_acquire(Filter_Engine engine);
+static void submit_queue_initialize(Submit_Queue* queue, size_t capacity);
+static void submit_queue_destroy(Submit_Queue* queue);
+static bool submit_queue_push(Submit_Queue* queue, Work_Context_Node* node);
+static Work_Context_Node* submit_queue_pop(Submit_Queue* queue);
+static inline Submit_Queue* submit_queue_of(Work_Context_Controller* controller, uint32_t priority, uint32_t numa_node);
+static Work_Context_Node* worker_pop_submitted(Worker* worker, uint32_t priority);
+static bool worker_run_work(Worker* worker);
+static uint32_t job_numa_node(Filter_Engine engine, const void* data);
+static void worker_placement(const Platform_Topology* topology, uint32_t* order);
+static void work_context_node_enqueue(Filter_Engine engine, Work_Context_Node* node);
+static void work_context_node_complete(Filter_Engine engine, Work_Context_Node* node);
+static inline bool work_context_node_cancelled(Filter_Engine engine, Work_Context_Node* node);
+static void work_context_node_distribute(Filter_Engine engine, Worker* worker, Work_Context_Node* node);
+static void wake_workers(Work_Context_Controller* controller, uint32_t count);
+static void work_deque_initialize(Work_Deque* deque);
+static void work_deque_destroy(Work_Deque* deque);
+static void work_deque_push(Work_Deque* deque, Work_Item* items, uint32_t count);
+static Work_Item* work_deque_pop(Work_Deque* deque);
+static Work_Item* work_deque_steal(Work_Deque* deque);
+static Work_Item* worker_find_work(Worker* worker, uint32_t priority);
+static inline uint32_t xorshift32(uint32_t* state);
+static void work_item_run(Filter_Engine engine, Work_Item* item);
+static bool caller_run_work(Filter_Engine engine, uint32_t* seed);
+static void engine_wait_until(Filter_Engine engine, Wait_Condition condition, const void* params);
+static bool worker_idle(Worker* worker);
+static uint32_t work_chunk_count(Filter_Engine engine, Image* input, Work_Type type, const Filter_Params* params);
+static Work_Item* work_context_node_items(Filter_Engine engine, Work_Context_Node* node, uint32_t count);
+static Work_Context work_context_create(Filter_Engine engine, Work_Item* works, Image* input, Image* output, Work_Type type, const Filter_Params* params, uint32_t chunk_count);
+static Work_Context work_context_create_batch(Filter_Engine engine, Work_Item* works, uint32_t work_count, Image* inputs, Image* outputs, size_t count, Work_Type type);
+static void work_items_fill(Work_Item* works, Image* input, unsigned char* output, Filter_Function function, const Filter_Params* params, uint32_t chunk_count);
+static void work_items_fill_rows(Work_Item* works, Image* input, unsigned char* output, Filter_Function function, const Filter_Params* params, uint32_t chunk_count, uint32_t halo);
+static void work_items_fill_resize(Work_Item* works, Image* input, Image* output, Filter_Function function, const Filter_Params* params, uint32_t chunk_count);
+static void work_items_fill_tiles(Work_Item* works, Image* input, unsigned char* output, Filter_Function function, const Filter_Params* params, uint32_t chunk_count, uint32_t tile_width, uint32_t tile_height);
+static unsigned char* image_copy(const Image* image);
+static inline bool images_overlap(const Image* input, const Image* output);
+static Filter_Job work_context_submit(Filter_Engine engine, Work_Context_Node* node, Work_Context context, const void* data, Work_Type type, Filter_Priority priority);
+static void work_context_destroy(Work_Context_Node* node);
+static inline const Filter_Params* get_filter_params(Filter_Engine engine, Work_Type type);
+static inline Filter_Function get_filter_function(Filter_Engine engine, Work_Type type, int channels, const Filter_Params* params);
+static inline uint32_t get_filter_cost(Work_Type type);
+static inline bool get_filter_is_area(Work_Type type);
+static inline bool get_filter_is_resample(Work_Type type);
+static inline bool get_filter_is_tiled(Work_Type type, const Filter_Params* params);
+static inline uint32_t get_filter_halo(Work_Type type, const Filter_Params* params);
+static inline void release_filter_params(Work_Type type, Filter_Params* params);
+static Filter_Job general_filter_helper(Filter_Engine engine, Image* input, Image* output, Work_Type type, const Filter_Params* params, Filter_Priority priority);
+static inline bool filter_job_is_done(Filter_Job job);
+static bool all_jobs_done(Filter_Engine engine, const void* params);
+static bool job_done(Filter_Engine engine, const void* params);
+static bool any_job_done(Filter_Engine engine, const void* params);
+
+static Platform_Thread_Result PLATFORM_THREAD_CALL thread_proc(void* params) {
+	Worker* worker = (Worker*)params;
+	Filter_Engine engine = worker->engine;
 	Work_Context_Controller* controller = &engine->wc_controller;
-	BOOLEAN stay = false;
 	while (true) {
-		Work_Context_Node* node = NULL;
-		EnterCriticalSection(&controller->cs);
-		if (!stay) SleepConditionVariableCS(&controller->cv_start, &controller->cs, INFINITE);
-		stay = false;
-		if (controller->shutdown) {
-			LeaveCriticalSection(&controller->cs);
+		if (worker_run_work(worker)) continue;
+		if (platform_atomic_load(&controller->queued_items) != 0) continue; // Items are being distributed right now
+		if (worker_idle(worker)) continue;
+		platform_mutex_lock(&controller->cs);
+		// Announce ourselves before the final check, a producer adds to queued_items before it reads sleeping_workers
+		platform_atomic_increment(&controller->sleeping_workers);
+		while (platform_atomic_load(&controller->queued_items) == 0 && !platform_atomic_load(&controller->shutdown)) {
+			platform_condition_sleep(&controller->cv_start, &controller->cs);
+		}
+		platform_atomic_decrement(&controller->sleeping_workers);
+		if (platform_atomic_load(&controller->shutdown) && platform_atomic_load(&controller->queued_items) == 0) {
+			platform_mutex_unlock(&controller->cs);
 			return 0;
 		}
-		node = controller->head;
-		LeaveCriticalSection(&controller->cs);
+		platform_mutex_unlock(&controller->cs);
+	}
+}
+
+// Work stealing deque functions, every worker owns one and the others steal from it when idle
+static void work_deque_initialize(Work_Deque* deque) {
+	deque->items = (Work_Item**)calloc(WORK_DEQUE_INITIAL_CAPACITY, sizeof(Work_Item*));
+	if (deque->items == NULL) {
+		fprintf(stderr, "Failed to allocate memory for work deque\n");
+		exit(EXIT_FAILURE);
+	}
+	deque->capacity = WORK_DEQUE_INITIAL_CAPACITY;
+	deque->front = 0;
+	deque->count = 0;
+	platform_mutex_initialize(&deque->lock);
+
+	return;
+}
+
+static void work_deque_destroy(Work_Deque* deque) {
+	free(deque->items);
+	deque->items = NULL;
+	deque->capacity = 0;
+	platform_mutex_destroy(&deque->lock);
+
+	return;
+}
+
+static void work_deque_push(Work_Deque* deque, Work_Item* items, uint32_t count) {
+	platform_mutex_lock(&deque->lock);
+	if (deque->count + count > deque->capacity) {
+		uint32_t capacity = deque->capacity;
+		while (capacity < deque->count + count) capacity *= 2;
+		Work_Item** grown = (Work_Item**)calloc(capacity, sizeof(Work_Item*));
+		if (grown == NULL) {
+			fprintf(stderr, "Failed to grow work deque\n");
+			exit(EXIT_FAILURE);
+		}
+		for (uint32_t i = 0; i < deque->count; ++i) {
+			grown[i] = deque->items[(deque->front + i) & (deque->capacity - 1)];
+		}
+		free(deque->items);
+		deque->items = grown;
+		deque->capacity = capacity;
+		deque->front = 0;
+	}
+	for (uint32_t i = 0; i < count; ++i) {
+		deque->items[(deque->front + deque->count + i) & (deque->capacity - 1)] = &items[i];
+	}
+	platform_atomic_store(&deque->count, deque->count + count);
+	platform_mutex_unlock(&deque->lock);
+
+	return;
+}
+
+// Owner side, takes the oldest item
+static Work_Item* work_deque_pop(Work_Deque* deque) {
+	if (platform_atomic_load(&deque->count) == 0) return NULL;
+	Work_Item* item = NULL;
+	platform_mutex_lock(&deque->lock);
+	if (deque->count > 0) {
+		item = deque->items[deque->front];
+		deque->front = (deque->front + 1) & (deque->capacity - 1);
+		platform_atomic_store(&deque->count, deque->count - 1);
+	}
+	platform_mutex_unlock(&deque->lock);
+
+	return item;
+}
+
+// Thief side, takes the newest item
+static Work_Item* work_deque_steal(Work_Deque* deque) {
+	if (platform_atomic_load(&deque->count) == 0) return NULL;
+	Work_Item* item = NULL;
+	platform_mutex_lock(&deque->lock);
+	if (deque->count > 0) {
+		platform_atomic_store(&deque->count, deque->count - 1);
+		item = deque->items[(deque->front + deque->count) & (deque->capacity - 1)];
+	}
+	platform_mutex_unlock(&deque->lock);
+
+	return item;
+}
+
+// Runs one item or distributes one context, whatever the highest priority class has to offer.
+// Checking between every item is what preempts a batch job for an interactive one. Returns false when idle.
+static bool worker_run_work(Worker* worker) {
+	for (uint32_t priority = 0; priority < PRIORITY_COUNT; ++priority) {
+		Work_Item* item = worker_find_work(worker, priority);
+		if (item != NULL) {
+			work_item_run(worker->engine, item);
+			return true;
+		}
+		Work_Context_Node* node = worker_pop_submitted(worker, priority);
 		if (node != NULL) {
-			Work_Context* context = &node->context;
-			while (context->work_index < context->work_count) {
-				uint32_t index = InterlockedIncrement(&context->work_index) - 1;
-				if (index < context->work_count) {
-					context->works[index].function(&context->works[index]);
-					InterlockedIncrement(&context->work_done);
-				}
+			work_context_node_distribute(worker->engine, worker, node);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Pops from the worker's own deque, otherwise tries every other worker once starting from a random victim.
+// With several NUMA nodes the workers on the same node are tried first, their items touch local memory.
+static Work_Item* worker_find_work(Worker* worker, uint32_t priority) {
+	Work_Item* item = work_deque_pop(&worker->deques[priority]);
+	if (item != NULL) return item;
+	Thread_Context* t_context = &worker->engine->t_context;
+	uint32_t thread_count = (uint32_t)t_context->thread_count;
+	if (thread_count < 2) return NULL;
+	uint32_t random = xorshift32(&worker->seed);
+	if (worker->engine->wc_controller.node_count > 1) {
+		uint32_t first = t_context->node_worker_offset[worker->node];
+		uint32_t local_count = t_context->node_worker_offset[worker->node + 1] - first;
+		uint32_t local = random % local_count;
+		for (uint32_t i = 0; i < local_count; ++i, local = (local + 1) % local_count) {
+			uint32_t victim = t_context->node_workers[first + local];
+			if (victim == worker->index) continue;
+			item = work_deque_steal(&t_context->workers[victim].deques[priority]);
+			if (item != NULL) return item;
+		}
+	}
+	uint32_t victim = random % thread_count;
+	for (uint32_t i = 0; i < thread_count; ++i, victim = (victim + 1) % thread_count) {
+		if (victim == worker->index) continue;
+		item = work_deque_steal(&t_context->workers[victim].deques[priority]);
+		if (item != NULL) return item;
+	}
+
+	return NULL;
+}
+
+static inline uint32_t xorshift32(uint32_t* state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+
+	return *state;
+}
+
+// Runs one item and completes its context when it was the last one, used by workers and waiting callers
+static void work_item_run(Filter_Engine engine, Work_Item* item) {
+	platform_atomic_decrement(&engine->wc_controller.queued_items);
+	Work_Context_Node* node = item->node;
+	uint32_t work_count = node->context.work_count; // Read before our increment, after it the node may already be recycled
+	if (!work_context_node_cancelled(engine, node)) item->function(item); // Cancelled items are only counted
+	if (platform_atomic_increment(&node->context.work_done) == work_count) {
+		work_context_node_complete(engine, node);
+	}
+
+	return;
+}
+
+// A thread waiting on the engine works as an extra worker instead of sleeping. It has no deque of its own,
+// so it steals items like a thief and spreads fresh contexts over the workers. Returns false when it found nothing.
+static bool caller_run_work(Filter_Engine engine, uint32_t* seed) {
+	Thread_Context* t_context = &engine->t_context;
+	Work_Context_Controller* controller = &engine->wc_controller;
+	uint32_t thread_count = (uint32_t)t_context->thread_count;
+	for (uint32_t priority = 0; priority < PRIORITY_COUNT; ++priority) {
+		uint32_t victim = xorshift32(seed) % thread_count;
+		for (uint32_t i = 0; i < thread_count; ++i, victim = (victim + 1) % thread_count) {
+			Work_Item* item = work_deque_steal(&t_context->workers[victim].deques[priority]);
+			if (item != NULL) {
+				work_item_run(engine, item);
+				return true;
 			}
-			if (InterlockedCompareExchange(&context->work_done, context->work_count, context->work_count) == context->work_count) {
-				stay = true;
-				work_context_node_dequeue(controller);
+		}
+		for (uint32_t n = 0; n < controller->node_count; ++n) {
+			Work_Context_Node* node = submit_queue_pop(submit_queue_of(controller, priority, n));
+			if (node != NULL) {
+				work_context_node_distribute(engine, NULL, node);
+				return true;
 			}
 		}
 	}
+
+	return false;
+}
+
+// Waits for work without the OS according to the idle policy. Returns true when work showed up, false
+// when the worker should park on cv_start. Shutdown also returns false, the park path handles the exit.
+static bool worker_idle(Worker* worker) {
+	Work_Context_Controller* controller = &worker->engine->wc_controller;
+	if (controller->idle_policy == IDLE_PARK) return false;
+	uint64_t start = platform_time_microseconds();
+	uint64_t spin_end = start + controller->idle_spin_us;
+	uint64_t yield_end = spin_end + controller->idle_yield_us;
+	while (true) {
+		if (platform_atomic_load(&controller->queued_items) != 0) return true;
+		if (platform_atomic_load(&controller->shutdown)) return false;
+		uint64_t now = platform_time_microseconds();
+		if (controller->idle_policy == IDLE_SPIN || now < spin_end) {
+			for (uint32_t i = 0; i < IDLE_SPIN_BATCH; ++i) platform_cpu_pause();
+		}
+		else if (now < yield_end) {
+			platform_thread_yield();
+		}
+		else {
+			return false;
+		}
+	}
 }
 
 // Arena management functions for work context nodes for better performance
-static void work_context_node_arena_initialize(Work_Context_Node_Arena* arena, size_t size) {
+static void work_context_node_arena_initialize(Work_Context_Node_Arena* arena, size_t size, size_t max_size, uint32_t items_per_node) {
 	assert(size > 1);
-	Work_Context_Node* arena_arr = (Work_Context_Node*)calloc(size, sizeof(Work_Context_Node));
-	if (arena_arr == NULL) {
+	arena->slab_size = (uint32_t)size;
+	arena->items_per_node = items_per_node;
+	arena->max_slabs = (uint32_t)MAX_ARENA_SLABS;
+	if (max_size != DEFAULT) {
+		if (max_size < size) max_size = size;
+		size_t max_slabs = (max_size + size - 1) / size;
+		if (max_slabs < arena->max_slabs) arena->max_slabs = (uint32_t)max_slabs;
+	}
+	arena->slabs = (Work_Context_Node**)calloc(arena->max_slabs, sizeof(Work_Context_Node*));
+	arena->item_slabs = (Work_Item**)calloc(arena->max_slabs, sizeof(Work_Item*));
+	if (arena->slabs == NULL || arena->item_slabs == NULL) {
 		fprintf(stderr, "Failed to allocate memory for context node arena\n");
 		exit(EXIT_FAILURE);
 	}
-	arena->free_list = arena_arr;
-	arena->nodes = arena_arr;
-	for (size_t i = 0; i < size - 1; ++i) {
-		arena->free_list[i].next = &arena->free_list[i + 1];
-	}
-	arena->free_list[size - 1].next = NULL;
-	arena->size = size;
+	arena->slab_count = 0;
+	arena->free_head = 0;
+	platform_mutex_initialize(&arena->grow_lock);
+	work_context_node_arena_grow(arena);
 
 	return;
 }
 
 static void work_context_node_arena_destroy(Work_Context_Node_Arena* arena) {
-	free(arena->nodes);
-	arena->nodes = NULL;
-	arena->free_list = NULL;
-	arena->size = 0;
+	for (uint32_t i = 0; i < arena->slab_count; ++i) {
+		free(arena->slabs[i]);
+		free(arena->item_slabs[i]);
+	}
+	free(arena->slabs);
+	free(arena->item_slabs);
+	arena->slabs = NULL;
+	arena->item_slabs = NULL;
+	arena->slab_count = 0;
+	arena->free_head = 0;
+	platform_mutex_destroy(&arena->grow_lock);
 
 	return;
 }
 
+static inline Work_Context_Node* work_context_node_arena_node(Work_Context_Node_Arena* arena, uint32_t index) {
+	return &arena->slabs[index / arena->slab_size][index % arena->slab_size];
+}
+
+// Adds one slab to the free list. Returns false once max_slabs is reached.
+static bool work_context_node_arena_grow(Work_Context_Node_Arena* arena) {
+	platform_mutex_lock(&arena->grow_lock);
+	// Somebody else may have grown or freed a node while we were waiting for the lock
+	if ((uint32_t)platform_atomic_load64(&arena->free_head) != 0) {
+		platform_mutex_unlock(&arena->grow_lock);
+		return true;
+	}
+	if (arena->slab_count == arena->max_slabs) {
+		platform_mutex_unlock(&arena->grow_lock);
+		return false;
+	}
+	Work_Context_Node* slab = (Work_Context_Node*)calloc(arena->slab_size, sizeof(Work_Context_Node));
+	Work_Item* items = (Work_Item*)calloc((size_t)arena->slab_size * arena->items_per_node, sizeof(Work_Item));
+	if (slab == NULL || items == NULL) {
+		fprintf(stderr, "Failed to grow context node arena\n");
+		exit(EXIT_FAILURE);
+	}
+	uint32_t base = arena->slab_count * arena->slab_size;
+	for (uint32_t i = 0; i < arena->slab_size; ++i) {
+		slab[i].index = base + i;
+		slab[i].next_free = base + i + 2; // index + 1 of the next node
+		slab[i].cancel_ticket = slab[i].ticket - 1;
+		slab[i].items = &items[(size_t)i * arena->items_per_node];
+	}
+	arena->slabs[arena->slab_count] = slab;
+	arena->item_slabs[arena->slab_count] = items;
+	platform_atomic_store(&arena->slab_count, arena->slab_count + 1);
+	work_context_node_arena_push(arena, &slab[0], &slab[arena->slab_size - 1]);
+	platform_mutex_unlock(&arena->grow_lock);
+
+	return true;
+}
+
+// Pushes the chain first..last, already linked through next_free, onto the free list
+static void work_context_node_arena_push(Work_Context_Node_Arena* arena, Work_Context_Node* first, Work_Context_Node* last) {
+	uint64_t head = platform_atomic_load64(&arena->free_head);
+	while (true) {
+		platform_atomic_store(&last->next_free, (uint32_t)head);
+		uint64_t new_head = ((head >> 32) + 1) << 32 | (uint64_t)(first->index + 1);
+		uint64_t previous = platform_atomic_compare_exchange64(&arena->free_head, new_head, head);
+		if (previous == head) break;
+		head = previous;
+	}
+
+	return;
+}
+
+// Returns NULL when the arena is empty and may not grow any further
 static Work_Context_Node* work_context_node_arena_allocate(Work_Context_Node_Arena* arena) {
-	assert(arena->free_list != NULL && "Arena out of memory, increase size");
-	Work_Context_Node* node = arena->free_list;
-	arena->free_list = arena->free_list->next;
-	node->next = NULL;
-	return node;
+	uint64_t head = platform_atomic_load64(&arena->free_head);
+	while (true) {
+		uint32_t link = (uint32_t)head;
+		if (link == 0) {
+			if (!work_context_node_arena_grow(arena)) return NULL;
+			head = platform_atomic_load64(&arena->free_head);
+			continue;
+		}
+		// The node may be popped and relinked by another thread meanwhile, the tag makes our exchange fail then
+		Work_Context_Node* node = work_context_node_arena_node(arena, link - 1);
+		uint64_t new_head = ((head >> 32) + 1) << 32 | (uint64_t)platform_atomic_load(&node->next_free);
+		uint64_t previous = platform_atomic_compare_exchange64(&arena->free_head, new_head, head);
+		if (previous == head) return node;
+		head = previous;
+	}
 }
 
 static void work_context_node_arena_free(Work_Context_Node_Arena* arena, Work_Context_Node* node) {
 	node->context.work_count = 0;
 	node->context.work_done = 0;
-	node->context.work_index = 0;
 	node->context.works = NULL;
-	Work_Context_Node* temp = arena->free_list;
-	arena->free_list = node;
-	arena->free_list->next = temp;
+	work_context_node_arena_push(arena, node, node);
+}
+
+// Allocates a node for a new job. When a bounded arena is exhausted the caller sleeps until a job completes.
+static Work_Context_Node* work_context_node_acquire(Filter_Engine engine) {
+	Work_Context_Controller* controller = &engine->wc_controller;
+	Work_Context_Node* node = work_context_node_arena_allocate(&controller->arena);
+	if (node != NULL) return node;
+	platform_mutex_lock(&controller->cs);
+	// Completions free the node before they look at done_waiters, so registering first means no missed wakeup
+	platform_atomic_increment(&controller->done_waiters);
+	while ((node = work_context_node_arena_allocate(&controller->arena)) == NULL) {
+		platform_condition_sleep(&controller->cv_done, &controller->cs);
+	}
+	platform_atomic_decrement(&controller->done_waiters);
+	platform_mutex_unlock(&controller->cs);
+
+	return node;
+}
+
+// Submit queue functions, the capacity is rounded up to a power of two.
+// It only holds contexts no worker has picked up yet, producers back off while it is full.
+static void submit_queue_initialize(Submit_Queue* queue, size_t capacity) {
+	uint32_t size = 2;
+	while (size < capacity) size *= 2;
+	queue->slots = (Submit_Slot*)calloc(size, sizeof(Submit_Slot));
+	if (queue->slots == NULL) {
+		fprintf(stderr, "Failed to allocate memory for submit queue\n");
+		exit(EXIT_FAILURE);
+	}
+	for (uint32_t i = 0; i < size; ++i) {
+		queue->slots[i].sequence = i;
+	}
+	queue->mask = size - 1;
+	queue->enqueue_position = 0;
+	queue->dequeue_position = 0;
+
+	return;
+}
+
+static void submit_queue_destroy(Submit_Queue* queue) {
+	free(queue->slots);
+	queue->slots = NULL;
+	queue->mask = 0;
+
+	return;
+}
+
+// Returns false when the queue is full
+static bool submit_queue_push(Submit_Queue* queue, Work_Context_Node* node) {
+	uint32_t position = platform_atomic_load(&queue->enqueue_position);
+	Submit_Slot* slot;
+	while (true) {
+		slot = &queue->slots[position & queue->mask];
+		int32_t difference = (int32_t)(platform_atomic_load(&slot->sequence) - position);
+		if (difference == 0) {
+			uint32_t previous = platform_atomic_compare_exchange(&queue->enqueue_position, position + 1, position);
+			if (previous == position) break;
+			position = previous;
+		}
+		else if (difference < 0) {
+			return false;
+		}
+		else {
+			position = platform_atomic_load(&queue->enqueue_position);
+		}
+	}
+	slot->node = node;
+	platform_atomic_store(&slot->sequence, position + 1);
+
+	return true;
+}
+
+// Returns NULL when the queue is empty
+static Work_Context_Node* submit_queue_pop(Submit_Queue* queue) {
+	uint32_t position = platform_atomic_load(&queue->dequeue_position);
+	Submit_Slot* slot;
+	while (true) {
+		slot = &queue->slots[position & queue->mask];
+		int32_t difference = (int32_t)(platform_atomic_load(&slot->sequence) - (position + 1));
+		if (difference == 0) {
+			uint32_t previous = platform_atomic_compare_exchange(&queue->dequeue_position, position + 1, position);
+			if (previous == position) break;
+			position = previous;
+		}
+		else if (difference < 0) {
+			return NULL;
+		}
+		else {
+			position = platform_atomic_load(&queue->dequeue_position);
+		}
+	}
+	Work_Context_Node* node = slot->node;
+	platform_atomic_store(&slot->sequence, position + queue->mask + 1);
+
+	return node;
+}
+
+static inline Submit_Queue* submit_queue_of(Work_Context_Controller* controller, uint32_t priority, uint32_t numa_node) {
+	return &controller->queues[priority * controller->node_count + numa_node];
+}
+
+// Takes the oldest context of the class from the worker's own node queue, then from the other nodes
+static Work_Context_Node* worker_pop_submitted(Worker* worker, uint32_t priority) {
+	Work_Context_Controller* controller = &worker->engine->wc_controller;
+	for (uint32_t i = 0; i < controller->node_count; ++i) {
+		Work_Context_Node* node = submit_queue_pop(submit_queue_of(controller, priority, (worker->node + i) % controller->node_count));
+		if (node != NULL) return node;
+	}
+
+	return NULL;
+}
+
+// Wakes at most count parked workers, never more than are actually asleep
+static void wake_workers(Work_Context_Controller* controller, uint32_t count) {
+	uint32_t sleeping = platform_atomic_load(&controller->sleeping_workers);
+	if (sleeping == 0) return;
+	if (count > sleeping) count = sleeping;
+	platform_mutex_lock(&controller->cs);
+	if (count == sleeping) platform_condition_wake_all(&controller->cv_start);
+	else for (uint32_t i = 0; i < count; ++i) platform_condition_wake_one(&controller->cv_start);
+	platform_mutex_unlock(&controller->cs);
+
+	return;
 }
 
-// Functions to manage the work context queue
-static void work_context_node_enqueue(Work_Context_Controller* controller, Work_Context_Node* node) {
-	EnterCriticalSection(&controller->cs);
-	if (controller->tail != NULL) controller->tail->next = node;
-	else controller->tail = node;
-	if (controller->head == NULL) controller->head = node;
-	controller->tail = node;
-	WakeAllConditionVariable(&controller->cv_start);
-	LeaveCriticalSection(&controller->cs);
+// Functions to manage the work context queue. A context is pushed whole, the first idle worker
+// to pop it spreads its items over the deques, so workers move on to the next context while
+// stragglers finish the previous one.
+static void work_context_node_enqueue(Filter_Engine engine, Work_Context_Node* node) {
+	Work_Context_Controller* controller = &engine->wc_controller;
+	Work_Context* context = &node->context;
+	for (uint32_t i = 0; i < context->work_count; ++i) {
+		context->works[i].node = node;
+	}
+	// The node can complete and be recycled as soon as it is pushed, so nothing reads it afterwards.
+	// Counting first also keeps queued_items from dipping below zero when a worker is quicker than us.
+	uint32_t work_count = context->work_count;
+	Submit_Queue* queue = submit_queue_of(controller, node->priority, node->numa_node);
+	node->submit_time = platform_time_microseconds();
+	platform_atomic_increment(&controller->jobs_in_flight);
+	platform_atomic_add(&controller->queued_items, work_count);
+	while (!submit_queue_push(queue, node)) {
+		platform_thread_yield();
+	}
+	wake_workers(controller, work_count);
 
 	return;
 }
 
-static void work_context_node_dequeue(Work_Context_Controller* controller) {
-	EnterCriticalSection(&controller->cs);
-	Work_Context_Node* node = controller->head;
-	if (node == NULL) {
-		LeaveCriticalSection(&controller->cs);
+// Called by the worker that finished the last item of the node's context
+static void work_context_node_complete(Filter_Engine engine, Work_Context_Node* node) {
+	Work_Context_Controller* controller = &engine->wc_controller;
+	work_context_destroy(node);
+	platform_atomic_store(&node->ticket, node->ticket + 1);
+	platform_atomic_decrement(&controller->jobs_in_flight);
+	work_context_node_arena_free(&controller->arena, node);
+	// Waiters bump done_waiters under cs before they check their jobs, so either they see the new ticket or we see them
+	if (platform_atomic_load(&controller->done_waiters) > 0) {
+		platform_mutex_lock(&controller->cs);
+		platform_condition_wake_all(&controller->cv_done);
+		platform_mutex_unlock(&controller->cs);
+	}
+}
+
+// Only valid while the node still holds the job, that is before its last item is counted
+static inline bool work_context_node_cancelled(Filter_Engine engine, Work_Context_Node* node) {
+	return platform_atomic_load(&node->cancel_ticket) == node->ticket
+		|| node->cancel_epoch != platform_atomic_load(&engine->wc_controller.cancel_epoch);
+}
+
+// Splits the context's items into one contiguous block per worker of the job's node, starting with the
+// distributing worker's own deque when it is on that node. Other nodes only get items by stealing.
+// A waiting caller passes NULL for worker, its blocks start with the node's first worker.
+static void work_context_node_distribute(Filter_Engine engine, Worker* worker, Work_Context_Node* node) {
+	Thread_Context* t_context = &engine->t_context;
+	Work_Context_Controller* controller = &engine->wc_controller;
+	Work_Context* context = &node->context;
+	uint32_t priority = node->priority;
+	uint64_t queue_us = platform_time_microseconds() - node->submit_time;
+	platform_atomic_add64(&controller->stats_jobs[priority], 1);
+	platform_atomic_add64(&controller->stats_queue_us_total[priority], queue_us);
+	uint64_t max_us = platform_atomic_load64(&controller->stats_queue_us_max[priority]);
+	while (queue_us > max_us) {
+		uint64_t previous = platform_atomic_compare_exchange64(&controller->stats_queue_us_max[priority], queue_us, max_us);
+		if (previous == max_us) break;
+		max_us = previous;
+	}
+	// Cancelled before anyone picked it up, none of the items ever reach a deque
+	if (work_context_node_cancelled(engine, node)) {
+		platform_atomic_add(&controller->queued_items, (uint32_t)0 - context->work_count);
+		work_context_node_complete(engine, node);
 		return;
 	}
-	controller->head = controller->head->next;
-	if (controller->head == NULL) {
-		controller->tail = NULL;
-		WakeAllConditionVariable(&controller->cv_done);
-	} else {
-		WakeAllConditionVariable(&controller->cv_start);
+	uint32_t* workers = &t_context->node_workers[t_context->node_worker_offset[node->numa_node]];
+	uint32_t thread_count = t_context->node_worker_offset[node->numa_node + 1] - t_context->node_worker_offset[node->numa_node];
+	uint32_t start = 0;
+	if (thread_count == 0) { // No worker landed on that node, any of them will do
+		workers = t_context->node_workers;
+		thread_count = (uint32_t)t_context->thread_count;
+	}
+	for (uint32_t w = 0; w < thread_count; ++w) {
+		if (worker != NULL && workers[w] == worker->index) start = w;
+	}
+	uint32_t first = 0;
+	for (uint32_t w = 0; w < thread_count; ++w) {
+		uint32_t last = (uint32_t)(((uint64_t)context->work_count * (w + 1)) / thread_count);
+		if (last > first) work_deque_push(&t_context->workers[workers[(w + start) % thread_count]].deques[priority], &context->works[first], last - first);
+		first = last;
+	}
+
+	return;
+}
+
+// Jobs go to the node that holds the input pages, the OS places a page on the node of the thread that touched it first
+static uint32_t job_numa_node(Filter_Engine engine, const void* data) {
+	uint32_t node_id;
+	if (engine->wc_controller.node_count < 2 || !platform_memory_node(data, &node_id)) return 0;
+	for (uint32_t n = 0; n < engine->wc_controller.node_count; ++n) {
+		if (engine->topology.node_ids[n] == node_id) return n;
+	}
+
+	return 0;
+}
+
+// Orders the processors for pinning: one thread of every core before any SMT sibling, and nodes take turns
+// so a pool smaller than the machine still has workers next to every node's memory
+static void worker_placement(const Platform_Topology* topology, uint32_t* order) {
+	size_t count = topology->processor_count;
+	uint32_t* core_rank = (uint32_t*)calloc(count, sizeof(uint32_t));
+	if (core_rank == NULL) {
+		fprintf(stderr, "Failed to allocate memory for worker placement\n");
+		exit(EXIT_FAILURE);
+	}
+	// Rank of the processor's core among the cores of its node, in OS order
+	for (size_t i = 0; i < count; ++i) {
+		const Platform_Processor* processor = &topology->processors[i];
+		uint32_t rank = 0;
+		bool sibling = false;
+		for (size_t j = 0; j < i && !sibling; ++j) {
+			const Platform_Processor* other = &topology->processors[j];
+			if (other->core == processor->core) {
+				rank = core_rank[j];
+				sibling = true;
+			}
+			else if (other->node == processor->node && other->smt == 0) {
+				rank++;
+			}
+		}
+		core_rank[i] = rank;
+		order[i] = (uint32_t)i;
+	}
+	// Insertion sort by (smt, core rank, node), topologies are small
+	for (size_t i = 1; i < count; ++i) {
+		uint32_t current = order[i];
+		const Platform_Processor* p = &topology->processors[current];
+		size_t j = i;
+		while (j > 0) {
+			const Platform_Processor* q = &topology->processors[order[j - 1]];
+			bool after = q->smt != p->smt ? q->smt > p->smt : core_rank[order[j - 1]] != core_rank[current] ? core_rank[order[j - 1]] > core_rank[current] : q->node > p->node;
+			if (!after) break;
+			order[j] = order[j - 1];
+			j--;
+		}
+		order[j] = current;
+	}
+	free(core_rank);
+
+	return;
+}
+
+// Decides how many work items a job is cut into, see the cost model constants at the top.
+// Area filters are cut into bands of whole rows, none shorter than the halo it reads around itself.
+// Tiled filters are cut along their tiles, see work_items_fill_tiles for the counts that fit.
+// Resampling is cut into bands of output rows, general_filter_helper caps the count at their number.
+static uint32_t work_chunk_count(Filter_Engine engine, Image* input, Work_Type type, const Filter_Params* params) {
+	uint64_t pixels = (uint64_t)input->width * input->height;
+	uint64_t bytes = pixels * input->channels;
+	uint32_t cost = get_filter_cost(type);
+	uint32_t chunks_per_worker = MIN_CHUNKS_PER_WORKER + cost - 1;
+	if (chunks_per_worker > MAX_CHUNKS_PER_WORKER) chunks_per_worker = MAX_CHUNKS_PER_WORKER;
+	uint64_t chunks = (uint64_t)engine->t_context.thread_count * chunks_per_worker;
+	uint64_t min_chunk_bytes = engine->min_chunk_bytes / cost;
+	if (min_chunk_bytes == 0) min_chunk_bytes = 1;
+	if (chunks > bytes / min_chunk_bytes) chunks = bytes / min_chunk_bytes;
+	if (chunks > pixels) chunks = pixels;
+	if (get_filter_is_tiled(type, params)) {
+		uint64_t tiles_down = (input->height + params->convolve.tile_rows - 1) / params->convolve.tile_rows;
+		uint64_t tiles_across = (input->width + params->convolve.tile_columns - 1) / params->convolve.tile_columns;
+		if (chunks > tiles_down) {
+			uint64_t groups = chunks / tiles_down;
+			chunks = tiles_down * (groups < tiles_across ? groups : tiles_across);
+		}
+	}
+	else if (get_filter_is_area(type)) {
+		uint32_t halo = get_filter_halo(type, params);
+		uint64_t bands = halo > 0 ? input->height / halo : input->height;
+		if (chunks > bands) chunks = bands;
 	}
-	LeaveCriticalSection(&controller->cs);
-	work_context_node_arena_free(&controller->arena, node);	
+	if (chunks == 0) chunks = 1;
+
+	return (uint32_t)chunks;
+}
+
+// Work item storage for a new job. Single image jobs never need more than the node's pooled items,
+// only a big batch gets a heap array, which work_context_destroy frees again.
+static Work_Item* work_context_node_items(Filter_Engine engine, Work_Context_Node* node, uint32_t count) {
+	if (count <= engine->wc_controller.arena.items_per_node) return node->items;
+	Work_Item* works = (Work_Item*)malloc((size_t)count * sizeof(Work_Item));
+	if (works == NULL) {
+		fprintf(stderr, "Failed to allocate memory for work items\n");
+		exit(EXIT_FAILURE);
+	}
+
+	return works;
 }
 
 // Function to create a thread work context for processing an image
-static Work_Context work_context_create(Image* input, unsigned char* output, Work_Type type) {
+static Work_Context work_context_create(Filter_Engine engine, Work_Item* works, Image* input, Image* output, Work_Type type, const Filter_Params* params, uint32_t chunk_count) {
 	Work_Context context = { 0 };
 	Filter_Function function;
-	function = get_filter_function(type, input->channels);
+	function = get_filter_function(engine, type, input->channels, params);
 	assert(function != NULL && "Check get_filter_function()");
-	uint32_t count = input->height/ WORK_ITEM_ROWS;
-	assert(count > 0 && "You forgot to add a suffiicent threshold");
-	uint32_t remainder = input->height % WORK_ITEM_ROWS;
-	context.work_count = count;
-	context.work_index = 0;
+	assert(chunk_count > 0);
+	context.work_count = chunk_count;
 	context.work_done = 0;
-	context.works = (Work_Item*)calloc(context.work_count, sizeof(Work_Item));
-	for (uint32_t i = 0; i < count; ++i) {
-		context.works[i].image = input->data + (i * WORK_ITEM_ROWS * input->channels * input->width);
-		context.works[i].output = output + (i * WORK_ITEM_ROWS * input->channels * input->width);
-		context.works[i].width = input->width;
-		context.works[i].height = WORK_ITEM_ROWS;
-		context.works[i].function = function;
+	context.works = works;
+	if (get_filter_is_resample(type)) work_items_fill_resize(context.works, input, output, function, params, chunk_count);
+	else if (get_filter_is_tiled(type, params)) work_items_fill_tiles(context.works, input, output->data, function, params, chunk_count, params->convolve.tile_columns, params->convolve.tile_rows);
+	else if (get_filter_is_area(type)) work_items_fill_rows(context.works, input, output->data, function, params, chunk_count, get_filter_halo(type, params));
+	else work_items_fill(context.works, input, output->data, function, params, chunk_count);
+
+	return context;
+}
+
+// One context for a whole batch. Every image is cut like a single job would be, so images under the
+// minimum chunk size become one item each and the batch as a whole still spreads over the pool.
+static Work_Context work_context_create_batch(Filter_Engine engine, Work_Item* works, uint32_t work_count, Image* inputs, Image* outputs, size_t count, Work_Type type) {
+	Work_Context context = { 0 };
+	context.work_count = work_count;
+	context.work_done = 0;
+	context.works = works;
+	const Filter_Params* params = get_filter_params(engine, type);
+	for (size_t i = 0; i < count; ++i) {
+		uint32_t chunk_count = work_chunk_count(engine, &inputs[i], type, params);
+		work_items_fill(works, &inputs[i], outputs[i].data, get_filter_function(engine, type, inputs[i].channels, params), params, chunk_count);
+		works += chunk_count;
 	}
-	if (remainder > 0) context.works[count - 1].height += remainder;
 
 	return context;
 }
 
-// Function to destroy a thread work context
-static void work_context_destroy(Work_Context context) {
-	free(context.works);
+// Point filters do not care about rows, so the image is treated as one flat pixel run and cut into chunk_count equal pieces
+static void work_items_fill(Work_Item* works, Image* input, unsigned char* output, Filter_Function function, const Filter_Params* params, uint32_t chunk_count) {
+	uint64_t pixels = (uint64_t)input->width * input->height;
+	uint64_t first = 0;
+	for (uint32_t i = 0; i < chunk_count; ++i) {
+		uint64_t last = pixels * (i + 1) / chunk_count;
+		works[i].image = input->data + first * input->channels;
+		works[i].output = output + first * input->channels;
+		works[i].width = (uint32_t)(last - first);
+		works[i].height = 1;
+		works[i].function = function;
+		works[i].params = params;
+		works[i].stride = (size_t)works[i].width * input->channels;
+		works[i].halo_top = 0;
+		works[i].halo_bottom = 0;
+		works[i].row = 0;
+		works[i].column = 0;
+		first = last;
+	}
+
+	return;
 }
 
-static void invert_color_work_3channel(Work_Item* work) {
-	for (uint32_t i = 0; i < work->width * work->height; ++i) {
-		uint32_t idx = i * 3; // Assuming RGB format, each pixel has 3 channels
-		work->output[idx] = 255 - work->image[idx];
-		work->output[idx + 1] = 255 - work->image[idx + 1];
-		work->output[idx + 2] = 255 - work->image[idx + 2];
+// Area filters get chunk_count bands of whole rows. Each band may read halo rows of its neighbours on either side,
+// so the items must not write where others read: general_filter_helper gives in-place jobs a copy of the input.
+static void work_items_fill_rows(Work_Item* works, Image* input, unsigned char* output, Filter_Function function, const Filter_Params* params, uint32_t chunk_count, uint32_t halo) {
+	size_t stride = (size_t)input->width * input->channels;
+	uint32_t first = 0;
+	for (uint32_t i = 0; i < chunk_count; ++i) {
+		uint32_t last = (uint32_t)((uint64_t)input->height * (i + 1) / chunk_count);
+		works[i].image = input->data + first * stride;
+		works[i].output = output + first * stride;
+		works[i].width = input->width;
+		works[i].height = last - first;
+		works[i].function = function;
+		works[i].params = params;
+		works[i].stride = stride;
+		works[i].halo_top = first < halo ? first : halo;
+		works[i].halo_bottom = input->height - last < halo ? input->height - last : halo;
+		works[i].row = first;
+		works[i].column = 0;
+		first = last;
 	}
+
+	return;
 }
 
-static void grayscale_work_3channel(Work_Item* work) {
-	for (uint32_t i = 0; i < work->width * work->height; ++i) {
-		uint32_t idx = i * 3; // Assuming RGB format, each pixel has 3 channels
-		unsigned char r = work->image[idx];
-		unsigned char g = work->image[idx + 1];
-		unsigned char b = work->image[idx + 2];
-		unsigned char gray = (unsigned char)(0.299f * r + 0.587f * g + 0.114f * b);
-		work->output[idx] = gray;
-		work->output[idx + 1] = gray;
-		work->output[idx + 2] = gray;
+// Resizing gets chunk_count bands of output rows. Every item reads from the whole input, the rows it needs follow from its row.
+static void work_items_fill_resize(Work_Item* works, Image* input, Image* output, Filter_Function function, const Filter_Params* params, uint32_t chunk_count) {
+	size_t stride = (size_t)output->width * output->channels;
+	uint32_t first = 0;
+	for (uint32_t i = 0; i < chunk_count; ++i) {
+		uint32_t last = (uint32_t)((uint64_t)output->height * (i + 1) / chunk_count);
+		works[i].image = input->data;
+		works[i].output = output->data + first * stride;
+		works[i].width = output->width;
+		works[i].height = last - first;
+		works[i].function = function;
+		works[i].params = params;
+		works[i].stride = stride;
+		works[i].halo_top = 0;
+		works[i].halo_bottom = 0;
+		works[i].row = first;
+		works[i].column = 0;
+		first = last;
 	}
+
+	return;
 }
 
-static void sepia_work_3channel(Work_Item* work) {
-	for (uint32_t i = 0; i < work->width * work->height; ++i) {
-		uint32_t idx = i * 3; // Assuming RGB format, each pixel has 3 channels
-		unsigned char r = work->image[idx];
-		unsigned char g = work->image[idx + 1];
-		unsigned char b = work->image[idx + 2];
-		work->output[idx] = (unsigned char)min(255, (int)(0.393f * r + 0.769f * g + 0.189f * b));
-		work->output[idx + 1] = (unsigned char)min(255, (int)(0.349f * r + 0.686f * g + 0.168f * b));
-		work->output[idx + 2] = (unsigned char)min(255, (int)(0.272f * r + 0.534f * g + 0.131f * b));
+// Tiled filters get rectangles of whole tiles. Up to one item per row of tiles they are bands of tile rows, beyond
+// that every row of tiles is cut into chunk_count / tiles_down runs of tiles, which work_chunk_count keeps exact.
+// Items read around their rectangle like area filters, in place they also work from a copy.
+static void work_items_fill_tiles(Work_Item* works, Image* input, unsigned char* output, Filter_Function function, const Filter_Params* params, uint32_t chunk_count, uint32_t tile_width, uint32_t tile_height) {
+	size_t stride = (size_t)input->width * input->channels;
+	uint32_t tiles_down = (input->height + tile_height - 1) / tile_height;
+	uint32_t tiles_across = (input->width + tile_width - 1) / tile_width;
+	uint32_t bands = chunk_count < tiles_down ? chunk_count : tiles_down;
+	uint32_t groups = chunk_count / bands;
+	for (uint32_t i = 0; i < chunk_count; ++i) {
+		uint32_t band = i / groups, group = i % groups;
+		uint64_t first_row = (uint64_t)tiles_down * band / bands * tile_height;
+		uint64_t last_row = (uint64_t)tiles_down * (band + 1) / bands * tile_height;
+		uint64_t first_column = (uint64_t)tiles_across * group / groups * tile_width;
+		uint64_t last_column = (uint64_t)tiles_across * (group + 1) / groups * tile_width;
+		if (last_row > input->height) last_row = input->height;
+		if (last_column > input->width) last_column = input->width;
+		works[i].image = input->data + first_row * stride + first_column * input->channels;
+		works[i].output = output + first_row * stride + first_column * input->channels;
+		works[i].width = (uint32_t)(last_column - first_column);
+		works[i].height = (uint32_t)(last_row - first_row);
+		works[i].function = function;
+		works[i].params = params;
+		works[i].stride = stride;
+		works[i].halo_top = 0;
+		works[i].halo_bottom = 0;
+		works[i].row = (uint32_t)first_row;
+		works[i].column = (uint32_t)first_column;
 	}
+
+	return;
 }
 
-static void invert_color_work_4channel(Work_Item* work) {
-	for (uint32_t i = 0; i < work->width * work->height; ++i) {
-		uint32_t idx = i * 4; // Assuming RGBA format, each pixel has 4 channels
-		work->output[idx] = 255 - work->image[idx];
-		work->output[idx + 1] = 255 - work->image[idx + 1];
-		work->output[idx + 2] = 255 - work->image[idx + 2];
-		work->output[idx + 3] = work->image[idx + 3]; 
+static unsigned char* image_copy(const Image* image) {
+	size_t size = (size_t)image->width * image->height * image->channels;
+	unsigned char* copy = (unsigned char*)malloc(size);
+	if (copy == NULL) {
+		fprintf(stderr, "Failed to allocate memory for a copy of the input image\n");
+		exit(EXIT_FAILURE);
 	}
+	memcpy(copy, image->data, size);
+
+	return copy;
+}
+
+static inline bool images_overlap(const Image* input, const Image* output) {
+	size_t input_size = (size_t)input->width * input->height * input->channels;
+	size_t output_size = (size_t)output->width * output->height * output->channels;
+
+	return input->data < output->data + output_size && output->data < input->data + input_size;
+}
+
+// Function to destroy a thread work context, pooled items stay with the node
+static void work_context_destroy(Work_Context_Node* node) {
+	if (node->context.works != node->items) free(node->context.works);
+	node->context.works = NULL;
+	free(node->source);
+	node->source = NULL;
+	release_filter_params(node->type, &node->params);
 }
 
-static void grayscale_work_4channel(Work_Item* work) {
-	for (uint32_t i = 0; i < work->width * work->height; ++i) {
-		uint32_t idx = i * 4; // Assuming RGBA format, each pixel has 4 channels
-		unsigned char r = work->image[idx];
-		unsigned char g = work->image[idx + 1];
-		unsigned char b = work->image[idx + 2];
-		unsigned char gray = (unsigned char)(0.299f * r + 0.587f * g + 0.114f * b);
-		work->output[idx] = gray;
-		work->output[idx + 1] = gray;
-		work->output[idx + 2] = gray;
-		work->output[idx + 3] = work->image[idx + 3];
+// Relative cost per pixel of each filter, invert is the unit. Drives work_chunk_count.
+static inline uint32_t get_filter_cost(Work_Type type) {
+	switch (type) {
+	case INVERT: return 1;
+	case GRAYSCALE: return 2;
+	case SEPIA: return 3;
+	case COLOR_MATRIX: return 3;
+	case LUT: return 1;
+	case BOX_BLUR: return 4;
+	case GAUSSIAN_BLUR: return 6;
+	case EDGE: return 3;
+	case SCALE_UP: return 3;
+	case SCALE_DOWN: return 6; // Per output pixel, each one reads several input pixels
+	case REDUCE: return 1; // Per input pixel
+	case CONVOLVE: return 6;
+	default: return 1;
 	}
 }
 
-static void sepia_work_4channel(Work_Item* work) {
-	for (uint32_t i = 0; i < work->width * work->height; ++i) {
-		uint32_t idx = i * 4; // Assuming RGBA format, each pixel has 3 channels
-		unsigned char r = work->image[idx];
-		unsigned char g = work->image[idx + 1];
-		unsigned char b = work->image[idx + 2];
-		work->output[idx] = (unsigned char)min(255, (int)(0.393f * r + 0.769f * g + 0.189f * b));
-		work->output[idx + 1] = (unsigned char)min(255, (int)(0.349f * r + 0.686f * g + 0.168f * b));
-		work->output[idx + 2] = (unsigned char)min(255, (int)(0.272f * r + 0.534f * g + 0.131f * b));
-		work->output[idx + 3] = work->image[idx + 3];
+// Area filters read the pixels around each output pixel, they are cut into bands of rows instead of pixel runs
+static inline bool get_filter_is_area(Work_Type type) {
+	return type == BOX_BLUR || type == GAUSSIAN_BLUR || type == EDGE || type == CONVOLVE;
+}
+
+// Resizing and reducing write an image of another size, their items are bands of output rows
+static inline bool get_filter_is_resample(Work_Type type) {
+	return type == SCALE_UP || type == SCALE_DOWN || type == REDUCE;
+}
+
+// Convolutions through the FFT work on whole tiles, their items are rectangles of tiles instead of bands
+static inline bool get_filter_is_tiled(Work_Type type, const Filter_Params* params) {
+	return type == CONVOLVE && params != NULL && params->convolve.tile_rows != 0;
+}
+
+// Rows an area filter reads above and below each output row
+static inline uint32_t get_filter_halo(Work_Type type, const Filter_Params* params) {
+	switch (type) {
+	case BOX_BLUR: return params->box_blur.radius;
+	case GAUSSIAN_BLUR: return params->gaussian_blur.halo;
+	case EDGE: return 1;
+	case CONVOLVE: return params->convolve.anchor_y; // The rows below the anchor are never more
+	default: return 0;
 	}
 }
 
-// Function to get the appropriate filter function based on the work type
-static inline Filter_Function get_filter_function(Work_Type type, int channel) {
-	if (channel == 3){
-		switch (type) {
-		case GRAYSCALE: return grayscale_work_3channel;
-		case INVERT: return invert_color_work_3channel;
-		case SEPIA: return sepia_work_3channel;
-		default: return NULL;
-		}
+// Gives back what a job's parameters hold, cached resize axes or a copy of a convolution kernel
+static inline void release_filter_params(Work_Type type, Filter_Params* params) {
+	switch (type) {
+	case SCALE_UP:
+	case SCALE_DOWN: resize_release(&params->resize); break;
+	case CONVOLVE: convolve_release(&params->convolve); break;
+	default: break;
 	}
-	else if (channel == 4){
-		switch (type) {
-		case GRAYSCALE: return grayscale_work_4channel;
-		case INVERT: return invert_color_work_4channel;
-		case SEPIA: return sepia_work_4channel;
-		default: return NULL;
-		}
+}
+
+// Parameters the engine owns for a work type, NULL if the type takes none or only caller supplied ones
+static inline const Filter_Params* get_filter_params(Filter_Engine engine, Work_Type type) {
+	switch (type) {
+	case GRAYSCALE: return &engine->grayscale_params;
+	case SEPIA: return &engine->sepia_params;
+	default: return NULL;
 	}
-	else {
-		return NULL;
+}
+
+// Function to get the appropriate filter function based on the work type, from the kernels picked for this CPU.
+// Color matrices carry the kernel that color_matrix_prepare picked for them.
+static inline Filter_Function get_filter_function(Filter_Engine engine, Work_Type type, int channel, const Filter_Params* params) {
+	if (channel != 3 && channel != 4) return NULL;
+	int layout = channel - 3; // 0 for RGB, 1 for RGBA
+	switch (type) {
+	case GRAYSCALE:
+	case SEPIA:
+	case COLOR_MATRIX: return params != NULL ? params->matrix.function[layout] : NULL;
+	case INVERT: return engine->kernels.invert[layout];
+	case LUT: return params != NULL ? engine->kernels.lut[layout] : NULL;
+	case BOX_BLUR: return params == NULL ? NULL : (layout == 0 ? box_blur_work_3channel : box_blur_work_4channel);
+	case GAUSSIAN_BLUR: return params == NULL ? NULL : (layout == 0 ? gaussian_blur_work_3channel : gaussian_blur_work_4channel);
+	case EDGE: return params == NULL ? NULL : (layout == 0 ? edge_work_3channel : edge_work_4channel);
+	case SCALE_UP:
+	case SCALE_DOWN: return params == NULL ? NULL : (layout == 0 ? resize_work_3channel : resize_work_4channel);
+	case REDUCE: return params == NULL ? NULL : (layout == 0 ? reduce_work_3channel : reduce_work_4channel);
+	case CONVOLVE: return params == NULL ? NULL : (layout == 0 ? convolve_work_3channel : convolve_work_4channel);
+	default: return NULL;
 	}
 }
 
 // Helper function for single step filters by Work_Type enum. Built to prevent code duplication.
-static void general_filter_helper(Filter_Engine engine, Image* input, Image* output, Work_Type type) {
+// params is NULL for the filters whose parameters the engine owns, caller supplied ones are copied into the job's node.
+// Jobs that run inline on the caller return an empty ticket which always reads as done.
+static Filter_Job general_filter_helper(Filter_Engine engine, Image* input, Image* output, Work_Type type, const Filter_Params* params, Filter_Priority priority) {
+	Filter_Job job = { NULL, 0 };
 	assert(input->channels == 3 || input->channels == 4);
-	Filter_Function function = get_filter_function(type, input->channels);
-	if (function == NULL) {
-		fprintf(stderr, "Unsupported filter type or image channel count\n");
-		return;
+	bool owned_params = params == NULL;
+	if (owned_params) params = get_filter_params(engine, type);
+	Filter_Function function = get_filter_function(engine, type, input->channels, params);
+	if (function == NULL || priority >= PRIORITY_COUNT) {
+		fprintf(stderr, "Unsupported filter type, image channel count or priority\n");
+		return job;
 	}
-	if (input->height <= THRESHOLD) {
-		Work_Item work = { input->data, output->data, input->width, input->height, function };
+	// Jobs are cut by the rows they write, only resampling writes an image of another size. Reducing reads
+	// many more pixels than it writes, its chunks are sized by the input like any other filter.
+	Image* target = get_filter_is_resample(type) ? output : input;
+	uint32_t chunk_count = work_chunk_count(engine, type == REDUCE ? input : target, type, params);
+	if (get_filter_is_resample(type) && chunk_count > target->height) chunk_count = target->height;
+	// Area filters and resizing read pixels that other rows overwrite, in place they read a copy of the input instead
+	Image source = *input;
+	bool copy_source = (get_filter_is_area(type) || get_filter_is_resample(type)) && images_overlap(input, output);
+	if (chunk_count == 1) {
+		if (copy_source) source.data = image_copy(input);
+		Work_Item work = { source.data, output->data, target->width, target->height, function, params };
+		work.stride = (size_t)target->width * target->channels;
 		work.function(&work);
-		return;
+		if (copy_source) free(source.data);
+		release_filter_params(type, (Filter_Params*)params);
+		return job;
+	}
+	Work_Context_Node* node = work_context_node_acquire(engine);
+	if (!owned_params) {
+		node->params = *params;
+		params = &node->params;
+	}
+	if (copy_source) {
+		node->source = image_copy(input);
+		source.data = node->source;
 	}
-	Work_Context context = work_context_create(input, output->data, type);
-	Work_Context_Node* node = work_context_node_arena_allocate(&engine->wc_controller.arena);
+	Work_Context context = work_context_create(engine, work_context_node_items(engine, node, chunk_count), &source, output, type, params, chunk_count);
+
+	return work_context_submit(engine, node, context, input->data, type, priority);
+}
+
+// Puts a filled context on its node and queues it. data picks the NUMA node.
+static Filter_Job work_context_submit(Filter_Engine engine, Work_Context_Node* node, Work_Context context, const void* data, Work_Type type, Filter_Priority priority) {
+	Filter_Job job = { NULL, 0 };
 	node->context = context;
-	work_context_node_enqueue(&engine->wc_controller, node);
+	node->type = type;
+	node->numa_node = job_numa_node(engine, data);
+	node->priority = priority;
+	node->cancel_epoch = platform_atomic_load(&engine->wc_controller.cancel_epoch);
+	job.node = node;
+	job.ticket = node->ticket;
+	work_context_node_enqueue(engine, node);
+
+	return job;
+}
+
+// Nodes are never returned to the OS before filter_engine_destroy, so reading a recycled node's ticket is safe
+static inline bool filter_job_is_done(Filter_Job job) {
+	return job.node == NULL || platform_atomic_load(&job.node->ticket) != job.ticket;
+}
+
+static bool all_jobs_done(Filter_Engine engine, const void* params) {
+	(void)params;
+	return platform_atomic_load(&engine->wc_controller.jobs_in_flight) == 0;
+}
+
+static bool job_done(Filter_Engine engine, const void* params) {
+	(void)engine;
+	return filter_job_is_done(*(const Filter_Job*)params);
+}
+
+static bool any_job_done(Filter_Engine engine, const void* params) {
+	(void)engine;
+	const Wait_Any_Params* any = (const Wait_Any_Params*)params;
+	for (size_t i = 0; i < any->count; ++i) {
+		if (filter_job_is_done(any->jobs[i])) return true;
+	}
+
+	return false;
+}
+
+// Shared by all waits. The caller runs queued items until the condition holds and only sleeps on cv_done
+// when nothing is left to pick up, then it wakes with the next completion and looks again.
+static void engine_wait_until(Filter_Engine engine, Wait_Condition condition, const void* params) {
+	Work_Context_Controller* controller = &engine->wc_controller;
+	uint32_t seed = (uint32_t)platform_time_microseconds() | 1;
+	while (!condition(engine, params)) {
+		if (caller_run_work(engine, &seed)) continue;
+		if (platform_atomic_load(&controller->queued_items) != 0) { // A worker is distributing a context right now
+			platform_thread_yield();
+			continue;
+		}
+		platform_mutex_lock(&controller->cs);
+		// Completions look at done_waiters after they bump the ticket, so registering first means no missed wakeup
+		platform_atomic_increment(&controller->done_waiters);
+		if (!condition(engine, params) && platform_atomic_load(&controller->queued_items) == 0) {
+			platform_condition_sleep(&controller->cv_done, &controller->cs);
+		}
+		platform_atomic_decrement(&controller->done_waiters);
+		platform_mutex_unlock(&controller->cs);
+	}
 
 	return;
 }
@@ -349,79 +1250,455 @@ Filter_Engine filter_engine_create() {
 }
 
 void filter_engine_initialize(Filter_Engine engine, size_t Arena_Size, size_t Thread_Count) {
+	Filter_Engine_Options options = { 0 };
+	options.arena_size = Arena_Size;
+	options.arena_max_size = DEFAULT;
+	options.thread_count = Thread_Count;
+	filter_engine_initialize_with_options(engine, &options);
+
+	return;
+}
+
+void filter_engine_initialize_with_options(Filter_Engine engine, const Filter_Engine_Options* options) {
+	size_t Arena_Size = options->arena_size;
+	size_t Thread_Count = options->thread_count;
 	if (Arena_Size == DEFAULT) Arena_Size = DEFAULT_ARENA_SIZE;
-	if (Thread_Count == DEFAULT) {
-		SYSTEM_INFO sys_info;
-		GetSystemInfo(&sys_info);
-		Thread_Count = sys_info.dwNumberOfProcessors;
-	}
+	if (Thread_Count == DEFAULT) Thread_Count = platform_processor_count();
+	if (Thread_Count > MAX_THREADS) Thread_Count = MAX_THREADS;
+	engine->min_chunk_bytes = options->min_chunk_bytes == DEFAULT ? DEFAULT_MIN_CHUNK_BYTES : options->min_chunk_bytes;
+	engine->simd_level = filter_kernels_select(&engine->kernels, options->simd_level);
+	engine->color_math = options->color_math;
+	float matrix[20];
+	filter_color_matrix_grayscale(matrix);
+	color_matrix_prepare(&engine->grayscale_params.matrix, matrix, &engine->kernels, engine->color_math);
+	filter_color_matrix_sepia(matrix);
+	color_matrix_prepare(&engine->sepia_params.matrix, matrix, &engine->kernels, engine->color_math);
+	engine->resample_cache = resample_cache_create();
 	engine->t_context.thread_count = Thread_Count;
-	engine->t_context.threads = (HANDLE*)calloc(Thread_Count, sizeof(HANDLE));
-	if (engine->t_context.threads == NULL) {
+	engine->t_context.threads = (Platform_Thread*)calloc(Thread_Count, sizeof(Platform_Thread));
+	engine->t_context.workers = (Worker*)calloc(Thread_Count, sizeof(Worker));
+	if (engine->t_context.threads == NULL || engine->t_context.workers == NULL) {
 		fprintf(stderr, "Failed to allocate memory for thread handles\n");
 		exit(EXIT_FAILURE);
 	}
-	work_context_node_arena_initialize(&engine->wc_controller.arena, Arena_Size);
-	engine->wc_controller.head = NULL;
-	engine->wc_controller.tail = NULL;
-	engine->wc_controller.shutdown = FALSE;
-	InitializeCriticalSection(&engine->wc_controller.cs);
-	InitializeConditionVariable(&engine->wc_controller.cv_start);
-	InitializeConditionVariable(&engine->wc_controller.cv_done);
+	// Workers only stay on a node when they are pinned, otherwise the whole machine is treated as one node
+	platform_topology_query(&engine->topology);
+	uint32_t node_count = options->pin_workers ? (uint32_t)engine->topology.node_count : 1;
+	size_t processor_count = engine->topology.processor_count;
+	uint32_t* placement = (uint32_t*)calloc(processor_count, sizeof(uint32_t));
+	engine->t_context.node_workers = (uint32_t*)calloc(Thread_Count, sizeof(uint32_t));
+	engine->t_context.node_worker_offset = (uint32_t*)calloc(node_count + 1, sizeof(uint32_t));
+	engine->wc_controller.queues = (Submit_Queue*)calloc(PRIORITY_COUNT * node_count, sizeof(Submit_Queue));
+	if (placement == NULL || engine->t_context.node_workers == NULL || engine->t_context.node_worker_offset == NULL || engine->wc_controller.queues == NULL) {
+		fprintf(stderr, "Failed to allocate memory for worker placement\n");
+		exit(EXIT_FAILURE);
+	}
+	if (options->pin_workers) worker_placement(&engine->topology, placement);
+	for (size_t i = 0; i < Thread_Count; ++i) {
+		Worker* worker = &engine->t_context.workers[i];
+		for (uint32_t priority = 0; priority < PRIORITY_COUNT; ++priority) {
+			work_deque_initialize(&worker->deques[priority]);
+		}
+		worker->engine = engine;
+		worker->index = (uint32_t)i;
+		worker->node = options->pin_workers ? engine->topology.processors[placement[i % processor_count]].node : 0;
+		worker->seed = 2654435761u * (uint32_t)(i + 1); // Any non-zero xorshift seed works
+		engine->t_context.node_worker_offset[worker->node + 1]++;
+	}
+	for (uint32_t n = 0; n < node_count; ++n) {
+		engine->t_context.node_worker_offset[n + 1] += engine->t_context.node_worker_offset[n];
+	}
+	for (uint32_t n = 0, next = 0; n < node_count; ++n) {
+		for (size_t i = 0; i < Thread_Count; ++i) {
+			if (engine->t_context.workers[i].node == n) engine->t_context.node_workers[next++] = (uint32_t)i;
+		}
+	}
+	// The most items work_chunk_count ever cuts a single image into
+	work_context_node_arena_initialize(&engine->wc_controller.arena, Arena_Size, options->arena_max_size, (uint32_t)Thread_Count * MAX_CHUNKS_PER_WORKER);
+	engine->wc_controller.node_count = node_count;
+	for (uint32_t q = 0; q < PRIORITY_COUNT * node_count; ++q) {
+		submit_queue_initialize(&engine->wc_controller.queues[q], Arena_Size > MIN_SUBMIT_QUEUE_SIZE ? Arena_Size : MIN_SUBMIT_QUEUE_SIZE);
+	}
+	engine->wc_controller.cancel_epoch = 0;
+	for (uint32_t priority = 0; priority < PRIORITY_COUNT; ++priority) {
+		engine->wc_controller.stats_jobs[priority] = 0;
+		engine->wc_controller.stats_queue_us_total[priority] = 0;
+		engine->wc_controller.stats_queue_us_max[priority] = 0;
+	}
+	engine->wc_controller.queued_items = 0;
+	engine->wc_controller.jobs_in_flight = 0;
+	engine->wc_controller.sleeping_workers = 0;
+	engine->wc_controller.done_waiters = 0;
+	engine->wc_controller.shutdown = false;
+	engine->wc_controller.idle_policy = options->idle_policy;
+	engine->wc_controller.idle_spin_us = options->idle_spin_us == DEFAULT ? DEFAULT_IDLE_SPIN_MICROSECONDS : options->idle_spin_us;
+	engine->wc_controller.idle_yield_us = options->idle_yield_us == DEFAULT ? DEFAULT_IDLE_YIELD_MICROSECONDS : options->idle_yield_us;
+	platform_mutex_initialize(&engine->wc_controller.cs);
+	platform_condition_initialize(&engine->wc_controller.cv_start);
+	platform_condition_initialize(&engine->wc_controller.cv_done);
 	for (size_t i = 0; i < Thread_Count; ++i) {
-		engine->t_context.threads[i] = CreateThread(NULL, 0, thread_proc, engine, 0, NULL);
-		if (engine->t_context.threads[i] == NULL) {
+		if (!platform_thread_create(&engine->t_context.threads[i], thread_proc, &engine->t_context.workers[i])) {
 			fprintf(stderr, "Failed to create thread %zu\n", i);
 			exit(EXIT_FAILURE);
 		}
+		// Best effort, an unpinned worker still works, it just may wander off its node
+		if (options->pin_workers) platform_thread_pin(engine->t_context.threads[i], engine->topology.processors[placement[i % processor_count]].os_index);
 	}
+	free(placement);
 
 	return;
 }
 
 void filter_engine_destroy(Filter_Engine engine) {
 	filter_engine_wait(engine);
-	EnterCriticalSection(&engine->wc_controller.cs);
-	engine->wc_controller.shutdown = TRUE;
-	WakeAllConditionVariable(&engine->wc_controller.cv_start);
-	LeaveCriticalSection(&engine->wc_controller.cs);
+	platform_mutex_lock(&engine->wc_controller.cs);
+	platform_atomic_store(&engine->wc_controller.shutdown, true);
+	platform_condition_wake_all(&engine->wc_controller.cv_start);
+	platform_mutex_unlock(&engine->wc_controller.cs);
+	for (size_t i = 0; i < engine->t_context.thread_count; ++i) {
+		platform_thread_join(engine->t_context.threads[i]);
+	}
 	for (size_t i = 0; i < engine->t_context.thread_count; ++i) {
-		WaitForSingleObject(engine->t_context.threads[i], INFINITE);
-		CloseHandle(engine->t_context.threads[i]);
+		for (uint32_t priority = 0; priority < PRIORITY_COUNT; ++priority) {
+			work_deque_destroy(&engine->t_context.workers[i].deques[priority]);
+		}
 	}
 	free(engine->t_context.threads);
+	free(engine->t_context.workers);
+	free(engine->t_context.node_workers);
+	free(engine->t_context.node_worker_offset);
 	work_context_node_arena_destroy(&engine->wc_controller.arena);
-	DeleteCriticalSection(&engine->wc_controller.cs);
+	for (uint32_t q = 0; q < PRIORITY_COUNT * engine->wc_controller.node_count; ++q) {
+		submit_queue_destroy(&engine->wc_controller.queues[q]);
+	}
+	free(engine->wc_controller.queues);
+	platform_topology_free(&engine->topology);
+	resample_cache_destroy(engine->resample_cache);
+	platform_condition_destroy(&engine->wc_controller.cv_start);
+	platform_condition_destroy(&engine->wc_controller.cv_done);
+	platform_mutex_destroy(&engine->wc_controller.cs);
 	memset(engine, 0, sizeof(Filter_Engine));
 
 	return;
 }
 
 void filter_engine_wait(Filter_Engine engine) {
-	EnterCriticalSection(&engine->wc_controller.cs);
-	if (engine->wc_controller.head != NULL) {
-		SleepConditionVariableCS(&engine->wc_controller.cv_done, &engine->wc_controller.cs, INFINITE);
+	engine_wait_until(engine, all_jobs_done, NULL);
+}
+
+void filter_engine_job_wait(Filter_Engine engine, Filter_Job job) {
+	engine_wait_until(engine, job_done, &job);
+}
+
+bool filter_engine_job_poll(Filter_Engine engine, Filter_Job job) {
+	(void)engine;
+	return filter_job_is_done(job);
+}
+
+size_t filter_engine_job_wait_any(Filter_Engine engine, const Filter_Job* jobs, size_t count) {
+	assert(count > 0);
+	Wait_Any_Params params = { jobs, count };
+	engine_wait_until(engine, any_job_done, &params);
+	// Done jobs stay done, so the one that ended the wait is still there
+	for (size_t i = 0; i < count; ++i) {
+		if (filter_job_is_done(jobs[i])) return i;
 	}
-	LeaveCriticalSection(&engine->wc_controller.cs);
+
+	return count;
+}
+
+bool filter_engine_cancel(Filter_Engine engine, Filter_Job job) {
+	(void)engine;
+	if (filter_job_is_done(job)) return false;
+	// A stale ticket can never match the node's ticket again, so cancelling a job that just finished is harmless.
+	// The job may also finish right after the store because its remaining items were skipped, checking again
+	// would then report a cancelled job as done.
+	platform_atomic_store(&job.node->cancel_ticket, job.ticket);
+
+	return true;
+}
+
+void filter_engine_cancel_all(Filter_Engine engine) {
+	platform_atomic_increment(&engine->wc_controller.cancel_epoch);
+}
+
+void filter_engine_get_stats(Filter_Engine engine, Filter_Engine_Stats* stats) {
+	Work_Context_Controller* controller = &engine->wc_controller;
+	for (uint32_t priority = 0; priority < PRIORITY_COUNT; ++priority) {
+		stats->jobs[priority] = platform_atomic_load64(&controller->stats_jobs[priority]);
+		stats->queue_us_total[priority] = platform_atomic_load64(&controller->stats_queue_us_total[priority]);
+		stats->queue_us_max[priority] = platform_atomic_load64(&controller->stats_queue_us_max[priority]);
+	}
+}
+
+// Not atomic as a whole, jobs picked up while resetting may count towards either side
+void filter_engine_reset_stats(Filter_Engine engine) {
+	Work_Context_Controller* controller = &engine->wc_controller;
+	for (uint32_t priority = 0; priority < PRIORITY_COUNT; ++priority) {
+		platform_atomic_store64(&controller->stats_jobs[priority], 0);
+		platform_atomic_store64(&controller->stats_queue_us_total[priority], 0);
+		platform_atomic_store64(&controller->stats_queue_us_max[priority], 0);
+	}
+}
+
+Filter_Simd_Level filter_engine_simd_level(Filter_Engine engine) {
+	return engine->simd_level;
+}
+
+Filter_Job filter_engine_submit(Filter_Engine engine, Image* input, Image* output, Work_Type type, Filter_Priority priority) {
+	return general_filter_helper(engine, input, output, type, NULL, priority);
+}
+
+// All images share one context, one node and one wakeup. The ticket completes once every image is done.
+Filter_Job filter_engine_submit_batch(Filter_Engine engine, Image* inputs, Image* outputs, size_t count, Work_Type type, Filter_Priority priority) {
+	Filter_Job job = { NULL, 0 };
+	if (count == 0) return job;
+	const Filter_Params* params = get_filter_params(engine, type);
+	for (size_t i = 0; i < count; ++i) {
+		if (get_filter_function(engine, type, inputs[i].channels, params) == NULL || priority >= PRIORITY_COUNT) {
+			fprintf(stderr, "Unsupported filter type, image channel count or priority\n");
+			return job;
+		}
+	}
+	uint64_t work_count = 0;
+	for (size_t i = 0; i < count; ++i) {
+		work_count += work_chunk_count(engine, &inputs[i], type, params);
+	}
+	assert(work_count <= UINT32_MAX && "Batch has too many work items");
+	if (work_count == 1) {
+		Work_Item work = { inputs[0].data, outputs[0].data, inputs[0].width, inputs[0].height, get_filter_function(engine, type, inputs[0].channels, params), params };
+		work.stride = (size_t)inputs[0].width * inputs[0].channels;
+		work.function(&work);
+		return job;
+	}
+	Work_Context_Node* node = work_context_node_acquire(engine);
+	Work_Item* works = work_context_node_items(engine, node, (uint32_t)work_count);
+	Work_Context context = work_context_create_batch(engine, works, (uint32_t)work_count, inputs, outputs, count, type);
+
+	return work_context_submit(engine, node, context, inputs[0].data, type, priority);
+}
+
+Filter_Job filter_engine_submit_invert(Filter_Engine engine, Image* input, Image* output) {
+	return general_filter_helper(engine, input, output, INVERT, NULL, PRIORITY_INTERACTIVE);
+}
+
+Filter_Job filter_engine_submit_grayscale(Filter_Engine engine, Image* input, Image* output) {
+	return general_filter_helper(engine, input, output, GRAYSCALE, NULL, PRIORITY_INTERACTIVE);
+}
+
+Filter_Job filter_engine_submit_sepia(Filter_Engine engine, Image* input, Image* output) {
+	return general_filter_helper(engine, input, output, SEPIA, NULL, PRIORITY_INTERACTIVE);
 }
 
 // Function to invert the colors of an image
 void filter_engine_invert(Filter_Engine engine, Image* input, Image* output) {
-	general_filter_helper(engine, input, output, INVERT);
+	general_filter_helper(engine, input, output, INVERT, NULL, PRIORITY_INTERACTIVE);
 
 	return;
 }
 
 // Function to convert an image to grayscale
 void filter_engine_grayscale(Filter_Engine engine, Image* input, Image* output) {
-	general_filter_helper(engine, input, output, GRAYSCALE);
+	general_filter_helper(engine, input, output, GRAYSCALE, NULL, PRIORITY_INTERACTIVE);
 
 	return;
 }
 
 // Function to convert an image to sepia
 void filter_engine_sepia(Filter_Engine engine, Image* input, Image* output) {
-	general_filter_helper(engine, input, output, SEPIA);
+	general_filter_helper(engine, input, output, SEPIA, NULL, PRIORITY_INTERACTIVE);
+
+	return;
+}
+
+// The matrix is prepared here, on the caller's thread, and the job carries its own copy
+Filter_Job filter_engine_submit_color_matrix(Filter_Engine engine, Image* input, Image* output, const float matrix[20], Filter_Priority priority) {
+	Filter_Job job = { NULL, 0 };
+	Filter_Params params;
+	if (!color_matrix_prepare(&params.matrix, matrix, &engine->kernels, engine->color_math)) {
+		fprintf(stderr, "Unsupported color matrix, weights must be within +-256 and offsets within +-65536\n");
+		return job;
+	}
+
+	return general_filter_helper(engine, input, output, COLOR_MATRIX, &params, priority);
+}
+
+// The chain is folded into one matrix first, so the image is read and written once however long the chain is
+Filter_Job filter_engine_submit_color_matrices(Filter_Engine engine, Image* input, Image* output, const float matrices[][20], size_t count, Filter_Priority priority) {
+	float combined[20];
+	filter_color_matrix_identity(combined);
+	for (size_t i = 0; i < count; ++i) {
+		filter_color_matrix_concat(combined, combined, matrices[i]);
+	}
+
+	return filter_engine_submit_color_matrix(engine, input, output, combined, priority);
+}
+
+// Function to apply a color matrix to an image
+void filter_engine_color_matrix(Filter_Engine engine, Image* input, Image* output, const float matrix[20]) {
+	filter_engine_submit_color_matrix(engine, input, output, matrix, PRIORITY_INTERACTIVE);
+
+	return;
+}
+
+// One table per channel of the input, copied with the job like a color matrix
+Filter_Job filter_engine_submit_lut(Filter_Engine engine, Image* input, Image* output, const uint8_t lut[][256], Filter_Priority priority) {
+	Filter_Params params;
+	lut_prepare(&params.lut, lut, input->channels);
+
+	return general_filter_helper(engine, input, output, LUT, &params, priority);
+}
+
+// Function to map every channel of an image through its lookup table
+void filter_engine_lut(Filter_Engine engine, Image* input, Image* output, const uint8_t lut[][256]) {
+	filter_engine_submit_lut(engine, input, output, lut, PRIORITY_INTERACTIVE);
+
+	return;
+}
+
+// The radius is checked here, on the caller's thread, and the job carries its own copy
+Filter_Job filter_engine_submit_box_blur(Filter_Engine engine, Image* input, Image* output, uint32_t radius, Filter_Priority priority) {
+	Filter_Job job = { NULL, 0 };
+	Filter_Params params;
+	if (!box_blur_prepare(&params.box_blur, radius)) {
+		fprintf(stderr, "Unsupported box blur radius, it must be 1024 or less\n");
+		return job;
+	}
+
+	return general_filter_helper(engine, input, output, BOX_BLUR, &params, priority);
+}
+
+// Function to blur an image with a box of (2 * radius + 1)^2 pixels
+void filter_engine_box_blur(Filter_Engine engine, Image* input, Image* output, uint32_t radius) {
+	filter_engine_submit_box_blur(engine, input, output, radius, PRIORITY_INTERACTIVE);
+
+	return;
+}
+
+// FIR or recursive filter is picked here from sigma, see gaussian_blur_prepare
+Filter_Job filter_engine_submit_gaussian_blur(Filter_Engine engine, Image* input, Image* output, float sigma, Filter_Priority priority) {
+	Filter_Job job = { NULL, 0 };
+	Filter_Params params;
+	if (!gaussian_blur_prepare(&params.gaussian_blur, sigma)) {
+		fprintf(stderr, "Unsupported gaussian blur sigma, it must be above 0 and 256 or less\n");
+		return job;
+	}
+
+	return general_filter_helper(engine, input, output, GAUSSIAN_BLUR, &params, priority);
+}
+
+// Function to blur an image with a Gaussian of the given standard deviation in pixels
+void filter_engine_gaussian_blur(Filter_Engine engine, Image* input, Image* output, float sigma) {
+	filter_engine_submit_gaussian_blur(engine, input, output, sigma, PRIORITY_INTERACTIVE);
+
+	return;
+}
+
+// Gradient magnitude per color channel, or of the luma when luma is set
+Filter_Job filter_engine_submit_edge(Filter_Engine engine, Image* input, Image* output, Filter_Edge_Operator edge_operator, bool luma, Filter_Priority priority) {
+	Filter_Job job = { NULL, 0 };
+	Filter_Params params;
+	if (!edge_prepare(&params.edge, edge_operator, luma)) {
+		fprintf(stderr, "Unsupported edge operator\n");
+		return job;
+	}
+
+	return general_filter_helper(engine, input, output, EDGE, &params, priority);
+}
+
+// Function to compute an edge map of an image
+void filter_engine_edge(Filter_Engine engine, Image* input, Image* output, Filter_Edge_Operator edge_operator, bool luma) {
+	filter_engine_submit_edge(engine, input, output, edge_operator, luma, PRIORITY_INTERACTIVE);
+
+	return;
+}
+
+// The output size picks SCALE_UP or SCALE_DOWN, the job holds its cached weights until it completes
+Filter_Job filter_engine_submit_resize(Filter_Engine engine, Image* input, Image* output, Filter_Resample filter, Filter_Priority priority) {
+	Filter_Job job = { NULL, 0 };
+	Filter_Params params;
+	if (input->channels != output->channels || (input->channels != 3 && input->channels != 4) || priority >= PRIORITY_COUNT) {
+		fprintf(stderr, "Unsupported resize, image channel counts or priority\n");
+		return job;
+	}
+	if (input->width == 0 || input->height == 0 || output->width == 0 || output->height == 0) return job;
+	if (!resize_prepare(&params.resize, engine->resample_cache, input, output, filter)) {
+		fprintf(stderr, "Unsupported resample filter\n");
+		return job;
+	}
+	Work_Type type = output->width >= input->width && output->height >= input->height ? SCALE_UP : SCALE_DOWN;
+
+	return general_filter_helper(engine, input, output, type, &params, priority);
+}
+
+// Function to resample an image to the size of output
+void filter_engine_resize(Filter_Engine engine, Image* input, Image* output, Filter_Resample filter) {
+	filter_engine_submit_resize(engine, input, output, filter, PRIORITY_INTERACTIVE);
+
+	return;
+}
+
+// The factor and the output size are checked here, the job carries its own copy of the level
+Filter_Job filter_engine_submit_reduce(Filter_Engine engine, Image* input, Image* output, uint32_t factor, Filter_Priority priority) {
+	Filter_Job job = { NULL, 0 };
+	Filter_Params params;
+	if (!reduce_prepare(&params.reduce, input, output, 1, factor)) {
+		fprintf(stderr, "Unsupported reduce, the factor must be 1 to 1024 and the output the input divided by it\n");
+		return job;
+	}
+
+	return general_filter_helper(engine, input, output, REDUCE, &params, priority);
+}
+
+// Function to shrink an image by an integer factor
+void filter_engine_reduce(Filter_Engine engine, Image* input, Image* output, uint32_t factor) {
+	filter_engine_submit_reduce(engine, input, output, factor, PRIORITY_INTERACTIVE);
+
+	return;
+}
+
+// The kernel is checked and copied here, split into its factors when it is rank-1 and transformed when it is large
+// enough for the FFT. The job frees both.
+Filter_Job filter_engine_submit_convolve(Filter_Engine engine, Image* input, Image* output, const float* kernel, uint32_t kernel_width, uint32_t kernel_height, Filter_Border border, Filter_Priority priority) {
+	Filter_Job job = { NULL, 0 };
+	Filter_Params params;
+	if ((input->channels != 3 && input->channels != 4) || priority >= PRIORITY_COUNT) {
+		fprintf(stderr, "Unsupported convolution, image channel count or priority\n");
+		return job;
+	}
+	if (!convolve_prepare(&params.convolve, input, kernel, kernel_width, kernel_height, border, (uint32_t)engine->t_context.thread_count)) {
+		fprintf(stderr, "Unsupported convolution kernel, both sides must be 1 to 255 and every weight finite\n");
+		return job;
+	}
+
+	return general_filter_helper(engine, input, output, CONVOLVE, &params, priority);
+}
+
+// Function to convolve an image with any kernel
+void filter_engine_convolve(Filter_Engine engine, Image* input, Image* output, const float* kernel, uint32_t kernel_width, uint32_t kernel_height, Filter_Border border) {
+	filter_engine_submit_convolve(engine, input, output, kernel, kernel_width, kernel_height, border, PRIORITY_INTERACTIVE);
+
+	return;
+}
+
+// One job reduces as many levels as the bands can hold. A band must end on a row of its last level, so the levels
+// with fewer rows than there are bands, a few tiny ones at the end, are reduced one by one after it.
+void filter_engine_build_pyramid(Filter_Engine engine, Image* input, Image* levels, size_t count) {
+	Filter_Params params;
+	if (count == 0) return;
+	if (count > REDUCE_MAX_LEVELS || !reduce_prepare(&params.reduce, input, levels, (uint32_t)count, 2)) {
+		fprintf(stderr, "Unsupported pyramid, every level must halve the one before it\n");
+		return;
+	}
+	uint32_t chunk_count = work_chunk_count(engine, input, REDUCE, &params);
+	uint32_t depth = 1;
+	while (depth < count && (input->height >> (depth + 1)) >= chunk_count) depth++;
+	params.reduce.level_count = depth;
+	filter_engine_job_wait(engine, general_filter_helper(engine, input, &levels[depth - 1], REDUCE, &params, PRIORITY_INTERACTIVE));
+	for (size_t k = depth; k < count; ++k) {
+		reduce_prepare(&params.reduce, &levels[k - 1], &levels[k], 1, 2);
+		filter_engine_job_wait(engine, general_filter_helper(engine, &levels[k - 1], &levels[k], REDUCE, &params, PRIORITY_INTERACTIVE));
+	}
 
 	return;
 }
@@ -1,12 +1,19 @@
 #ifndef FILTER_H
 #define FILTER_H
-#include <windows.h>
 #include <stdint.h>
+#include <stddef.h>
 
 #define DEFAULT 0
 struct _Filter_Engine;
+struct Work_Context_Node;
 
 typedef _Filter_Engine* Filter_Engine;
+
+// Ticket for one submitted filter call. It stays valid after the job completes, until the engine is destroyed.
+typedef struct Filter_Job {
+	Work_Context_Node* node;
+	uint32_t ticket;
+} Filter_Job;
 	
 typedef struct Image {
     unsigned char* data;
@@ -14,25 +21,166 @@ typedef struct Image {
     uint32_t channels;
 } Image;
 
+// What a worker does when it runs out of work
+enum Idle_Policy {
+	IDLE_SPIN_THEN_PARK = DEFAULT,	// Spin for idle_spin_us, yield for idle_yield_us, then sleep until woken.
+	IDLE_PARK,						// Sleep right away. Lowest CPU use, every job pays an OS wakeup.
+	IDLE_SPIN						// Never sleep. Lowest latency, keeps every worker's core busy while idle.
+};
+
+// Scheduling class of a job. Workers always finish picking up interactive items before they touch batch ones,
+// so an interactive job submitted during a batch export starts as soon as the current work items are done.
+enum Filter_Priority {
+	PRIORITY_INTERACTIVE = DEFAULT,	// Used by the filter_engine_submit_* shortcuts.
+	PRIORITY_BATCH,
+	PRIORITY_COUNT
+};
+
+// Widest instruction set the point filter kernels may use. The CPU is checked once when the engine is initialized,
+// a level it does not support falls back to the next narrower one. Every level produces the same output.
+enum Filter_Simd_Level {
+	SIMD_AUTO = DEFAULT,	// Widest level the CPU supports.
+	SIMD_SCALAR,
+	SIMD_SSE41,
+	SIMD_AVX2,
+	SIMD_AVX512
+};
+
+// How color matrices, grayscale and sepia included, compute their weighted channel sums
+enum Filter_Color_Math {
+	COLOR_MATH_EXACT = DEFAULT,	// Float math, bit-exact with the reference kernels on every CPU.
+	COLOR_MATH_FAST				// 16-bit fixed point, never more than one off the exact result. Faster, and also the same on every CPU.
+								// Matrices with a weight of 32 or more keep the float math.
+};
+
+// Gradient operator of filter_engine_submit_edge, both 3x3. The magnitude sqrt(gx^2 + gy^2) is rounded and clamped to a byte.
+enum Filter_Edge_Operator {
+	EDGE_SOBEL = DEFAULT,	// Smooths across the gradient with 1 2 1.
+	EDGE_SCHARR				// 3 10 3, responds more evenly to edges at any angle. Scaled by 1/4 to the Sobel range.
+};
+
+// Reconstruction filter of filter_engine_resize. When shrinking, every filter but nearest widens by the scale,
+// so each output pixel averages all the input pixels it covers instead of aliasing.
+enum Filter_Resample {
+	RESAMPLE_BILINEAR = DEFAULT,	// Triangle, 2 taps per axis when enlarging.
+	RESAMPLE_NEAREST,				// Copies the input pixel under each output pixel's center, never blends.
+	RESAMPLE_BICUBIC,				// Cubic convolution with a = -0.5, 4 taps. Sharper, may ring slightly at hard edges.
+	RESAMPLE_LANCZOS3				// Windowed sinc, 6 taps. Sharpest and slowest.
+};
+
+// What filter_engine_convolve reads where the kernel reaches past the image edge
+enum Filter_Border {
+	BORDER_CLAMP = DEFAULT,	// Repeats the edge pixel, like the blurs.
+	BORDER_MIRROR,			// Reflects around the edge pixel without repeating it: c b | a b c.
+	BORDER_WRAP,			// Tiles the image, the right edge continues with the left one.
+	BORDER_CONSTANT			// Zero in every channel.
+};
+
+// Queueing statistics per priority class, the time from submit until a worker picks the job up
+typedef struct Filter_Engine_Stats {
+	uint64_t jobs[PRIORITY_COUNT];
+	uint64_t queue_us_total[PRIORITY_COUNT];
+	uint64_t queue_us_max[PRIORITY_COUNT];
+} Filter_Engine_Stats;
+
+// Engine settings for filter_engine_initialize_with_options, fields left as DEFAULT take the default value.
+typedef struct Filter_Engine_Options {
+	size_t arena_size;		// Job nodes per arena slab, the arena starts with one slab. DEFAULT is 64.
+	size_t arena_max_size;	// Once this many jobs are queued submits block until one completes. DEFAULT grows up to 4096 slabs.
+	size_t thread_count;	// DEFAULT is one worker per processor.
+	size_t min_chunk_bytes;	// Smallest slice of input bytes handed to a worker for the cheapest filter. DEFAULT is 256 KiB.
+	Idle_Policy idle_policy;
+	size_t idle_spin_us;	// DEFAULT is 20 microseconds.
+	size_t idle_yield_us;	// DEFAULT is 50 microseconds.
+	bool pin_workers;		// Pins every worker to one processor, whole cores before SMT siblings, and gives every NUMA node its own job queue.
+	Filter_Simd_Level simd_level;
+	Filter_Color_Math color_math;
+} Filter_Engine_Options;
+
 enum Work_Type {
 	GRAYSCALE,
 	INVERT,
 	SEPIA,
-	BOX_BLUR,
-	GAUSSIAN_BLUR,
-	EDGE,
-	SCALE_UP,
-	SCALE_DOWN
+	BOX_BLUR,		// Only through filter_engine_submit_box_blur, it needs the radius.
+	GAUSSIAN_BLUR,	// Only through filter_engine_submit_gaussian_blur, it needs sigma.
+	EDGE,			// Only through filter_engine_submit_edge, it needs the operator.
+	SCALE_UP,		// Only through filter_engine_submit_resize, which picks one of the two from the sizes.
+	SCALE_DOWN,
+	REDUCE,			// Only through filter_engine_submit_reduce and filter_engine_build_pyramid, it needs the factor.
+	CONVOLVE,		// Only through filter_engine_submit_convolve, it needs the kernel.
+	COLOR_MATRIX,	// Only through filter_engine_submit_color_matrix, it needs the matrix.
+	LUT				// Only through filter_engine_submit_lut, it needs the tables.
 };
 
+// Color matrices are 4x5 and row-major, each row computes one output channel from the input pixel:
+// out = m[0] * r + m[1] * g + m[2] * b + m[3] * a + m[4], with the offset m[4] in byte units, truncated and clamped to 0..255.
+// RGB images read alpha as 255 and ignore the alpha row. Weights must be within +-256 and offsets within +-65536.
+void filter_color_matrix_identity(float matrix[20]);
+void filter_color_matrix_grayscale(float matrix[20]);													// What GRAYSCALE applies.
+void filter_color_matrix_sepia(float matrix[20]);														// What SEPIA applies.
+void filter_color_matrix_saturation(float matrix[20], float saturation);								// 0 is grayscale, 1 leaves the image as it is.
+void filter_color_matrix_brightness(float matrix[20], float offset);									// Adds offset to r, g and b.
+void filter_color_matrix_contrast(float matrix[20], float contrast);									// Scales r, g and b around mid gray.
+void filter_color_matrix_scale(float matrix[20], float r, float g, float b);							// Per channel gain, for white balance.
+void filter_color_matrix_concat(float result[20], const float first[20], const float second[20]);		// Applying result equals applying first, then second, without clamping in between. result may be either input.
+
+// Lookup tables map every value of one channel to a new byte, filter_engine_lut takes one table per channel of the image.
+// The builders round to the nearest byte and clamp. Chaining tables with filter_lut_concat gives exactly the same bytes
+// as applying them one after another, so any number of adjustments costs one pass.
+void filter_lut_identity(uint8_t lut[256]);
+void filter_lut_gamma(uint8_t lut[256], float gamma);												// 255 * (x / 255)^(1 / gamma), above 1 brightens the midtones.
+void filter_lut_levels(uint8_t lut[256], uint8_t in_black, uint8_t in_white, float gamma, uint8_t out_black, uint8_t out_white); // Stretches in_black..in_white to out_black..out_white, gamma as above in between.
+void filter_lut_brightness_contrast(uint8_t lut[256], float brightness, float contrast);			// contrast * (x - 127.5) + 127.5 + brightness.
+void filter_lut_curve(uint8_t lut[256], const uint8_t points[][2], size_t count);					// Straight lines through the (input, output) points, sorted by input, flat outside them.
+void filter_lut_concat(uint8_t result[256], const uint8_t first[256], const uint8_t second[256]);	// second[first[x]], result may be either input.
+
+// Mip pyramids halve both sides from one level to the next, rounding down and never below one pixel. Level 0 is the image.
+size_t filter_pyramid_level_count(uint32_t width, uint32_t height);											// Levels down to 1x1, level 0 included.
+void filter_pyramid_level_size(uint32_t width, uint32_t height, size_t level, uint32_t* level_width, uint32_t* level_height);
+
 
 Filter_Engine filter_engine_create();														  // Creates and initializes the filter engine.
 void filter_engine_initialize(Filter_Engine engine, size_t Arena_Size, size_t Thread_Count); // Initializes the filter engine with specified arena size and thread count. Use DEFAULT for default values.
+void filter_engine_initialize_with_options(Filter_Engine engine, const Filter_Engine_Options* options); // Same as above with every engine setting exposed.
 void filter_engine_destroy(Filter_Engine engine);											  // Destroys the filter engine and frees resources.
 void filter_engine_wait(Filter_Engine engine);												  // Waits for all filter operations to complete.
 
+bool filter_engine_job_poll(Filter_Engine engine, Filter_Job job);								  // Returns true once the job's output is fully written.
+void filter_engine_job_wait(Filter_Engine engine, Filter_Job job);								  // Waits for one job, other queued jobs keep running.
+size_t filter_engine_job_wait_any(Filter_Engine engine, const Filter_Job* jobs, size_t count);	  // Waits until any of the jobs is done and returns its index.
+bool filter_engine_cancel(Filter_Engine engine, Filter_Job job);								  // Skips the job's remaining work items, returns false if it was already done. Its output is left partly written.
+void filter_engine_cancel_all(Filter_Engine engine);											  // Cancels every job submitted so far, later submits are not affected.
+void filter_engine_get_stats(Filter_Engine engine, Filter_Engine_Stats* stats);				  // Jobs that ran inline on the caller are not counted.
+void filter_engine_reset_stats(Filter_Engine engine);
+Filter_Simd_Level filter_engine_simd_level(Filter_Engine engine);								  // Instruction set the kernels were picked for.
+
+Filter_Job filter_engine_submit(Filter_Engine engine, Image* input, Image* output, Work_Type type, Filter_Priority priority);
+Filter_Job filter_engine_submit_batch(Filter_Engine engine, Image* inputs, Image* outputs, size_t count, Work_Type type, Filter_Priority priority); // One job for all count images, small images still spread over the pool.
+
+Filter_Job filter_engine_submit_grayscale(Filter_Engine engine, Image* input, Image* output);
+Filter_Job filter_engine_submit_invert(Filter_Engine engine, Image* input, Image* output);
+Filter_Job filter_engine_submit_sepia(Filter_Engine engine, Image* input, Image* output);
+Filter_Job filter_engine_submit_color_matrix(Filter_Engine engine, Image* input, Image* output, const float matrix[20], Filter_Priority priority);
+Filter_Job filter_engine_submit_color_matrices(Filter_Engine engine, Image* input, Image* output, const float matrices[][20], size_t count, Filter_Priority priority); // Concatenates the chain and applies it in one pass.
+Filter_Job filter_engine_submit_lut(Filter_Engine engine, Image* input, Image* output, const uint8_t lut[][256], Filter_Priority priority); // lut has one table per channel of input.
+Filter_Job filter_engine_submit_box_blur(Filter_Engine engine, Image* input, Image* output, uint32_t radius, Filter_Priority priority); // Mean of the (2 * radius + 1)^2 box, edges repeat outwards. Radius up to 1024, the time per pixel does not grow with it.
+Filter_Job filter_engine_submit_gaussian_blur(Filter_Engine engine, Image* input, Image* output, float sigma, Filter_Priority priority); // Sigma in pixels, above 0 and up to 256. Edges repeat outwards.
+Filter_Job filter_engine_submit_edge(Filter_Engine engine, Image* input, Image* output, Filter_Edge_Operator edge_operator, bool luma, Filter_Priority priority); // Edge map, with luma one gray map instead of one per color channel. Alpha is kept.
+Filter_Job filter_engine_submit_resize(Filter_Engine engine, Image* input, Image* output, Filter_Resample filter, Filter_Priority priority); // Resamples input to the size of output, same channel count. Every channel alpha included is filtered on its own, edges repeat outwards.
+Filter_Job filter_engine_submit_reduce(Filter_Engine engine, Image* input, Image* output, uint32_t factor, Filter_Priority priority); // Rounded mean of every factor x factor block, factor up to 1024. output is input / factor rounded down and at least 1 on both sides, the last blocks take in the remainder.
+Filter_Job filter_engine_submit_convolve(Filter_Engine engine, Image* input, Image* output, const float* kernel, uint32_t kernel_width, uint32_t kernel_height, Filter_Border border, Filter_Priority priority); // kernel is row-major, up to 255 on each side, and centered on (kernel_width / 2, kernel_height / 2). Applied as given, not flipped. Alpha is kept.
+
 void filter_engine_grayscale(Filter_Engine engine, Image* input, Image* output);
 void filter_engine_invert(Filter_Engine engine, Image* input, Image* output);
 void filter_engine_sepia(Filter_Engine engine, Image* input, Image* output);
+void filter_engine_color_matrix(Filter_Engine engine, Image* input, Image* output, const float matrix[20]);
+void filter_engine_lut(Filter_Engine engine, Image* input, Image* output, const uint8_t lut[][256]);
+void filter_engine_box_blur(Filter_Engine engine, Image* input, Image* output, uint32_t radius);
+void filter_engine_gaussian_blur(Filter_Engine engine, Image* input, Image* output, float sigma);
+void filter_engine_edge(Filter_Engine engine, Image* input, Image* output, Filter_Edge_Operator edge_operator, bool luma);
+void filter_engine_resize(Filter_Engine engine, Image* input, Image* output, Filter_Resample filter);
+void filter_engine_reduce(Filter_Engine engine, Image* input, Image* output, uint32_t factor);
+void filter_engine_convolve(Filter_Engine engine, Image* input, Image* output, const float* kernel, uint32_t kernel_width, uint32_t kernel_height, Filter_Border border);
+void filter_engine_build_pyramid(Filter_Engine engine, Image* input, Image* levels, size_t count); // Writes levels 1 to count into levels[0..count), sized as by filter_pyramid_level_size. Returns once all are written.
 
 #endif
\ No newline at end of file
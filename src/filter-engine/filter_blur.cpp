@@ -0,0 +1,527 @@
+#include "filter_kernels.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Area filters. An item is a band of whole rows and may read halo_top rows above and halo_bottom rows below it.
+// The halo only comes up short at the image edges, so clamping a row index to the halo repeats the edge row.
+
+// Largest radius box_blur_prepare takes, 255 * (2 * 1024 + 1)^2 still fits the 32-bit box sums
+const uint32_t BOX_BLUR_MAX_RADIUS = 1024;
+
+// The mean is (sum + area / 2) * reciprocal >> BOX_BLUR_SHIFT. With reciprocal = ceil(2^56 / area) the error
+// stays below 1 / area for every sum up to 255 * area, so this is the exact rounded division, and still fits 64 bits.
+const uint32_t BOX_BLUR_SHIFT = 56;
+
+static void* blur_allocate(size_t size) {
+	void* memory = malloc(size);
+	if (memory == NULL) {
+		fprintf(stderr, "Failed to allocate memory for the blur buffers\n");
+		exit(EXIT_FAILURE);
+	}
+
+	return memory;
+}
+
+static inline unsigned char box_mean(const Box_Blur* blur, uint32_t sum) {
+	return (unsigned char)(((uint64_t)(sum + blur->area / 2) * blur->reciprocal) >> BOX_BLUR_SHIFT);
+}
+
+static inline int64_t box_row_clamp(int64_t y, int64_t top, int64_t bottom) {
+	return y < top ? top : (y > bottom ? bottom : y);
+}
+
+// Adds count copies of a row to the column sums
+static void box_column_add(uint32_t* sums, const unsigned char* row, size_t bytes, uint32_t count) {
+	for (size_t i = 0; i < bytes; ++i) {
+		sums[i] += count * row[i];
+	}
+}
+
+// Moves the vertical window down one row, the sums wrap in between but never end up negative
+static void box_column_slide(uint32_t* sums, const unsigned char* add, const unsigned char* remove, size_t bytes) {
+	for (size_t i = 0; i < bytes; ++i) {
+		sums[i] += (uint32_t)add[i] - remove[i];
+	}
+}
+
+// Horizontal running sum over one row of column sums. Only the pixels within radius of either edge
+// need the clamped indices, the middle of the row adds one column and drops another.
+static inline void box_row(const Box_Blur* blur, const uint32_t* sums, unsigned char* output, uint32_t width, uint32_t channels) {
+	int64_t radius = blur->radius;
+	int64_t last = (int64_t)width - 1;
+	uint32_t totals[4];
+	for (uint32_t c = 0; c < channels; ++c) {
+		totals[c] = (uint32_t)(radius + 1) * sums[c];
+		for (int64_t i = 1; i <= radius; ++i) {
+			totals[c] += sums[(i < last ? i : last) * channels + c];
+		}
+	}
+	int64_t x = 0;
+	for (; x < width && (x < radius || x + radius + 1 > last); ++x) {
+		int64_t add = x + radius + 1 < last ? x + radius + 1 : last;
+		int64_t remove = x > radius ? x - radius : 0;
+		for (uint32_t c = 0; c < channels; ++c) {
+			output[x * channels + c] = box_mean(blur, totals[c]);
+			totals[c] += sums[add * channels + c] - sums[remove * channels + c];
+		}
+	}
+	for (; x + radius + 1 <= last; ++x) {
+		const uint32_t* add = sums + (x + radius + 1) * channels;
+		const uint32_t* remove = sums + (x - radius) * channels;
+		for (uint32_t c = 0; c < channels; ++c) {
+			output[x * channels + c] = box_mean(blur, totals[c]);
+			totals[c] += add[c] - remove[c];
+		}
+	}
+	for (; x < width; ++x) {
+		int64_t remove = x - radius;
+		for (uint32_t c = 0; c < channels; ++c) {
+			output[x * channels + c] = box_mean(blur, totals[c]);
+			totals[c] += sums[last * channels + c] - sums[remove * channels + c];
+		}
+	}
+}
+
+// Vertical pass first: the column sums of the window follow the output row down the band, one row
+// added and one dropped per step, then each output row is a horizontal running sum over them
+static inline void box_blur_rows(Work_Item* work, uint32_t channels) {
+	const Box_Blur* blur = (const Box_Blur*)work->params;
+	int64_t radius = blur->radius;
+	size_t bytes = (size_t)work->width * channels;
+	int64_t top = -(int64_t)work->halo_top;
+	int64_t bottom = (int64_t)work->height - 1 + work->halo_bottom;
+	uint32_t* sums = (uint32_t*)blur_allocate(bytes * sizeof(uint32_t));
+	memset(sums, 0, bytes * sizeof(uint32_t));
+	// Window of the first row, the rows past the halo are the edge row repeated
+	int64_t first = -radius > top ? -radius : top;
+	int64_t last = radius < bottom ? radius : bottom;
+	for (int64_t y = first; y <= last; ++y) {
+		box_column_add(sums, work->image + y * (ptrdiff_t)work->stride, bytes, 1);
+	}
+	box_column_add(sums, work->image + top * (ptrdiff_t)work->stride, bytes, (uint32_t)(first + radius));
+	box_column_add(sums, work->image + bottom * (ptrdiff_t)work->stride, bytes, (uint32_t)(radius - last));
+	for (int64_t y = 0; y < work->height; ++y) {
+		box_row(blur, sums, work->output + y * (ptrdiff_t)work->stride, work->width, channels);
+		if (y + 1 == work->height) break;
+		int64_t add = box_row_clamp(y + radius + 1, top, bottom);
+		int64_t remove = box_row_clamp(y - radius, top, bottom);
+		if (add != remove) box_column_slide(sums, work->image + add * (ptrdiff_t)work->stride, work->image + remove * (ptrdiff_t)work->stride, bytes);
+	}
+	free(sums);
+}
+
+void box_blur_work_3channel(Work_Item* work) {
+	box_blur_rows(work, 3);
+}
+
+void box_blur_work_4channel(Work_Item* work) {
+	box_blur_rows(work, 4);
+}
+
+bool box_blur_prepare(Box_Blur* prepared, uint32_t radius) {
+	if (radius > BOX_BLUR_MAX_RADIUS) return false;
+	prepared->radius = radius;
+	prepared->area = (2 * radius + 1) * (2 * radius + 1);
+	prepared->reciprocal = (((uint64_t)1 << BOX_BLUR_SHIFT) + prepared->area - 1) / prepared->area;
+
+	return true;
+}
+
+// --- Gaussian blur. Both paths blur down the columns of the band first, straight from the image and its halo,
+// and round into the output rows, then blur each output row in place. ---
+
+const float GAUSSIAN_MAX_SIGMA = 256.0f;
+
+const float GAUSSIAN_FIR_SIGMAS = 3.0f; // FIR radius, the weights past 3 sigma add up to under 0.3%
+
+// From this sigma on the recursive filter beats the FIR, measured with BlurBench
+const float GAUSSIAN_IIR_MIN_SIGMA = 4.0f;
+
+// Poles of the recursive filter for sigma 2, one of a conjugate pair and the real one
+const double GAUSSIAN_IIR_POLES[2][2] = { { 1.41650, 1.00829 }, { 1.86543, 0.0 } };
+
+// The recursive filter's response to a band edge is below half a step after 4 sigma, so the bands warm up over that many rows
+const float GAUSSIAN_IIR_HALO_SIGMAS = 4.0f;
+
+const size_t GAUSSIAN_STRIP_BYTES = 64; // Columns of one vertical strip, the sums and the rows of its taps stay in L1
+
+const uint32_t GAUSSIAN_ROW_GROUP = 8; // Rows the horizontal recursive pass runs side by side, one lane per row and channel
+
+// Clamps after the conversion, integer selects keep the loops that round a strip vectorized where float ones do not
+static inline unsigned char gaussian_round(float value) {
+	int rounded = (int)(value + 0.5f);
+	rounded = rounded < 0 ? 0 : rounded;
+	rounded = rounded > 255 ? 255 : rounded;
+
+	return (unsigned char)rounded;
+}
+
+// Vertical FIR over column strips of the band. Walking a strip down the rows keeps the rows of the taps in L1
+// from one output row to the next, and the loops over the strip vectorize.
+static void gaussian_fir_columns(const Gaussian_Blur* blur, const Work_Item* work, size_t bytes) {
+	int64_t radius = blur->halo;
+	int64_t top = -(int64_t)work->halo_top;
+	int64_t bottom = (int64_t)work->height - 1 + work->halo_bottom;
+	ptrdiff_t stride = (ptrdiff_t)work->stride;
+	float sums[GAUSSIAN_STRIP_BYTES];
+	for (size_t strip = 0; strip < bytes; strip += GAUSSIAN_STRIP_BYTES) {
+		size_t count = bytes - strip < GAUSSIAN_STRIP_BYTES ? bytes - strip : GAUSSIAN_STRIP_BYTES;
+		const unsigned char* image = work->image + strip;
+		for (int64_t y = 0; y < work->height; ++y) {
+			const unsigned char* center = image + y * stride;
+			for (size_t i = 0; i < count; ++i) {
+				sums[i] = blur->weights[0] * center[i];
+			}
+			for (int64_t k = 1; k <= radius; ++k) {
+				const unsigned char* above = image + box_row_clamp(y - k, top, bottom) * stride;
+				const unsigned char* below = image + box_row_clamp(y + k, top, bottom) * stride;
+				float weight = blur->weights[k];
+				for (size_t i = 0; i < count; ++i) {
+					sums[i] += weight * (float)(above[i] + below[i]);
+				}
+			}
+			unsigned char* output = work->output + y * stride + strip;
+			for (size_t i = 0; i < count; ++i) {
+				output[i] = gaussian_round(sums[i]);
+			}
+		}
+	}
+}
+
+// Horizontal FIR over one row in place. The row is copied to a float line with radius pixels of the edge
+// repeated on either side, so every byte sums the same taps without bounds checks.
+static void gaussian_fir_row(const Gaussian_Blur* blur, unsigned char* row, float* line, uint32_t width, uint32_t channels) {
+	size_t radius = blur->halo;
+	size_t bytes = (size_t)width * channels;
+	size_t pad = radius * channels;
+	for (size_t i = 0; i < bytes; ++i) {
+		line[pad + i] = row[i];
+	}
+	for (size_t x = 0; x < radius; ++x) {
+		for (uint32_t c = 0; c < channels; ++c) {
+			line[x * channels + c] = row[c];
+			line[pad + bytes + x * channels + c] = row[bytes - channels + c];
+		}
+	}
+	float sums[GAUSSIAN_STRIP_BYTES];
+	for (size_t strip = 0; strip < bytes; strip += GAUSSIAN_STRIP_BYTES) {
+		size_t count = bytes - strip < GAUSSIAN_STRIP_BYTES ? bytes - strip : GAUSSIAN_STRIP_BYTES;
+		const float* center = line + pad + strip;
+		for (size_t i = 0; i < count; ++i) {
+			sums[i] = blur->weights[0] * center[i];
+		}
+		for (size_t k = 1; k <= radius; ++k) {
+			const float* left = center - k * channels;
+			const float* right = center + k * channels;
+			float weight = blur->weights[k];
+			for (size_t i = 0; i < count; ++i) {
+				sums[i] += weight * (left[i] + right[i]);
+			}
+		}
+		for (size_t i = 0; i < count; ++i) {
+			row[strip + i] = gaussian_round(sums[i]);
+		}
+	}
+}
+
+// Forward, then backward recursion along steps for lanes independent signals, stored step after step so the
+// loop over the lanes vectorizes. data has room for halo more steps, which repeat the last value so the forward
+// pass settles there. Each direction then starts in the steady state of its first value, like an edge that
+// repeats outwards.
+static void gaussian_iir_lanes(const Gaussian_Blur* blur, double* data, size_t steps, size_t lanes, double* edge) {
+	const double* c = blur->coefficients;
+	for (size_t n = steps; n < steps + blur->halo; ++n) {
+		memcpy(data + n * lanes, data + (steps - 1) * lanes, lanes * sizeof(double));
+	}
+	steps += blur->halo;
+	memcpy(edge, data, lanes * sizeof(double));
+	for (size_t n = 0; n < steps; ++n) {
+		double* out = data + n * lanes;
+		const double* previous_1 = n >= 1 ? out - lanes : edge;
+		const double* previous_2 = n >= 2 ? out - 2 * lanes : edge;
+		const double* previous_3 = n >= 3 ? out - 3 * lanes : edge;
+		for (size_t l = 0; l < lanes; ++l) {
+			out[l] = c[0] * out[l] + c[1] * previous_1[l] + c[2] * previous_2[l] + c[3] * previous_3[l];
+		}
+	}
+	memcpy(edge, data + (steps - 1) * lanes, lanes * sizeof(double));
+	for (size_t n = steps; n-- > 0;) {
+		double* out = data + n * lanes;
+		const double* next_1 = n + 1 < steps ? out + lanes : edge;
+		const double* next_2 = n + 2 < steps ? out + 2 * lanes : edge;
+		const double* next_3 = n + 3 < steps ? out + 3 * lanes : edge;
+		for (size_t l = 0; l < lanes; ++l) {
+			out[l] = c[0] * out[l] + c[1] * next_1[l] + c[2] * next_2[l] + c[3] * next_3[l];
+		}
+	}
+}
+
+// Vertical recursive pass, one column strip at a time through the whole band and its halo
+static void gaussian_iir_columns(const Gaussian_Blur* blur, const Work_Item* work, size_t bytes, double* columns, double* edge) {
+	ptrdiff_t stride = (ptrdiff_t)work->stride;
+	size_t steps = (size_t)work->halo_top + work->height + work->halo_bottom;
+	const unsigned char* first = work->image - (ptrdiff_t)work->halo_top * stride;
+	for (size_t strip = 0; strip < bytes; strip += GAUSSIAN_STRIP_BYTES) {
+		size_t count = bytes - strip < GAUSSIAN_STRIP_BYTES ? bytes - strip : GAUSSIAN_STRIP_BYTES;
+		for (size_t n = 0; n < steps; ++n) {
+			const unsigned char* source = first + (ptrdiff_t)n * stride + strip;
+			for (size_t i = 0; i < count; ++i) {
+				columns[n * count + i] = source[i];
+			}
+		}
+		gaussian_iir_lanes(blur, columns, steps, count, edge);
+		for (uint32_t y = 0; y < work->height; ++y) {
+			const double* values = columns + ((size_t)work->halo_top + y) * count;
+			unsigned char* output = work->output + y * stride + strip;
+			for (size_t i = 0; i < count; ++i) {
+				output[i] = gaussian_round(values[i]);
+			}
+		}
+	}
+}
+
+// Horizontal recursive pass in place. A row on its own would be one serial chain per channel, so
+// GAUSSIAN_ROW_GROUP rows are interleaved into lanes and run side by side.
+static void gaussian_iir_rows(const Gaussian_Blur* blur, const Work_Item* work, uint32_t channels, double* lines, double* edge) {
+	for (uint32_t first = 0; first < work->height; first += GAUSSIAN_ROW_GROUP) {
+		uint32_t rows = work->height - first < GAUSSIAN_ROW_GROUP ? work->height - first : GAUSSIAN_ROW_GROUP;
+		size_t lanes = (size_t)rows * channels;
+		for (uint32_t r = 0; r < rows; ++r) {
+			const unsigned char* row = work->output + (first + r) * work->stride;
+			for (size_t x = 0; x < work->width; ++x) {
+				for (uint32_t c = 0; c < channels; ++c) {
+					lines[x * lanes + r * channels + c] = row[x * channels + c];
+				}
+			}
+		}
+		gaussian_iir_lanes(blur, lines, work->width, lanes, edge);
+		for (uint32_t r = 0; r < rows; ++r) {
+			unsigned char* row = work->output + (first + r) * work->stride;
+			for (size_t x = 0; x < work->width; ++x) {
+				for (uint32_t c = 0; c < channels; ++c) {
+					row[x * channels + c] = gaussian_round(lines[x * lanes + r * channels + c]);
+				}
+			}
+		}
+	}
+}
+
+static inline void gaussian_blur_rows(Work_Item* work, uint32_t channels) {
+	const Gaussian_Blur* blur = (const Gaussian_Blur*)work->params;
+	size_t bytes = (size_t)work->width * channels;
+	if (!blur->recursive) {
+		float* line = (float*)blur_allocate((bytes + 2 * (size_t)blur->halo * channels) * sizeof(float));
+		gaussian_fir_columns(blur, work, bytes);
+		for (uint32_t y = 0; y < work->height; ++y) {
+			gaussian_fir_row(blur, work->output + y * work->stride, line, work->width, channels);
+		}
+		free(line);
+		return;
+	}
+	size_t steps = (size_t)work->halo_top + work->height + work->halo_bottom;
+	size_t columns_size = (steps + blur->halo) * GAUSSIAN_STRIP_BYTES;
+	size_t lines_size = ((size_t)work->width + blur->halo) * GAUSSIAN_ROW_GROUP * channels;
+	double* buffer = (double*)blur_allocate((columns_size > lines_size ? columns_size : lines_size) * sizeof(double));
+	double edge[GAUSSIAN_STRIP_BYTES > GAUSSIAN_ROW_GROUP * 4 ? GAUSSIAN_STRIP_BYTES : GAUSSIAN_ROW_GROUP * 4];
+	gaussian_iir_columns(blur, work, bytes, buffer, edge);
+	gaussian_iir_rows(blur, work, channels, buffer, edge);
+	free(buffer);
+}
+
+void gaussian_blur_work_3channel(Work_Item* work) {
+	gaussian_blur_rows(work, 3);
+}
+
+void gaussian_blur_work_4channel(Work_Item* work) {
+	gaussian_blur_rows(work, 4);
+}
+
+// Sampled Gaussian out to GAUSSIAN_FIR_SIGMAS, normalized so the weights add up to exactly one
+static void gaussian_fir_prepare(Gaussian_Blur* prepared) {
+	uint32_t radius = (uint32_t)ceilf(GAUSSIAN_FIR_SIGMAS * prepared->sigma);
+	if (radius > GAUSSIAN_FIR_MAX_RADIUS) radius = GAUSSIAN_FIR_MAX_RADIUS;
+	double weights[GAUSSIAN_FIR_MAX_RADIUS + 1];
+	double total = 0.0;
+	for (uint32_t k = 0; k <= radius; ++k) {
+		weights[k] = exp(-0.5 * (double)k * k / ((double)prepared->sigma * prepared->sigma));
+		total += k == 0 ? weights[k] : 2.0 * weights[k];
+	}
+	memset(prepared->weights, 0, sizeof(prepared->weights));
+	for (uint32_t k = 0; k <= radius; ++k) {
+		prepared->weights[k] = (float)(weights[k] / total);
+	}
+	prepared->halo = radius;
+	prepared->recursive = false;
+}
+
+// Variance of the forward and backward recursion through the poles scaled by 1 / q
+static double gaussian_iir_variance(double q) {
+	double variance = 0.0;
+	for (int k = 0; k < 2; ++k) {
+		// p / (p - 1)^2 for the complex pole and the real one, the conjugate pole adds the same real part again
+		double magnitude = pow(hypot(GAUSSIAN_IIR_POLES[k][0], GAUSSIAN_IIR_POLES[k][1]), 1.0 / q);
+		double angle = atan2(GAUSSIAN_IIR_POLES[k][1], GAUSSIAN_IIR_POLES[k][0]) / q;
+		double a = magnitude * cos(angle), b = magnitude * sin(angle);
+		double u = (a - 1.0) * (a - 1.0) - b * b, v = 2.0 * (a - 1.0) * b;
+		variance += (k == 0 ? 2.0 : 1.0) * (a * u + b * v) / (u * u + v * v);
+	}
+
+	return 2.0 * variance;
+}
+
+// Third order recursive Gaussian after van Vliet, Young and Verbeek, "Recursive Gaussian derivative filters", 1998.
+// The poles are scaled so the variance is exactly sigma^2, a step then stays within 0.3% of the exact Gaussian.
+static void gaussian_iir_prepare(Gaussian_Blur* prepared) {
+	double target = (double)prepared->sigma * prepared->sigma;
+	double low = 0.0, high = prepared->sigma; // q is about sigma / 2
+	for (int i = 0; i < 64; ++i) {
+		double q = 0.5 * (low + high);
+		if (gaussian_iir_variance(q) < target) low = q;
+		else high = q;
+	}
+	double q = 0.5 * (low + high);
+	// Expands (1 - r1 z)(1 - conj(r1) z)(1 - r3 z) with r = 1 / p into 1 + a1 z + a2 z^2 + a3 z^3
+	double magnitude = pow(hypot(GAUSSIAN_IIR_POLES[0][0], GAUSSIAN_IIR_POLES[0][1]), -1.0 / q);
+	double angle = -atan2(GAUSSIAN_IIR_POLES[0][1], GAUSSIAN_IIR_POLES[0][0]) / q;
+	double pair_sum = 2.0 * magnitude * cos(angle), pair_product = magnitude * magnitude;
+	double real = pow(GAUSSIAN_IIR_POLES[1][0], -1.0 / q);
+	double a1 = -(pair_sum + real);
+	double a2 = pair_product + pair_sum * real;
+	double a3 = -pair_product * real;
+	prepared->coefficients[0] = 1.0 + a1 + a2 + a3;
+	prepared->coefficients[1] = -a1;
+	prepared->coefficients[2] = -a2;
+	prepared->coefficients[3] = -a3;
+	prepared->halo = (uint32_t)ceilf(GAUSSIAN_IIR_HALO_SIGMAS * prepared->sigma);
+	prepared->recursive = true;
+}
+
+bool gaussian_blur_prepare(Gaussian_Blur* prepared, float sigma) {
+	if (!(sigma > 0.0f && sigma <= GAUSSIAN_MAX_SIGMA)) return false; // Also catches NaN
+	prepared->sigma = sigma;
+	if (sigma >= GAUSSIAN_IIR_MIN_SIGMA) gaussian_iir_prepare(prepared);
+	else gaussian_fir_prepare(prepared);
+
+	return true;
+}
+
+// --- Edge detection. A window of three rows slides down the band, every output row takes its gradient from the
+// row above and below it in one pass. Only one row of column sums is kept, there are no gradient images. ---
+
+// Luma weights of GRAYSCALE in 8-bit fixed point, they add up to 256
+const int32_t EDGE_LUMA_WEIGHTS[3] = { 77, 150, 29 };
+
+// Integer selects after the conversion, so the loop over a row vectorizes like gaussian_round's
+static inline unsigned char edge_magnitude(int32_t gx, int32_t gy, float scale) {
+	int32_t magnitude = (int32_t)(sqrtf((float)(gx * gx + gy * gy)) * scale + 0.5f);
+	magnitude = magnitude > 255 ? 255 : magnitude;
+
+	return (unsigned char)magnitude;
+}
+
+static void edge_luma_row(const unsigned char* row, unsigned char* luma, uint32_t width, uint32_t channels) {
+	for (uint32_t x = 0; x < width; ++x) {
+		const unsigned char* pixel = row + (size_t)x * channels;
+		luma[x] = (unsigned char)((EDGE_LUMA_WEIGHTS[0] * pixel[0] + EDGE_LUMA_WEIGHTS[1] * pixel[1] + EDGE_LUMA_WEIGHTS[2] * pixel[2] + 128) >> 8);
+	}
+}
+
+// Magnitudes of one row from the window of the rows above, at and below it, count values with lanes values per pixel.
+// smooth and difference take the vertical smoothing and difference of every column with the edge pixel repeated
+// on either side, gx and gy then come from a column and its two neighbours.
+static void edge_row(const Edge* edge, const unsigned char* const window[3], unsigned char* magnitudes, int16_t* smooth, int16_t* difference, size_t count, size_t lanes) {
+	const unsigned char* above = window[0];
+	const unsigned char* center = window[1];
+	const unsigned char* below = window[2];
+	for (size_t i = 0; i < count; ++i) {
+		smooth[lanes + i] = (int16_t)(edge->outer * (above[i] + below[i]) + edge->center * center[i]);
+		difference[lanes + i] = (int16_t)(below[i] - above[i]);
+	}
+	for (size_t l = 0; l < lanes; ++l) {
+		smooth[l] = smooth[lanes + l];
+		difference[l] = difference[lanes + l];
+		smooth[lanes + count + l] = smooth[count + l];
+		difference[lanes + count + l] = difference[count + l];
+	}
+	for (size_t i = 0; i < count; ++i) {
+		int32_t gx = smooth[i + 2 * lanes] - smooth[i];
+		int32_t gy = edge->outer * (difference[i] + difference[i + 2 * lanes]) + edge->center * difference[i + lanes];
+		magnitudes[i] = edge_magnitude(gx, gy, edge->scale);
+	}
+}
+
+static inline void edge_rows(Work_Item* work, uint32_t channels) {
+	const Edge* edge = (const Edge*)work->params;
+	size_t lanes = edge->luma ? 1 : channels;
+	size_t count = (size_t)work->width * lanes;
+	int64_t top = -(int64_t)work->halo_top;
+	int64_t bottom = (int64_t)work->height - 1 + work->halo_bottom;
+	ptrdiff_t stride = (ptrdiff_t)work->stride;
+	int16_t* smooth = (int16_t*)blur_allocate(2 * (count + 2 * lanes) * sizeof(int16_t));
+	int16_t* difference = smooth + count + 2 * lanes;
+	// With luma the window holds three luma lines, every row is converted once as the window slides over it
+	unsigned char* luma = edge->luma ? (unsigned char*)blur_allocate(4 * (size_t)work->width) : NULL;
+	const unsigned char* window[3];
+	for (int64_t y = 0; y < work->height; ++y) {
+		for (int k = 0; k < 3; ++k) {
+			const unsigned char* row = work->image + box_row_clamp(y - 1 + k, top, bottom) * stride;
+			if (!edge->luma) {
+				window[k] = row;
+				continue;
+			}
+			unsigned char* line = luma + (size_t)((y + k) % 3) * work->width;
+			if (y == 0 || k == 2) edge_luma_row(row, line, work->width, channels);
+			window[k] = line;
+		}
+		const unsigned char* source = work->image + y * stride;
+		unsigned char* output = work->output + y * stride;
+		if (!edge->luma) {
+			edge_row(edge, window, output, smooth, difference, count, lanes);
+		}
+		else {
+			unsigned char* magnitudes = luma + 3 * (size_t)work->width;
+			edge_row(edge, window, magnitudes, smooth, difference, count, lanes);
+			for (uint32_t x = 0; x < work->width; ++x) {
+				for (uint32_t c = 0; c < 3; ++c) {
+					output[x * channels + c] = magnitudes[x];
+				}
+			}
+		}
+		if (channels == 4) {
+			for (uint32_t x = 0; x < work->width; ++x) {
+				output[x * 4 + 3] = source[x * 4 + 3];
+			}
+		}
+	}
+	free(luma);
+	free(smooth);
+}
+
+void edge_work_3channel(Work_Item* work) {
+	edge_rows(work, 3);
+}
+
+void edge_work_4channel(Work_Item* work) {
+	edge_rows(work, 4);
+}
+
+bool edge_prepare(Edge* prepared, Filter_Edge_Operator edge_operator, bool luma) {
+	switch (edge_operator) {
+	case EDGE_SOBEL:
+		prepared->outer = 1;
+		prepared->center = 2;
+		prepared->scale = 1.0f;
+		break;
+	case EDGE_SCHARR:
+		prepared->outer = 3;
+		prepared->center = 10;
+		prepared->scale = 0.25f;
+		break;
+	default: return false;
+	}
+	prepared->luma = luma;
+
+	return true;
+}
@@ -0,0 +1,150 @@
+#include "filter.h"
+#include <string.h>
+#include <math.h>
+
+// Builders for the 4x5 color matrices of filter_engine_submit_color_matrix and the lookup tables of
+// filter_engine_submit_lut, see filter.h for the layouts
+
+// Luma weights of GRAYSCALE, also the gray point of filter_color_matrix_saturation
+static const float LUMA_WEIGHTS[3] = { 0.299f, 0.587f, 0.114f };
+
+static const float SEPIA_WEIGHTS[3][3] = {
+	{ 0.393f, 0.769f, 0.189f },
+	{ 0.349f, 0.686f, 0.168f },
+	{ 0.272f, 0.534f, 0.131f }
+};
+
+void filter_color_matrix_identity(float matrix[20]) {
+	memset(matrix, 0, 20 * sizeof(float));
+	for (int c = 0; c < 4; ++c) {
+		matrix[c * 5 + c] = 1.0f;
+	}
+}
+
+void filter_color_matrix_grayscale(float matrix[20]) {
+	filter_color_matrix_identity(matrix);
+	for (int c = 0; c < 3; ++c) {
+		for (int k = 0; k < 3; ++k) {
+			matrix[c * 5 + k] = LUMA_WEIGHTS[k];
+		}
+	}
+}
+
+void filter_color_matrix_sepia(float matrix[20]) {
+	filter_color_matrix_identity(matrix);
+	for (int c = 0; c < 3; ++c) {
+		for (int k = 0; k < 3; ++k) {
+			matrix[c * 5 + k] = SEPIA_WEIGHTS[c][k];
+		}
+	}
+}
+
+// Blends every channel with the luma: 0 gives grayscale, above 1 pushes colors away from gray
+void filter_color_matrix_saturation(float matrix[20], float saturation) {
+	filter_color_matrix_identity(matrix);
+	for (int c = 0; c < 3; ++c) {
+		for (int k = 0; k < 3; ++k) {
+			matrix[c * 5 + k] = (1.0f - saturation) * LUMA_WEIGHTS[k] + (c == k ? saturation : 0.0f);
+		}
+	}
+}
+
+void filter_color_matrix_brightness(float matrix[20], float offset) {
+	filter_color_matrix_identity(matrix);
+	for (int c = 0; c < 3; ++c) {
+		matrix[c * 5 + 4] = offset;
+	}
+}
+
+// contrast * (x - 127.5) + 127.5, so mid gray stays where it is
+void filter_color_matrix_contrast(float matrix[20], float contrast) {
+	filter_color_matrix_identity(matrix);
+	for (int c = 0; c < 3; ++c) {
+		matrix[c * 5 + c] = contrast;
+		matrix[c * 5 + 4] = 127.5f * (1.0f - contrast);
+	}
+}
+
+void filter_color_matrix_scale(float matrix[20], float r, float g, float b) {
+	filter_color_matrix_identity(matrix);
+	matrix[0] = r;
+	matrix[6] = g;
+	matrix[12] = b;
+}
+
+// second * first as 5x5 matrices with an implicit (0, 0, 0, 0, 1) last row, summed in double
+void filter_color_matrix_concat(float result[20], const float first[20], const float second[20]) {
+	float product[20];
+	for (int c = 0; c < 4; ++c) {
+		for (int k = 0; k < 5; ++k) {
+			double sum = k == 4 ? second[c * 5 + 4] : 0.0;
+			for (int j = 0; j < 4; ++j) {
+				sum += (double)second[c * 5 + j] * first[j * 5 + k];
+			}
+			product[c * 5 + k] = (float)sum;
+		}
+	}
+	memcpy(result, product, sizeof(product));
+}
+
+// Nearest byte, clamped
+static uint8_t lut_round(float value) {
+	if (!(value > 0.0f)) return 0;
+	if (value >= 255.0f) return 255;
+
+	return (uint8_t)(value + 0.5f);
+}
+
+void filter_lut_identity(uint8_t lut[256]) {
+	for (int x = 0; x < 256; ++x) {
+		lut[x] = (uint8_t)x;
+	}
+}
+
+void filter_lut_gamma(uint8_t lut[256], float gamma) {
+	filter_lut_levels(lut, 0, 255, gamma, 0, 255);
+}
+
+void filter_lut_levels(uint8_t lut[256], uint8_t in_black, uint8_t in_white, float gamma, uint8_t out_black, uint8_t out_white) {
+	float range = in_white > in_black ? (float)(in_white - in_black) : 1.0f;
+	for (int x = 0; x < 256; ++x) {
+		float t = (x - in_black) / range;
+		if (t < 0.0f) t = 0.0f;
+		if (t > 1.0f) t = 1.0f;
+		if (gamma > 0.0f && gamma != 1.0f) t = powf(t, 1.0f / gamma);
+		lut[x] = lut_round(out_black + t * (out_white - out_black));
+	}
+}
+
+void filter_lut_brightness_contrast(uint8_t lut[256], float brightness, float contrast) {
+	for (int x = 0; x < 256; ++x) {
+		lut[x] = lut_round(contrast * (x - 127.5f) + 127.5f + brightness);
+	}
+}
+
+void filter_lut_curve(uint8_t lut[256], const uint8_t points[][2], size_t count) {
+	if (count == 0) {
+		filter_lut_identity(lut);
+		return;
+	}
+	size_t segment = 0; // First point at or above x
+	for (int x = 0; x < 256; ++x) {
+		while (segment < count && points[segment][0] < x) segment++;
+		if (segment == 0) lut[x] = points[0][1];
+		else if (segment == count) lut[x] = points[count - 1][1];
+		else {
+			const uint8_t* low = points[segment - 1];
+			const uint8_t* high = points[segment];
+			float t = (float)(x - low[0]) / (float)(high[0] - low[0]);
+			lut[x] = lut_round(low[1] + t * (high[1] - low[1]));
+		}
+	}
+}
+
+void filter_lut_concat(uint8_t result[256], const uint8_t first[256], const uint8_t second[256]) {
+	uint8_t table[256];
+	for (int x = 0; x < 256; ++x) {
+		table[x] = second[first[x]];
+	}
+	memcpy(result, table, sizeof(table));
+}
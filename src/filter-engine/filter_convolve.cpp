@@ -0,0 +1,574 @@
+#include "filter_kernels.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Convolution with any kernel. A rank-1 kernel is the outer product of a column and a row, it runs as a vertical
+// pass over the input rows into a float line and a horizontal pass along that line, kernel_width + kernel_height
+// multiply-adds per byte instead of their product. Any other kernel sums its taps directly over a ring of padded
+// float rows. Both passes sum column strips short enough that the sums and the rows of the taps stay in L1.
+// Large kernels go through the FFT instead, whose cost per pixel barely grows with the kernel. Overlap-save tiles
+// keep its buffers to one transform per item: each tile transforms the input under its output pixels plus the
+// kernel's reach, multiplies by the kernel's spectrum and keeps the pixels the circular wrap did not touch.
+// Items are bands of whole rows, or rectangles of whole tiles on the FFT path so that large kernels still spread
+// over the pool. A mirrored or wrapped border may reach any pixel of the input, so the kernels find the whole
+// input through work->row and work->column.
+
+// Largest kernel width and height
+const uint32_t CONVOLVE_MAX_SIZE = 255;
+
+// A kernel counts as rank-1 when no tap is further than this, relative to the largest tap, from the outer product.
+// A byte image can not show the difference.
+const float CONVOLVE_SEPARABLE_TOLERANCE = 1e-6f;
+
+// Floats of output sums per column strip, 4 KiB of sums plus a strip of each tap row
+const size_t CONVOLVE_STRIP_FLOATS = 1024;
+
+// Kernels from these many taps per pixel on go through the FFT, width * height for the direct path and
+// width + height for a rank-1 kernel. Measured with ConvolveBench: the FFT wins from about 16x16 for any kernel,
+// but the two 1D passes of a rank-1 kernel keep up with it until about 240x240.
+const uint32_t CONVOLVE_FFT_MIN_TAPS = 256;
+const uint32_t CONVOLVE_FFT_MIN_SEPARABLE_TAPS = 480;
+
+const uint32_t CONVOLVE_FFT_MAX_SIZE = 2048; // Largest transform side, 2048 x 1025 complex floats per plane
+
+const double CONVOLVE_PI = 3.14159265358979323846;
+
+typedef struct Fft_Complex {
+	float re, im;
+} Fft_Complex;
+
+// Transform sizes and tables of one FFT convolution, and the kernel's spectrum. One block, freed with the kernel.
+typedef struct Convolve_Fft {
+	uint32_t rows, columns; // Transform size, powers of two
+	uint32_t tile_rows, tile_columns; // Output pixels per tile, rows - kernel_height + 1 by columns - kernel_width + 1
+	Fft_Complex* spectrum; // rows x (columns / 2 + 1), conjugated for correlation and scaled by 1 / (rows * columns)
+	Fft_Complex* row_twiddles; // columns / 2
+	Fft_Complex* column_twiddles; // rows / 2
+	uint32_t* row_reverse; // Bit reversed index, columns
+	uint32_t* column_reverse; // rows
+} Convolve_Fft;
+
+static void* convolve_allocate(size_t size) {
+	void* memory = malloc(size);
+	if (memory == NULL) {
+		fprintf(stderr, "Failed to allocate memory for the convolution buffers\n");
+		exit(EXIT_FAILURE);
+	}
+
+	return memory;
+}
+
+// Index of the pixel that stands in for index on an axis of size pixels, -1 for the constant border
+static inline int64_t convolve_index(int64_t index, int64_t size, Filter_Border border) {
+	if (index >= 0 && index < size) return index;
+	switch (border) {
+	case BORDER_MIRROR: {
+		if (size == 1) return 0;
+		int64_t period = 2 * (size - 1);
+		index %= period;
+		if (index < 0) index += period;
+		return index < size ? index : period - index;
+	}
+	case BORDER_WRAP:
+		index %= size;
+		return index < 0 ? index + size : index;
+	case BORDER_CONSTANT: return -1;
+	default: return index < 0 ? 0 : size - 1;
+	}
+}
+
+static inline unsigned char convolve_round(float value) {
+	int rounded = (int)(value + 0.5f);
+	rounded = rounded < 0 ? 0 : rounded;
+	rounded = rounded > 255 ? 255 : rounded;
+
+	return (unsigned char)rounded;
+}
+
+// Start of the input row that stands in for row y of the image, NULL outside a constant border
+static inline const unsigned char* convolve_source_row(const Work_Item* work, const Convolve* convolve, int64_t y, uint32_t channels) {
+	int64_t row = convolve_index(y, convolve->image_height, convolve->border);
+	if (row < 0) return NULL;
+
+	return work->image + (row - (int64_t)work->row) * (ptrdiff_t)work->stride - (ptrdiff_t)work->column * channels;
+}
+
+// Fills the border of a padded row around its width pixels, which start anchor_x pixels in
+static void convolve_pad(const Convolve* convolve, float* padded, uint32_t width, uint32_t channels) {
+	const float* center = padded + (size_t)convolve->anchor_x * channels;
+	size_t left = convolve->anchor_x;
+	size_t right = convolve->kernel_width - 1 - convolve->anchor_x;
+	for (size_t p = 0; p < left + right; ++p) {
+		int64_t x = p < left ? (int64_t)p - (int64_t)left : (int64_t)width + (int64_t)(p - left);
+		int64_t index = convolve_index(x, width, convolve->border);
+		float* pixel = padded + (x + (int64_t)left) * channels;
+		for (uint32_t c = 0; c < channels; ++c) {
+			pixel[c] = index < 0 ? 0.0f : center[index * channels + c];
+		}
+	}
+}
+
+// Adds one padded row's taps to the sums of the strip that starts at byte start. Each tap is a multiply-add
+// along the strip, the padded row just shifts by a pixel from one tap to the next. Four taps share a pass,
+// so the sums are loaded and stored once per four taps.
+static inline void convolve_taps(float* sums, const float* padded, const float* weights, uint32_t taps, size_t start, size_t length, uint32_t channels) {
+	const float* source = padded + start;
+	uint32_t k = 0;
+	for (; k + 4 <= taps; k += 4) {
+		float w0 = weights[k], w1 = weights[k + 1], w2 = weights[k + 2], w3 = weights[k + 3];
+		const float* s0 = source + (size_t)k * channels;
+		const float* s1 = s0 + channels;
+		const float* s2 = s1 + channels;
+		const float* s3 = s2 + channels;
+		for (size_t i = 0; i < length; ++i) {
+			sums[i] += w0 * s0[i] + w1 * s1[i] + w2 * s2[i] + w3 * s3[i];
+		}
+	}
+	for (; k < taps; ++k) {
+		float weight = weights[k];
+		const float* tap = source + (size_t)k * channels;
+		for (size_t i = 0; i < length; ++i) {
+			sums[i] += weight * tap[i];
+		}
+	}
+}
+
+static inline void convolve_store(unsigned char* output, const float* sums, size_t length) {
+	for (size_t i = 0; i < length; ++i) {
+		output[i] = convolve_round(sums[i]);
+	}
+}
+
+// Alpha is not convolved, it is copied from the input pixel
+static inline void convolve_keep_alpha(unsigned char* output, const unsigned char* source, uint32_t width) {
+	for (uint32_t x = 0; x < width; ++x) {
+		output[x * 4 + 3] = source[x * 4 + 3];
+	}
+}
+
+// Vertical pass into the middle of the padded line, straight from the input rows, then the horizontal pass per strip
+static void convolve_separable(Work_Item* work, const Convolve* convolve, uint32_t channels) {
+	size_t bytes = (size_t)work->width * channels;
+	float* padded = (float*)convolve_allocate(((size_t)work->width + convolve->kernel_width - 1) * channels * sizeof(float));
+	float* sums = (float*)convolve_allocate(CONVOLVE_STRIP_FLOATS * sizeof(float));
+	float* center = padded + (size_t)convolve->anchor_x * channels;
+	for (uint32_t y = 0; y < work->height; ++y) {
+		int64_t row = (int64_t)work->row + y;
+		memset(center, 0, bytes * sizeof(float));
+		for (uint32_t k = 0; k < convolve->kernel_height; ++k) {
+			const unsigned char* source = convolve_source_row(work, convolve, row + k - convolve->anchor_y, channels);
+			float weight = convolve->vertical[k];
+			if (source == NULL || weight == 0.0f) continue;
+			for (size_t i = 0; i < bytes; ++i) {
+				center[i] += weight * source[i];
+			}
+		}
+		convolve_pad(convolve, padded, work->width, channels);
+		unsigned char* output = work->output + y * work->stride;
+		for (size_t start = 0; start < bytes; start += CONVOLVE_STRIP_FLOATS) {
+			size_t length = bytes - start < CONVOLVE_STRIP_FLOATS ? bytes - start : CONVOLVE_STRIP_FLOATS;
+			memset(sums, 0, length * sizeof(float));
+			convolve_taps(sums, padded, convolve->horizontal, convolve->kernel_width, start, length, channels);
+			convolve_store(output + start, sums, length);
+		}
+		if (channels == 4) convolve_keep_alpha(output, work->image + y * work->stride, work->width);
+	}
+	free(sums);
+	free(padded);
+}
+
+// Padded float rows of the kernel's window, one slot per kernel row. Moving down one output row converts
+// one new input row into the slot of the row that left the window.
+static void convolve_direct(Work_Item* work, const Convolve* convolve, uint32_t channels) {
+	size_t bytes = (size_t)work->width * channels;
+	size_t padded_floats = ((size_t)work->width + convolve->kernel_width - 1) * channels;
+	uint32_t slots = convolve->kernel_height;
+	float* ring = (float*)convolve_allocate(padded_floats * slots * sizeof(float));
+	float* sums = (float*)convolve_allocate(CONVOLVE_STRIP_FLOATS * sizeof(float));
+	int64_t top = (int64_t)work->row - convolve->anchor_y; // Image row of the window's first kernel row
+	for (int64_t y = top; y < top + (int64_t)work->height + slots - 1; ++y) {
+		float* padded = ring + (size_t)(((y % slots) + slots) % slots) * padded_floats;
+		const unsigned char* source = convolve_source_row(work, convolve, y, channels);
+		if (source == NULL) {
+			memset(padded, 0, padded_floats * sizeof(float));
+		}
+		else {
+			float* center = padded + (size_t)convolve->anchor_x * channels;
+			for (size_t i = 0; i < bytes; ++i) {
+				center[i] = source[i];
+			}
+			convolve_pad(convolve, padded, work->width, channels);
+		}
+		// The window is full once its last kernel row is in
+		int64_t output_row = y - (slots - 1) - top;
+		if (output_row < 0) continue;
+		unsigned char* output = work->output + output_row * (ptrdiff_t)work->stride;
+		for (size_t start = 0; start < bytes; start += CONVOLVE_STRIP_FLOATS) {
+			size_t length = bytes - start < CONVOLVE_STRIP_FLOATS ? bytes - start : CONVOLVE_STRIP_FLOATS;
+			memset(sums, 0, length * sizeof(float));
+			for (uint32_t k = 0; k < slots; ++k) {
+				int64_t kernel_row = top + output_row + k;
+				const float* tap_row = ring + (size_t)(((kernel_row % slots) + slots) % slots) * padded_floats;
+				convolve_taps(sums, tap_row, convolve->weights + (size_t)k * convolve->kernel_width, convolve->kernel_width, start, length, channels);
+			}
+			convolve_store(output + start, sums, length);
+		}
+		if (channels == 4) convolve_keep_alpha(output, work->image + output_row * (ptrdiff_t)work->stride, work->width);
+	}
+	free(sums);
+	free(ring);
+}
+
+// --- FFT. Radix-2 and in place. Rows are real, so two rows share one complex transform and their half spectra
+// are split apart by symmetry. The columns of a spectrum are transformed all at once, every butterfly combines
+// two whole rows, which vectorizes across the columns. ---
+
+static void fft_tables(Fft_Complex* twiddles, uint32_t* reverse, uint32_t size) {
+	uint32_t bits = 0;
+	while ((1u << bits) < size) bits++;
+	for (uint32_t k = 0; k < size / 2; ++k) {
+		double angle = -2.0 * CONVOLVE_PI * k / size;
+		twiddles[k].re = (float)cos(angle);
+		twiddles[k].im = (float)sin(angle);
+	}
+	for (uint32_t i = 0; i < size; ++i) {
+		uint32_t reversed = 0;
+		for (uint32_t b = 0; b < bits; ++b) {
+			reversed |= ((i >> b) & 1) << (bits - 1 - b);
+		}
+		reverse[i] = reversed;
+	}
+}
+
+// One complex sequence. The inverse is unscaled, the kernel's spectrum carries the scale.
+static void fft_line(Fft_Complex* data, uint32_t size, const Fft_Complex* twiddles, const uint32_t* reverse, bool inverse) {
+	for (uint32_t i = 0; i < size; ++i) {
+		uint32_t j = reverse[i];
+		if (i < j) {
+			Fft_Complex swap = data[i];
+			data[i] = data[j];
+			data[j] = swap;
+		}
+	}
+	float sign = inverse ? -1.0f : 1.0f;
+	for (uint32_t length = 2; length <= size; length <<= 1) {
+		uint32_t half = length / 2, step = size / length;
+		for (uint32_t i = 0; i < size; i += length) {
+			for (uint32_t j = 0; j < half; ++j) {
+				Fft_Complex w = twiddles[j * step];
+				Fft_Complex a = data[i + j], b = data[i + j + half];
+				float re = b.re * w.re - sign * b.im * w.im;
+				float im = b.im * w.re + sign * b.re * w.im;
+				data[i + j].re = a.re + re;
+				data[i + j].im = a.im + im;
+				data[i + j + half].re = a.re - re;
+				data[i + j + half].im = a.im - im;
+			}
+		}
+	}
+}
+
+// Every column of size rows of width complex values, the butterflies run along whole rows
+static void fft_columns(Fft_Complex* data, size_t width, uint32_t size, const Fft_Complex* twiddles, const uint32_t* reverse, bool inverse) {
+	for (uint32_t i = 0; i < size; ++i) {
+		uint32_t j = reverse[i];
+		if (i < j) {
+			Fft_Complex* a = data + i * width;
+			Fft_Complex* b = data + j * width;
+			for (size_t x = 0; x < width; ++x) {
+				Fft_Complex swap = a[x];
+				a[x] = b[x];
+				b[x] = swap;
+			}
+		}
+	}
+	float sign = inverse ? -1.0f : 1.0f;
+	for (uint32_t length = 2; length <= size; length <<= 1) {
+		uint32_t half = length / 2, step = size / length;
+		for (uint32_t i = 0; i < size; i += length) {
+			for (uint32_t j = 0; j < half; ++j) {
+				float w_re = twiddles[j * step].re, w_im = sign * twiddles[j * step].im;
+				float* a = (float*)(data + (i + j) * width);
+				float* b = (float*)(data + (i + j + half) * width);
+				for (size_t x = 0; x < 2 * width; x += 2) {
+					float re = b[x] * w_re - b[x + 1] * w_im;
+					float im = b[x + 1] * w_re + b[x] * w_im;
+					b[x] = a[x] - re;
+					b[x + 1] = a[x + 1] - im;
+					a[x] += re;
+					a[x + 1] += im;
+				}
+			}
+		}
+	}
+}
+
+// Half spectra, columns / 2 + 1 values, of two real rows from one transform of first + i * second
+static void fft_real_pair(const Convolve_Fft* fft, const float* first, const float* second, Fft_Complex* line, Fft_Complex* first_spectrum, Fft_Complex* second_spectrum) {
+	uint32_t size = fft->columns;
+	for (uint32_t q = 0; q < size; ++q) {
+		line[q].re = first[q];
+		line[q].im = second[q];
+	}
+	fft_line(line, size, fft->row_twiddles, fft->row_reverse, false);
+	for (uint32_t k = 0; k <= size / 2; ++k) {
+		Fft_Complex a = line[k], b = line[(size - k) & (size - 1)];
+		first_spectrum[k].re = 0.5f * (a.re + b.re);
+		first_spectrum[k].im = 0.5f * (a.im - b.im);
+		second_spectrum[k].re = 0.5f * (a.im + b.im);
+		second_spectrum[k].im = 0.5f * (b.re - a.re);
+	}
+}
+
+// The way back: both half spectra extended by symmetry, one inverse transform, first in the real part and second in the imaginary one
+static void fft_real_pair_inverse(const Convolve_Fft* fft, const Fft_Complex* first_spectrum, const Fft_Complex* second_spectrum, Fft_Complex* line, float* first, float* second) {
+	uint32_t size = fft->columns;
+	for (uint32_t k = 0; k < size; ++k) {
+		Fft_Complex a, b;
+		if (k <= size / 2) {
+			a = first_spectrum[k];
+			b = second_spectrum[k];
+		}
+		else {
+			a = first_spectrum[size - k];
+			b = second_spectrum[size - k];
+			a.im = -a.im;
+			b.im = -b.im;
+		}
+		line[k].re = a.re - b.im;
+		line[k].im = a.im + b.re;
+	}
+	fft_line(line, size, fft->row_twiddles, fft->row_reverse, true);
+	for (uint32_t q = 0; q < size; ++q) {
+		first[q] = line[q].re;
+		second[q] = line[q].im;
+	}
+}
+
+// Spectrum of a real rows x columns plane, rows transformed in pairs and then all columns at once
+static void fft_forward(const Convolve_Fft* fft, const float* plane, Fft_Complex* spectrum, Fft_Complex* line) {
+	size_t width = fft->columns / 2 + 1;
+	for (uint32_t r = 0; r < fft->rows; r += 2) {
+		fft_real_pair(fft, plane + (size_t)r * fft->columns, plane + (size_t)(r + 1) * fft->columns, line, spectrum + r * width, spectrum + (r + 1) * width);
+	}
+	fft_columns(spectrum, width, fft->rows, fft->column_twiddles, fft->column_reverse, false);
+}
+
+// Overlap-save tiles across the item's rectangle, which starts on a tile. Each color channel of a tile is transformed on its own. Only the rows
+// of the tile's output need the inverse row transforms.
+static void convolve_fft(Work_Item* work, const Convolve* convolve, uint32_t channels) {
+	const Convolve_Fft* fft = convolve->fft;
+	size_t width = fft->columns / 2 + 1;
+	size_t plane_size = (size_t)fft->rows * fft->columns;
+	uint32_t colors = channels == 4 ? 3 : channels;
+	float* plane = (float*)convolve_allocate(plane_size * sizeof(float));
+	Fft_Complex* spectrum = (Fft_Complex*)convolve_allocate(fft->rows * width * sizeof(Fft_Complex));
+	Fft_Complex* line = (Fft_Complex*)convolve_allocate(fft->columns * sizeof(Fft_Complex));
+	const unsigned char** source_rows = (const unsigned char**)convolve_allocate(fft->rows * sizeof(const unsigned char*));
+	int64_t* source_columns = (int64_t*)convolve_allocate(fft->columns * sizeof(int64_t));
+	for (uint32_t top = 0; top < work->height; top += fft->tile_rows) {
+		uint32_t tile_height = work->height - top < fft->tile_rows ? work->height - top : fft->tile_rows;
+		for (uint32_t r = 0; r < fft->rows; ++r) {
+			source_rows[r] = convolve_source_row(work, convolve, (int64_t)work->row + top + r - convolve->anchor_y, channels);
+		}
+		for (uint32_t left = 0; left < work->width; left += fft->tile_columns) {
+			uint32_t tile_width = work->width - left < fft->tile_columns ? work->width - left : fft->tile_columns;
+			for (uint32_t q = 0; q < fft->columns; ++q) {
+				source_columns[q] = convolve_index((int64_t)work->column + left + q - convolve->anchor_x, convolve->image_width, convolve->border);
+			}
+			for (uint32_t c = 0; c < colors; ++c) {
+				for (uint32_t r = 0; r < fft->rows; ++r) {
+					const unsigned char* source = source_rows[r];
+					float* plane_row = plane + (size_t)r * fft->columns;
+					for (uint32_t q = 0; q < fft->columns; ++q) {
+						plane_row[q] = source == NULL || source_columns[q] < 0 ? 0.0f : source[source_columns[q] * channels + c];
+					}
+				}
+				fft_forward(fft, plane, spectrum, line);
+				for (size_t i = 0; i < fft->rows * width; ++i) {
+					Fft_Complex a = spectrum[i], b = fft->spectrum[i];
+					spectrum[i].re = a.re * b.re - a.im * b.im;
+					spectrum[i].im = a.re * b.im + a.im * b.re;
+				}
+				fft_columns(spectrum, width, fft->rows, fft->column_twiddles, fft->column_reverse, true);
+				// The inverse rows land in the plane, which is free again
+				for (uint32_t r = 0; r < tile_height; r += 2) {
+					float* first = plane + (size_t)r * fft->columns;
+					fft_real_pair_inverse(fft, spectrum + r * width, spectrum + (r + 1) * width, line, first, first + fft->columns);
+				}
+				for (uint32_t r = 0; r < tile_height; ++r) {
+					const float* result = plane + (size_t)r * fft->columns;
+					unsigned char* output = work->output + (top + r) * work->stride + (size_t)left * channels + c;
+					for (uint32_t x = 0; x < tile_width; ++x) {
+						output[x * channels] = convolve_round(result[x]);
+					}
+				}
+			}
+		}
+		if (channels == 4) {
+			for (uint32_t r = 0; r < tile_height; ++r) {
+				convolve_keep_alpha(work->output + (top + r) * work->stride, work->image + (top + r) * work->stride, work->width);
+			}
+		}
+	}
+	free(source_columns);
+	free(source_rows);
+	free(line);
+	free(spectrum);
+	free(plane);
+}
+
+static inline void convolve_rows(Work_Item* work, uint32_t channels) {
+	const Convolve* convolve = (const Convolve*)work->params;
+	if (convolve->fft != NULL) convolve_fft(work, convolve, channels);
+	else if (convolve->separable) convolve_separable(work, convolve, channels);
+	else convolve_direct(work, convolve, channels);
+}
+
+void convolve_work_3channel(Work_Item* work) {
+	convolve_rows(work, 3);
+}
+
+void convolve_work_4channel(Work_Item* work) {
+	convolve_rows(work, 4);
+}
+
+// Rank-1 test without a decomposition: if the kernel is an outer product, the column and the row through its
+// largest tap are its factors, up to a scale that the row takes out by dividing by that tap
+static bool convolve_split(Convolve* prepared) {
+	uint32_t width = prepared->kernel_width, height = prepared->kernel_height;
+	const float* weights = prepared->weights;
+	uint32_t pivot_x = 0, pivot_y = 0;
+	float largest = 0.0f;
+	for (uint32_t y = 0; y < height; ++y) {
+		for (uint32_t x = 0; x < width; ++x) {
+			if (fabsf(weights[y * width + x]) > largest) {
+				largest = fabsf(weights[y * width + x]);
+				pivot_x = x;
+				pivot_y = y;
+			}
+		}
+	}
+	float pivot = weights[pivot_y * width + pivot_x];
+	for (uint32_t y = 0; y < height; ++y) {
+		prepared->vertical[y] = weights[y * width + pivot_x];
+	}
+	for (uint32_t x = 0; x < width; ++x) {
+		prepared->horizontal[x] = largest == 0.0f ? 0.0f : weights[pivot_y * width + x] / pivot;
+	}
+	for (uint32_t y = 0; y < height; ++y) {
+		for (uint32_t x = 0; x < width; ++x) {
+			float product = prepared->vertical[y] * prepared->horizontal[x];
+			if (fabsf(weights[y * width + x] - product) > CONVOLVE_SEPARABLE_TOLERANCE * largest) return false;
+		}
+	}
+
+	return true;
+}
+
+// Transform side for one axis. Overlap-save keeps size - kernel_size + 1 pixels of each tile, so small transforms
+// waste most of their work on the kernel's reach and large ones pay more per pixel. Larger than one tile over the
+// whole image is never needed.
+static uint32_t convolve_fft_size(uint32_t kernel_size, uint32_t image_size) {
+	uint32_t size = 2;
+	while (size < kernel_size) size <<= 1;
+	uint32_t best = size;
+	double best_cost = 1e30;
+	for (; size <= CONVOLVE_FFT_MAX_SIZE; size <<= 1) {
+		double cost = size * (log2((double)size) + 1.0) / (size - kernel_size + 1);
+		if (cost < best_cost) {
+			best = size;
+			best_cost = cost;
+		}
+		if (size >= (uint64_t)image_size + kernel_size - 1) break;
+	}
+
+	return best;
+}
+
+// Sizes, tables and the kernel's spectrum, all in one block. The tiles are the items, so the sides are halved,
+// the larger first, until every worker gets a tile or the tiles can not shrink any more.
+static Convolve_Fft* convolve_fft_create(const Convolve* prepared, uint32_t image_width, uint32_t image_height, uint32_t thread_count) {
+	uint32_t rows = convolve_fft_size(prepared->kernel_height, image_height);
+	uint32_t columns = convolve_fft_size(prepared->kernel_width, image_width);
+	while (true) {
+		uint64_t tiles_down = (image_height + (uint64_t)rows - prepared->kernel_height) / (rows - prepared->kernel_height + 1);
+		uint64_t tiles_across = (image_width + (uint64_t)columns - prepared->kernel_width) / (columns - prepared->kernel_width + 1);
+		if (tiles_down * tiles_across >= thread_count) break;
+		bool halve_rows = rows / 2 >= prepared->kernel_height && rows / 2 >= 2 && tiles_down < image_height;
+		bool halve_columns = columns / 2 >= prepared->kernel_width && columns / 2 >= 2 && tiles_across < image_width;
+		if (halve_rows && (!halve_columns || rows - prepared->kernel_height >= columns - prepared->kernel_width)) rows /= 2;
+		else if (halve_columns) columns /= 2;
+		else break;
+	}
+	size_t width = columns / 2 + 1;
+	size_t bytes = sizeof(Convolve_Fft) + (rows * width + columns / 2 + rows / 2) * sizeof(Fft_Complex) + ((size_t)columns + rows) * sizeof(uint32_t);
+	Convolve_Fft* fft = (Convolve_Fft*)convolve_allocate(bytes);
+	fft->rows = rows;
+	fft->columns = columns;
+	fft->tile_rows = rows - prepared->kernel_height + 1;
+	fft->tile_columns = columns - prepared->kernel_width + 1;
+	fft->spectrum = (Fft_Complex*)(fft + 1);
+	fft->row_twiddles = fft->spectrum + rows * width;
+	fft->column_twiddles = fft->row_twiddles + columns / 2;
+	fft->row_reverse = (uint32_t*)(fft->column_twiddles + rows / 2);
+	fft->column_reverse = fft->row_reverse + columns;
+	fft_tables(fft->row_twiddles, fft->row_reverse, columns);
+	fft_tables(fft->column_twiddles, fft->column_reverse, rows);
+	// The kernel in the top left corner of a zero plane. A tile's spectrum times the conjugate of this one is the
+	// circular correlation, which the tiles need since the kernel is applied unflipped.
+	float* plane = (float*)convolve_allocate((size_t)rows * columns * sizeof(float));
+	Fft_Complex* line = (Fft_Complex*)convolve_allocate(columns * sizeof(Fft_Complex));
+	memset(plane, 0, (size_t)rows * columns * sizeof(float));
+	for (uint32_t y = 0; y < prepared->kernel_height; ++y) {
+		memcpy(plane + (size_t)y * columns, prepared->weights + (size_t)y * prepared->kernel_width, prepared->kernel_width * sizeof(float));
+	}
+	fft_forward(fft, plane, fft->spectrum, line);
+	float scale = 1.0f / ((float)rows * columns);
+	for (size_t i = 0; i < rows * width; ++i) {
+		fft->spectrum[i].re *= scale;
+		fft->spectrum[i].im *= -scale;
+	}
+	free(line);
+	free(plane);
+
+	return fft;
+}
+
+bool convolve_prepare(Convolve* prepared, const Image* input, const float* kernel, uint32_t kernel_width, uint32_t kernel_height, Filter_Border border, uint32_t thread_count) {
+	if (kernel == NULL || kernel_width == 0 || kernel_height == 0) return false;
+	if (kernel_width > CONVOLVE_MAX_SIZE || kernel_height > CONVOLVE_MAX_SIZE) return false;
+	if (border != BORDER_CLAMP && border != BORDER_MIRROR && border != BORDER_WRAP && border != BORDER_CONSTANT) return false;
+	size_t taps = (size_t)kernel_width * kernel_height;
+	for (size_t i = 0; i < taps; ++i) {
+		if (!isfinite(kernel[i])) return false;
+	}
+	// One block for the kernel and both factors, convolve_release frees it
+	prepared->weights = (float*)convolve_allocate((taps + kernel_width + kernel_height) * sizeof(float));
+	memcpy(prepared->weights, kernel, taps * sizeof(float));
+	prepared->horizontal = prepared->weights + taps;
+	prepared->vertical = prepared->horizontal + kernel_width;
+	prepared->kernel_width = kernel_width;
+	prepared->kernel_height = kernel_height;
+	prepared->anchor_x = kernel_width / 2;
+	prepared->anchor_y = kernel_height / 2;
+	prepared->border = border;
+	prepared->image_width = input->width;
+	prepared->image_height = input->height;
+	prepared->separable = convolve_split(prepared);
+	bool use_fft = prepared->separable ? kernel_width + kernel_height >= CONVOLVE_FFT_MIN_SEPARABLE_TAPS : taps >= CONVOLVE_FFT_MIN_TAPS;
+	prepared->fft = use_fft ? convolve_fft_create(prepared, input->width, input->height, thread_count) : NULL;
+	prepared->tile_rows = prepared->fft != NULL ? prepared->fft->tile_rows : 0;
+	prepared->tile_columns = prepared->fft != NULL ? prepared->fft->tile_columns : 0;
+
+	return true;
+}
+
+void convolve_release(Convolve* prepared) {
+	free(prepared->weights);
+	free(prepared->fft);
+	prepared->weights = NULL;
+	prepared->fft = NULL;
+}
@@ -0,0 +1,936 @@
+#include "filter_kernels.h"
+#include "platform.h" // for platform_cpu_features
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+// Limits of color_matrix_prepare, they keep every SIMD sum inside 32-bit integers
+const float MATRIX_MAX_WEIGHT = 256.0f;
+const float MATRIX_MAX_OFFSET = 65536.0f;
+
+// Fast mode: weights in Q(shift), the largest shift in this range that keeps every weight in 16 bits.
+// The rounding error is at most 255.5 * 4 / 2^shift, so from Q10 up the result is never more than one off exact.
+const uint32_t FIXED_MIN_SHIFT = 10;
+const uint32_t FIXED_MAX_SHIFT = 14;
+
+// Exact mode sums each row as ((((m0 * r + m1 * g) + m2 * b) + m3 * a) + m4) in floats, truncates toward zero
+// and saturates to a byte. The SIMD kernels do the same multiplies and adds in the same order, so every level
+// writes exactly the bytes of the scalar kernels. RGB reads alpha as 255 and ignores the alpha row.
+static inline float matrix_row_sum(const float row[5], float r, float g, float b, float a) {
+	return row[0] * r + row[1] * g + row[2] * b + row[3] * a + row[4];
+}
+
+static inline unsigned char matrix_clamp_float(float sum) {
+	if (!(sum > 0.0f)) return 0;
+	if (sum >= 255.0f) return 255;
+
+	return (unsigned char)sum;
+}
+
+static inline unsigned char matrix_clamp_fixed(int32_t sum) {
+	if (sum < 0) return 0;
+
+	return (unsigned char)(sum > 255 ? 255 : sum);
+}
+
+// Scalar loops over count pixels. The SIMD kernels use them for the pixels left over after the last full vector.
+// RGB inverts every byte, so it is treated as a plain byte run.
+static void invert_bytes(const unsigned char* image, unsigned char* output, size_t bytes) {
+	for (size_t i = 0; i < bytes; ++i) {
+		output[i] = 255 - image[i];
+	}
+}
+
+static void invert_pixels_4channel(const unsigned char* image, unsigned char* output, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		size_t idx = i * 4; // Assuming RGBA format, each pixel has 4 channels
+		output[idx] = 255 - image[idx];
+		output[idx + 1] = 255 - image[idx + 1];
+		output[idx + 2] = 255 - image[idx + 2];
+		output[idx + 3] = image[idx + 3];
+	}
+}
+
+static void matrix_pixels(const Color_Matrix* prepared, const unsigned char* image, unsigned char* output, size_t count, uint32_t channels) {
+	Color_Matrix matrix = *prepared; // Output stores may alias the matrix, a local copy stays in registers
+	for (size_t i = 0; i < count; ++i) {
+		size_t idx = i * channels;
+		float r = image[idx];
+		float g = image[idx + 1];
+		float b = image[idx + 2];
+		unsigned char alpha = channels == 4 ? image[idx + 3] : 255;
+		float a = alpha;
+		unsigned char c0 = matrix_clamp_float(matrix_row_sum(matrix.rows[0], r, g, b, a));
+		output[idx] = c0;
+		output[idx + 1] = matrix.uniform ? c0 : matrix_clamp_float(matrix_row_sum(matrix.rows[1], r, g, b, a));
+		output[idx + 2] = matrix.uniform ? c0 : matrix_clamp_float(matrix_row_sum(matrix.rows[2], r, g, b, a));
+		if (channels == 4) output[idx + 3] = matrix.alpha_passthrough ? alpha : matrix_clamp_float(matrix_row_sum(matrix.rows[3], r, g, b, a));
+	}
+}
+
+// floor((weights . (r, g, b, a) + offset) / 2^shift), the integer sum never leaves 32 bits
+static inline unsigned char matrix_row_fixed(const Color_Matrix* matrix, int c, int32_t r, int32_t g, int32_t b, int32_t a) {
+	const int16_t* weights = matrix->weights[c];
+	int32_t sum = (weights[0] * r + weights[1] * g) + (weights[2] * b + weights[3] * a) + matrix->offsets[c];
+
+	return matrix_clamp_fixed(sum >> matrix->shift);
+}
+
+static void matrix_fixed_pixels(const Color_Matrix* prepared, const unsigned char* image, unsigned char* output, size_t count, uint32_t channels) {
+	Color_Matrix matrix = *prepared;
+	for (size_t i = 0; i < count; ++i) {
+		size_t idx = i * channels;
+		int32_t r = image[idx];
+		int32_t g = image[idx + 1];
+		int32_t b = image[idx + 2];
+		int32_t a = channels == 4 ? image[idx + 3] : 255;
+		unsigned char c0 = matrix_row_fixed(&matrix, 0, r, g, b, a);
+		output[idx] = c0;
+		output[idx + 1] = matrix.uniform ? c0 : matrix_row_fixed(&matrix, 1, r, g, b, a);
+		output[idx + 2] = matrix.uniform ? c0 : matrix_row_fixed(&matrix, 2, r, g, b, a);
+		if (channels == 4) output[idx + 3] = matrix.alpha_passthrough ? (unsigned char)a : matrix_row_fixed(&matrix, 3, r, g, b, a);
+	}
+}
+
+static void lut_pixels(const Lut* lut, const unsigned char* image, unsigned char* output, size_t count, uint32_t channels) {
+	const uint8_t* r = lut->tables[0];
+	const uint8_t* g = lut->tables[1];
+	const uint8_t* b = lut->tables[2];
+	const uint8_t* a = lut->tables[3];
+	for (size_t i = 0; i < count; ++i) {
+		size_t idx = i * channels;
+		output[idx] = r[image[idx]];
+		output[idx + 1] = g[image[idx + 1]];
+		output[idx + 2] = b[image[idx + 2]];
+		if (channels == 4) output[idx + 3] = a[image[idx + 3]];
+	}
+}
+
+static void invert_color_work_3channel(Work_Item* work) {
+	invert_bytes(work->image, work->output, (size_t)work->width * work->height * 3);
+}
+
+static void invert_color_work_4channel(Work_Item* work) {
+	invert_pixels_4channel(work->image, work->output, (size_t)work->width * work->height);
+}
+
+static void matrix_work_3channel(Work_Item* work) {
+	matrix_pixels((const Color_Matrix*)work->params, work->image, work->output, (size_t)work->width * work->height, 3);
+}
+
+static void matrix_work_4channel(Work_Item* work) {
+	matrix_pixels((const Color_Matrix*)work->params, work->image, work->output, (size_t)work->width * work->height, 4);
+}
+
+static void matrix_fixed_work_3channel(Work_Item* work) {
+	matrix_fixed_pixels((const Color_Matrix*)work->params, work->image, work->output, (size_t)work->width * work->height, 3);
+}
+
+static void matrix_fixed_work_4channel(Work_Item* work) {
+	matrix_fixed_pixels((const Color_Matrix*)work->params, work->image, work->output, (size_t)work->width * work->height, 4);
+}
+
+static void lut_work_3channel(Work_Item* work) {
+	lut_pixels((const Lut*)work->params, work->image, work->output, (size_t)work->width * work->height, 3);
+}
+
+static void lut_work_4channel(Work_Item* work) {
+	lut_pixels((const Lut*)work->params, work->image, work->output, (size_t)work->width * work->height, 4);
+}
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FILTER_KERNELS_X86
+
+// GCC and Clang only accept intrinsics of an instruction set inside functions compiled for it.
+// MSVC accepts them anywhere, the dispatch in filter_kernels_select keeps them off CPUs without it.
+#if defined(__GNUC__) || defined(__clang__)
+#define KERNEL_TARGET(isa) __attribute__((target(isa)))
+#else
+#define KERNEL_TARGET(isa)
+#endif
+
+#define KERNEL_SSE41 KERNEL_TARGET("sse4.1")
+#define KERNEL_AVX2 KERNEL_TARGET("avx2")
+#define KERNEL_AVX512 KERNEL_TARGET("avx512f,avx512bw")
+#define KERNEL_AVX512VBMI KERNEL_TARGET("avx512f,avx512bw,avx512vbmi")
+
+// The kernels copy the item's pointers to locals first. Byte stores may alias *work,
+// so reading work->output inside the loop would reload it on every iteration.
+
+// RGB24 is split into one register per channel: 16 pixels are 48 bytes, three shuffles per channel
+// pick that channel's bytes out of the three loads and the ORs merge them.
+KERNEL_SSE41 static inline void rgb_deinterleave_16(const unsigned char* image, __m128i* r, __m128i* g, __m128i* b) {
+	__m128i a0 = _mm_loadu_si128((const __m128i*)image);
+	__m128i a1 = _mm_loadu_si128((const __m128i*)(image + 16));
+	__m128i a2 = _mm_loadu_si128((const __m128i*)(image + 32));
+	*r = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(a0, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+		_mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+		_mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+	*g = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(a0, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+		_mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+		_mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+	*b = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(a0, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+		_mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+		_mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+}
+
+// Inverse of rgb_deinterleave_16, every output register takes its bytes from all three channels
+KERNEL_SSE41 static inline void rgb_interleave_16(unsigned char* output, __m128i r, __m128i g, __m128i b) {
+	__m128i a0 = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(r, _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5)),
+		_mm_shuffle_epi8(g, _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1))),
+		_mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1)));
+	__m128i a1 = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(r, _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1)),
+		_mm_shuffle_epi8(g, _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10))),
+		_mm_shuffle_epi8(b, _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1)));
+	__m128i a2 = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(r, _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1)),
+		_mm_shuffle_epi8(g, _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1))),
+		_mm_shuffle_epi8(b, _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15)));
+	_mm_storeu_si128((__m128i*)output, a0);
+	_mm_storeu_si128((__m128i*)(output + 16), a1);
+	_mm_storeu_si128((__m128i*)(output + 32), a2);
+}
+
+// --- SSE4.1: 4 floats per register ---
+
+// 16 bytes to four registers of 4 floats
+KERNEL_SSE41 static inline void u8_to_float_sse41(__m128i bytes, __m128 values[4]) {
+	for (int q = 0; q < 4; ++q) {
+		values[q] = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(bytes));
+		bytes = _mm_srli_si128(bytes, 4);
+	}
+}
+
+// Matrix row for 16 RGB pixels, truncated and saturated to bytes
+KERNEL_SSE41 static inline __m128i matrix_row_sse41(const float row[5], const __m128 r[4], const __m128 g[4], const __m128 b[4], const __m128 a[4]) {
+	__m128 w0 = _mm_set1_ps(row[0]), w1 = _mm_set1_ps(row[1]), w2 = _mm_set1_ps(row[2]), w3 = _mm_set1_ps(row[3]), w4 = _mm_set1_ps(row[4]);
+	__m128i sums[4];
+	for (int q = 0; q < 4; ++q) {
+		__m128 sum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, r[q]), _mm_mul_ps(w1, g[q])), _mm_mul_ps(w2, b[q]));
+		sum = _mm_add_ps(_mm_add_ps(sum, _mm_mul_ps(w3, a[q])), w4);
+		sums[q] = _mm_cvttps_epi32(sum);
+	}
+
+	return _mm_packus_epi16(_mm_packs_epi32(sums[0], sums[1]), _mm_packs_epi32(sums[2], sums[3]));
+}
+
+// Matrix row for the 4 RGBA pixels of one register, result in the low byte of every lane
+KERNEL_SSE41 static inline __m128i matrix_row_rgba_sse41(const float row[5], __m128 r, __m128 g, __m128 b, __m128 a) {
+	__m128 sum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(row[0]), r), _mm_mul_ps(_mm_set1_ps(row[1]), g)), _mm_mul_ps(_mm_set1_ps(row[2]), b));
+	sum = _mm_add_ps(_mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(row[3]), a)), _mm_set1_ps(row[4]));
+
+	return _mm_min_epi32(_mm_max_epi32(_mm_cvttps_epi32(sum), _mm_setzero_si128()), _mm_set1_epi32(255));
+}
+
+KERNEL_SSE41 static void invert_color_work_3channel_sse41(Work_Item* work) {
+	const unsigned char* image = work->image;
+	unsigned char* output = work->output;
+	size_t bytes = (size_t)work->width * work->height * 3;
+	__m128i ones = _mm_set1_epi8(-1);
+	size_t i = 0;
+	for (; i + 16 <= bytes; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(image + i));
+		_mm_storeu_si128((__m128i*)(output + i), _mm_xor_si128(v, ones));
+	}
+	invert_bytes(image + i, output + i, bytes - i);
+}
+
+KERNEL_SSE41 static void invert_color_work_4channel_sse41(Work_Item* work) {
+	const unsigned char* image = work->image;
+	unsigned char* output = work->output;
+	size_t count = (size_t)work->width * work->height;
+	__m128i colour = _mm_set1_epi32(0x00FFFFFF); // Alpha is kept
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(image + i * 4));
+		_mm_storeu_si128((__m128i*)(output + i * 4), _mm_xor_si128(v, colour));
+	}
+	invert_pixels_4channel(image + i * 4, output + i * 4, count - i);
+}
+
+// The matrix kernels copy the prepared matrix too, for the same reason
+KERNEL_SSE41 static void matrix_work_3channel_sse41(Work_Item* work) {
+	Color_Matrix matrix = *(const Color_Matrix*)work->params;
+	const unsigned char* image = work->image;
+	unsigned char* output = work->output;
+	size_t count = (size_t)work->width * work->height;
+	__m128 fa[4] = { _mm_set1_ps(255.0f), _mm_set1_ps(255.0f), _mm_set1_ps(255.0f), _mm_set1_ps(255.0f) };
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i r, g, b;
+		__m128 fr[4], fg[4], fb[4];
+		rgb_deinterleave_16(image + i * 3, &r, &g, &b);
+		u8_to_float_sse41(r, fr);
+		u8_to_float_sse41(g, fg);
+		u8_to_float_sse41(b, fb);
+		__m128i c0 = matrix_row_sse41(matrix.rows[0], fr, fg, fb, fa);
+		__m128i c1 = matrix.uniform ? c0 : matrix_row_sse41(matrix.rows[1], fr, fg, fb, fa);
+		__m128i c2 = matrix.uniform ? c0 : matrix_row_sse41(matrix.rows[2], fr, fg, fb, fa);
+		rgb_interleave_16(output + i * 3, c0, c1, c2);
+	}
+	matrix_pixels((const Color_Matrix*)work->params, image + i * 3, output + i * 3, count - i, 3);
+}
+
+// RGBA needs no shuffles, every 32-bit lane is one pixel and the channels are shifted out of it
+KERNEL_SSE41 static void matrix_work_4channel_sse41(Work_Item* work) {
+	Color_Matrix matrix = *(const Color_Matrix*)work->params;
+	const unsigned char* image = work->image;
+	unsigned char* output = work->output;
+	size_t count = (size_t)work->width * work->height;
+	__m128i low_byte = _mm_set1_epi32(0xFF);
+	__m128i alpha = _mm_set1_epi32((int)0xFF000000);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(image + i * 4));
+		__m128 r = _mm_cvtepi32_ps(_mm_and_si128(v, low_byte));
+		__m128 g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 8), low_byte));
+		__m128 b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 16), low_byte));
+		__m128 a = _mm_cvtepi32_ps(_mm_srli_epi32(v, 24));
+		__m128i c0 = matrix_row_rgba_sse41(matrix.rows[0], r, g, b, a);
+		__m128i c1 = matrix.uniform ? c0 : matrix_row_rgba_sse41(matrix.rows[1], r, g, b, a);
+		__m128i c2 = matrix.uniform ? c0 : matrix_row_rgba_sse41(matrix.rows[2], r, g, b, a);
+		__m128i c3 = matrix.alpha_passthrough ? _mm_and_si128(v, alpha) : _mm_slli_epi32(matrix_row_rgba_sse41(matrix.rows[3], r, g, b, a), 24);
+		__m128i result = _mm_or_si128(_mm_or_si128(c0, _mm_slli_epi32(c1, 8)), _mm_or_si128(_mm_slli_epi32(c2, 16), c3));
+		_mm_storeu_si128((__m128i*)(output + i * 4), result);
+	}
+	matrix_pixels((const Color_Matrix*)work->params, image + i * 4, output + i * 4, count - i, 4);
+}
+
+// --- AVX2: 8 floats per register. RGB still goes through the 16-pixel shuffles,
+// AVX2 byte shuffles cannot cross the two 128-bit halves that a 3-byte pixel straddles. ---
+
+KERNEL_AVX2 static inline void u8_to_float_avx2(__m128i bytes, __m256 values[2]) {
+	values[0] = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+	values[1] = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8)));
+}
+
+KERNEL_AVX2 static inline __m128i matrix_row_avx2(const float row[5], const __m256 r[2], const __m256 g[2], const __m256 b[2], const __m256 a[2]) {
+	__m256 w0 = _mm256_set1_ps(row[0]), w1 = _mm256_set1_ps(row[1]), w2 = _mm256_set1_ps(row[2]), w3 = _mm256_set1_ps(row[3]), w4 = _mm256_set1_ps(row[4]);
+	__m128i words[2];
+	for (int h = 0; h < 2; ++h) {
+		__m256 sum = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(w0, r[h]), _mm256_mul_ps(w1, g[h])), _mm256_mul_ps(w2, b[h]));
+		sum = _mm256_add_ps(_mm256_add_ps(sum, _mm256_mul_ps(w3, a[h])), w4);
+		__m256i sum32 = _mm256_cvttps_epi32(sum);
+		words[h] = _mm_packs_epi32(_mm256_castsi256_si128(sum32), _mm256_extracti128_si256(sum32, 1));
+	}
+
+	return _mm_packus_epi16(words[0], words[1]);
+}
+
+KERNEL_AVX2 static inline __m256i matrix_row_rgba_avx2(const float row[5], __m256 r, __m256 g, __m256 b, __m256 a) {
+	__m256 sum = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(row[0]), r), _mm256_mul_ps(_mm256_set1_ps(row[1]), g)), _mm256_mul_ps(_mm256_set1_ps(row[2]), b));
+	sum = _mm256_add_ps(_mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(row[3]), a)), _mm256_set1_ps(row[4]));
+
+	return _mm256_min_epi32(_mm256_max_epi32(_mm256_cvttps_epi32(sum), _mm256_setzero_si256()), _mm256_set1_epi32(255));
+}
+
+KERNEL_AVX2 static void invert_color_work_3channel_avx2(Work_Item* work) {
+	const unsigned char* image = work->image;
+	unsigned char* output = work->output;
+	size_t bytes = (size_t)work->width * work->height * 3;
+	__m256i ones = _mm256_set1_epi8(-1);
+	size_t i = 0;
+	for (; i + 32 <= bytes; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(image + i));
+		_mm256_storeu_si256((__m256i*)(output + i), _mm256_xor_si256(v, ones));
+	}
+	_mm256_zeroupper();
+	invert_bytes(image + i, output + i, bytes - i);
+}
+
+KERNEL_AVX2 static void invert_color_work_4channel_avx2(Work_Item* work) {
+	const unsigned char* image = work->image;
+	unsigned char* output = work->output;
+	size_t count = (size_t)work->width * work->height;
+	__m256i colour = _mm256_set1_epi32(0x00FFFFFF);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(image + i * 4));
+		_mm256_storeu_si256((__m256i*)(output + i * 4), _mm256_xor_si256(v, colour));
+	}
+	_mm256_zeroupper();
+	invert_pixels_4channel(image + i * 4, output + i * 4, count - i);
+}
+
+KERNEL_AVX2 static void matrix_work_3channel_avx2(Work_Item* work) {
+	Color_Matrix matrix = *(const Color_Matrix*)work->params;
+	const unsigned char* image = work->image;
+	unsigned char* output = work->output;
+	size_t count = (size_t)work->width * work->height;
+	__m256 fa[2] = { _mm256_set1_ps(255.0f), _mm256_set1_ps(255.0f) };
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i r, g, b;
+		__m256 fr[2], fg[2], fb[2];
+		rgb_deinterleave_16(image + i * 3, &r, &g, &b);
+		u8_to_float_avx2(r, fr);
+		u8_to_float_avx2(g, fg);
+		u8_to_float_avx2(b, fb);
+		__m128i c0 = matrix_row_avx2(matrix.rows[0], fr, fg, fb, fa);
+		__m128i c1 = matrix.uniform ? c0 : matrix_row_avx2(matrix.rows[1], fr, fg, fb, fa);
+		__m128i c2 = matrix.uniform ? c0 : matrix_row_avx2(matrix.rows[2], fr, fg, fb, fa);
+		rgb_interleave_16(output + i * 3, c0, c1, c2);
+	}
+	_mm256_zeroupper();
+	matrix_pixels((const Color_Matrix*)work->params, image + i * 3, output + i * 3, count - i, 3);
+}
+
+KERNEL_AVX2 static void matrix_work_4channel_avx2(Work_Item* work) {
+	Color_Matrix matrix = *(const Color_Matrix*)work->params;
+	const unsigned char* image = work->image;
+	unsigned char* output = work->output;
+	size_t count = (size_t)work->width * work->height;
+	__m256i low_byte = _mm256_set1_epi32(0xFF);
+	__m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(image + i * 4));
+		__m256 r = _mm256_cvtepi32_ps(_mm256_and_si256(v, low_byte));
+		__m256 g = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, 8), low_byte));
+		__m256 b = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, 16), low_byte));
+		__m256 a = _mm256_cvtepi32_ps(_mm256_srli_epi32(v, 24));
+		__m256i c0 = matrix_row_rgba_avx2(matrix.rows[0], r, g, b, a);
+		__m256i c1 = matrix.uniform ? c0 : matrix_row_rgba_avx2(matrix.rows[1], r, g, b, a);
+		__m256i c2 = matrix.uniform ? c0 : matrix_row_rgba_avx2(matrix.rows[2], r, g, b, a);
+		__m256i c3 = matrix.alpha_passthrough ? _mm256_and_si256(v, alpha) : _mm256_slli_epi32(matrix_row_rgba_avx2(matrix.rows[3], r, g, b, a), 24);
+		__m256i result = _mm256_or_si256(_mm256_or_si256(c0, _mm256_slli_epi32(c1, 8)), _mm256_or_si256(_mm256_slli_epi32(c2, 16), c3));
+		_mm256_storeu_si256((__m256i*)(output + i * 4), result);
+	}
+	_mm256_zeroupper();
+	matrix_pixels((const Color_Matrix*)work->params, image + i * 4, output + i * 4, count - i, 4);
+}
+
+// --- AVX-512: 16 floats per register, one register per 16-pixel RGB block ---
+
+KERNEL_AVX512 static inline __m512 u8_to_float_avx512(__m128i bytes) {
+	return _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(bytes));
+}
+
+// AVX-512 implies FMA and GCC would fuse a plain multiply and add into one, rounding once instead of twice
+// and so differing from the scalar kernels. Multiplies with an explicit rounding mode are never fused.
+KERNEL_AVX512 static inline __m512i matrix_row32_avx512(const float row[5], __m512 r, __m512 g, __m512 b, __m512 a) {
+	const int rounding = _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC;
+	__m512 wr = _mm512_mul_round_ps(_mm512_set1_ps(row[0]), r, rounding);
+	__m512 wg = _mm512_mul_round_ps(_mm512_set1_ps(row[1]), g, rounding);
+	__m512 wb = _mm512_mul_round_ps(_mm512_set1_ps(row[2]), b, rounding);
+	__m512 wa = _mm512_mul_round_ps(_mm512_set1_ps(row[3]), a, rounding);
+	__m512 sum = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(_mm512_add_ps(wr, wg), wb), wa), _mm512_set1_ps(row[4]));
+
+	return _mm512_min_epi32(_mm512_max_epi32(_mm512_cvttps_epi32(sum), _mm512_setzero_si512()), _mm512_set1_epi32(255));
+}
+
+KERNEL_AVX512 static void invert_color_work_3channel_avx512(Work_Item* work) {
+	const unsigned char* image = work->image;
+	unsigned char* output = work->output;
+	size_t bytes = (size_t)work->width * work->height * 3;
+	__m512i ones = _mm512_set1_epi8(-1);
+	size_t i = 0;
+	for (; i + 64 <= bytes; i += 64) {
+		__m512i v = _mm512_loadu_si512((const void*)(image + i));
+		_mm512_storeu_si512((void*)(output + i), _mm512_xor_si512(v, ones));
+	}
+	_mm256_zeroupper();
+	invert_bytes(image + i, output + i, bytes - i);
+}
+
+KERNEL_AVX512 static void invert_color_work_4channel_avx512(Work_Item* work) {
+	const unsigned char* image = work->image;
+	unsigned char* output = work->output;
+	size_t count = (size_t)work->width * work->height;
+	__m512i colour = _mm512_set1_epi32(0x00FFFFFF);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m512i v = _mm512_loadu_si512((const void*)(image + i * 4));
+		_mm512_storeu_si512((void*)(output + i * 4), _mm512_xor_si512(v, colour));
+	}
+	_mm256_zeroupper();
+	invert_pixels_4channel(image + i * 4, output + i * 4, count - i);
+}
+
+KERNEL_AVX512 static void matrix_work_3channel_avx512(Work_Item* work) {
+	Color_Matrix matrix = *(const Color_Matrix*)work->params;
+	const unsigned char* image = work->image;
+	unsigned char* output = work->output;
+	size_t count = (size_t)work->width * work->height;
+	__m512 fa = _mm512_set1_ps(255.0f);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i r, g, b;
+		rgb_deinterleave_16(image + i * 3, &r, &g, &b);
+		__m512 fr = u8_to_float_avx512(r), fg = u8_to_float_avx512(g), fb = u8_to_float_avx512(b);
+		__m128i c0 = _mm512_cvtepi32_epi8(matrix_row32_avx512(matrix.rows[0], fr, fg, fb, fa));
+		__m128i c1 = matrix.uniform ? c0 : _mm512_cvtepi32_epi8(matrix_row32_avx512(matrix.rows[1], fr, fg, fb, fa));
+		__m128i c2 = matrix.uniform ? c0 : _mm512_cvtepi32_epi8(matrix_row32_avx512(matrix.rows[2], fr, fg, fb, fa));
+		rgb_interleave_16(output + i * 3, c0, c1, c2);
+	}
+	_mm256_zeroupper();
+	matrix_pixels((const Color_Matrix*)work->params, image + i * 3, output + i * 3, count - i, 3);
+}
+
+KERNEL_AVX512 static void matrix_work_4channel_avx512(Work_Item* work) {
+	Color_Matrix matrix = *(const Color_Matrix*)work->params;
+	const unsigned char* image = work->image;
+	unsigned char* output = work->output;
+	size_t count = (size_t)work->width * work->height;
+	__m512i low_byte = _mm512_set1_epi32(0xFF);
+	__m512i alpha = _mm512_set1_epi32((int)0xFF000000);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m512i v = _mm512_loadu_si512((const void*)(image + i * 4));
+		__m512 r = _mm512_cvtepi32_ps(_mm512_and_si512(v, low_byte));
+		__m512 g = _mm512_cvtepi32_ps(_mm512_and_si512(_mm512_srli_epi32(v, 8), low_byte));
+		__m512 b = _mm512_cvtepi32_ps(_mm512_and_si512(_mm512_srli_epi32(v, 16), low_byte));
+		__m512 a = _mm512_cvtepi32_ps(_mm512_srli_epi32(v, 24));
+		__m512i c0 = matrix_row32_avx512(matrix.rows[0], r, g, b, a);
+		__m512i c1 = matrix.uniform ? c0 : matrix_row32_avx512(matrix.rows[1], r, g, b, a);
+		__m512i c2 = matrix.uniform ? c0 : matrix_row32_avx512(matrix.rows[2], r, g, b, a);
+		__m512i c3 = matrix.alpha_passthrough ? _mm512_and_si512(v, alpha) : _mm512_slli_epi32(matrix_row32_avx512(matrix.rows[3], r, g, b, a), 24);
+		__m512i result = _mm512_or_si512(_mm512_or_si512(c0, _mm512_slli_epi32(c1, 8)), _mm512_or_si512(_mm512_slli_epi32(c2, 16), c3));
+		_mm512_storeu_si512((void*)(output + i * 4), result);
+	}
+	_mm256_zeroupper();
+	matrix_pixels((const Color_Matrix*)work->params, image + i * 4, output + i * 4, count - i, 4);
+}
+
+// --- Fast mode kernels. Channels are held in 16-bit lanes and pmaddwd multiplies two channel/weight pairs
+// and adds them into one 32-bit sum, so a row of four weights is two instructions per 4, 8 or 16 sums. ---
+
+// pmaddwd operand of two weights, low multiplies the low word of every 32-bit lane
+static inline int32_t weight_pair(int16_t low, int16_t high) {
+	return (int32_t)((uint32_t)(uint16_t)low | ((uint32_t)(uint16_t)high << 16));
+}
+
+// Matrix row for 16 RGB pixels held as two registers of 8 words per channel
+KERNEL_SSE41 static inline __m128i matrix_row_fixed_sse41(const Color_Matrix* matrix, int c, const __m128i r[2], const __m128i g[2], const __m128i b[2], __m128i a) {
+	const int16_t* weights = matrix->weights[c];
+	__m128i w_rg = _mm_set1_epi32(weight_pair(weights[0], weights[1]));
+	__m128i w_ba = _mm_set1_epi32(weight_pair(weights[2], weights[3]));
+	__m128i offset = _mm_set1_epi32(matrix->offsets[c]);
+	__m128i shift = _mm_cvtsi32_si128((int)matrix->shift);
+	__m128i words[2];
+	for (int h = 0; h < 2; ++h) {
+		__m128i low = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(r[h], g[h]), w_rg), _mm_madd_epi16(_mm_unpacklo_epi16(b[h], a), w_ba));
+		__m128i high = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(r[h], g[h]), w_rg), _mm_madd_epi16(_mm_unpackhi_epi16(b[h], a), w_ba));
+		words[h] = _mm_packs_epi32(_mm_sra_epi32(_mm_add_epi32(low, offset), shift), _mm_sra_epi32(_mm_add_epi32(high, offset), shift));
+	}
+
+	return _mm_packus_epi16(words[0], words[1]);
+}
+
+// For RGBA every 32-bit lane keeps one pixel: masking gives the word pair (r, b), shifting first gives (g, a)
+KERNEL_SSE41 static inline __m128i matrix_row_fixed_rgba_sse41(const Color_Matrix* matrix, int c, __m128i rb, __m128i ga) {
+	const int16_t* weights = matrix->weights[c];
+	__m128i sum = _mm_add_epi32(_mm_madd_epi16(rb, _mm_set1_epi32(weight_pair(weights[0], weights[2]))), _mm_madd_epi16(ga, _mm_set1_epi32(weight_pair(weights[1], weights[3]))));
+	sum = _mm_sra_epi32(_mm_add_epi32(sum, _mm_set1_epi32(matrix->offsets[c])), _mm_cvtsi32_si128((int)matrix->shift));
+
+	return _mm_min_epi32(_mm_max_epi32(sum, _mm_setzero_si128()), _mm_set1_epi32(255));
+}
+
+// 16 channel bytes to two registers of 8 words
+KERNEL_SSE41 static inline void u8_to_words_sse41(__m128i bytes, __m128i values[2]) {
+	values[0] = _mm_unpacklo_epi8(bytes, _mm_setzero_si128());
+	values[1] = _mm_unpackhi_epi8(bytes, _mm_setzero_si128());
+}
+
+KERNEL_SSE41 static void matrix_fixed_work_3channel_sse41(Work_Item* work) {
+	Color_Matrix matrix = *(const Color_Matrix*)work->params;
+	const unsigned char* image = work->image;
+	unsigned char* output = work->output;
+	size_t count = (size_t)work->width * work->height;
+	__m128i a = _mm_set1_epi16(255);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i r, g, b, wr[2], wg[2], wb[2];
+		rgb_deinterleave_16(image + i * 3, &r, &g, &b);
+		u8_to_words_sse41(r, wr);
+		u8_to_words_sse41(g, wg);
+		u8_to_words_sse41(b, wb);
+		__m128i c0 = matrix_row_fixed_sse41(&matrix, 0, wr, wg, wb, a);
+		__m128i c1 = matrix.uniform ? c0 : matrix_row_fixed_sse41(&matrix, 1, wr, wg, wb, a);
+		__m128i c2 = matrix.uniform ? c0 : matrix_row_fixed_sse41(&matrix, 2, wr, wg, wb, a);
+		rgb_interleave_16(output + i * 3, c0, c1, c2);
+	}
+	matrix_fixed_pixels((const Color_Matrix*)work->params, image + i * 3, output + i * 3, count - i, 3);
+}
+
+KERNEL_SSE41 static void matrix_fixed_work_4channel_sse41(Work_Item* work) {
+	Color_Matrix matrix = *(const Color_Matrix*)work->params;
+	const unsigned char* image = work->image;
+	unsigned char* output = work->output;
+	size_t count = (size_t)work->width * work->height;
+	__m128i pair_mask = _mm_set1_epi32(0x00FF00FF);
+	__m128i alpha = _mm_set1_epi32((int)0xFF000000);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(image + i * 4));
+		__m128i rb = _mm_and_si128(v, pair_mask);
+		__m128i ga = _mm_and_si128(_mm_srli_epi32(v, 8), pair_mask);
+		__m128i c0 = matrix_row_fixed_rgba_sse41(&matrix, 0, rb, ga);
+		__m128i c1 = matrix.uniform ? c0 : matrix_row_fixed_rgba_sse41(&matrix, 1, rb, ga);
+		__m128i c2 = matrix.uniform ? c0 : matrix_row_fixed_rgba_sse41(&matrix, 2, rb, ga);
+		__m128i c3 = matrix.alpha_passthrough ? _mm_and_si128(v, alpha) : _mm_slli_epi32(matrix_row_fixed_rgba_sse41(&matrix, 3, rb, ga), 24);
+		__m128i result = _mm_or_si128(_mm_or_si128(c0, _mm_slli_epi32(c1, 8)), _mm_or_si128(_mm_slli_epi32(c2, 16), c3));
+		_mm_storeu_si128((__m128i*)(output + i * 4), result);
+	}
+	matrix_fixed_pixels((const Color_Matrix*)work->params, image + i * 4, output + i * 4, count - i, 4);
+}
+
+// The in-lane unpacks take pixels 0-3 and 8-11 into the low sums and 4-7 and 12-15 into the high ones,
+// the in-lane pack puts them back in order
+KERNEL_AVX2 static inline __m128i matrix_row_fixed_avx2(const Color_Matrix* matrix, int c, __m256i r, __m256i g, __m256i b, __m256i a) {
+	const int16_t* weights = matrix->weights[c];
+	__m256i w_rg = _mm256_set1_epi32(weight_pair(weights[0], weights[1]));
+	__m256i w_ba = _mm256_set1_epi32(weight_pair(weights[2], weights[3]));
+	__m256i offset = _mm256_set1_epi32(matrix->offsets[c]);
+	__m128i shift = _mm_cvtsi32_si128((int)matrix->shift);
+	__m256i low = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(r, g), w_rg), _mm256_madd_epi16(_mm256_unpacklo_epi16(b, a), w_ba));
+	__m256i high = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(r, g), w_rg), _mm256_madd_epi16(_mm256_unpackhi_epi16(b, a), w_ba));
+	__m256i words = _mm256_packs_epi32(_mm256_sra_epi32(_mm256_add_epi32(low, offset), shift), _mm256_sra_epi32(_mm256_add_epi32(high, offset), shift));
+
+	return _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1));
+}
+
+KERNEL_AVX2 static inline __m256i matrix_row_fixed_rgba_avx2(const Color_Matrix* matrix, int c, __m256i rb, __m256i ga) {
+	const int16_t* weights = matrix->weights[c];
+	__m256i sum = _mm256_add_epi32(_mm256_madd_epi16(rb, _mm256_set1_epi32(weight_pair(weights[0], weights[2]))), _mm256_madd_epi16(ga, _mm256_set1_epi32(weight_pair(weights[1], weights[3]))));
+	sum = _mm256_sra_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(matrix->offsets[c])), _mm_cvtsi32_si128((int)matrix->shift));
+
+	return _mm256_min_epi32(_mm256_max_epi32(sum, _mm256_setzero_si256()), _mm256_set1_epi32(255));
+}
+
+KERNEL_AVX2 static void matrix_fixed_work_3channel_avx2(Work_Item* work) {
+	Color_Matrix matrix = *(const Color_Matrix*)work->params;
+	const unsigned char* image = work->image;
+	unsigned char* output = work->output;
+	size_t count = (size_t)work->width * work->height;
+	__m256i a = _mm256_set1_epi16(255);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i r, g, b;
+		rgb_deinterleave_16(image + i * 3, &r, &g, &b);
+		__m256i wr = _mm256_cvtepu8_epi16(r), wg = _mm256_cvtepu8_epi16(g), wb = _mm256_cvtepu8_epi16(b);
+		__m128i c0 = matrix_row_fixed_avx2(&matrix, 0, wr, wg, wb, a);
+		__m128i c1 = matrix.uniform ? c0 : matrix_row_fixed_avx2(&matrix, 1, wr, wg, wb, a);
+		__m128i c2 = matrix.uniform ? c0 : matrix_row_fixed_avx2(&matrix, 2, wr, wg, wb, a);
+		rgb_interleave_16(output + i * 3, c0, c1, c2);
+	}
+	_mm256_zeroupper();
+	matrix_fixed_pixels((const Color_Matrix*)work->params, image + i * 3, output + i * 3, count - i, 3);
+}
+
+KERNEL_AVX2 static void matrix_fixed_work_4channel_avx2(Work_Item* work) {
+	Color_Matrix matrix = *(const Color_Matrix*)work->params;
+	const unsigned char* image = work->image;
+	unsigned char* output = work->output;
+	size_t count = (size_t)work->width * work->height;
+	__m256i pair_mask = _mm256_set1_epi32(0x00FF00FF);
+	__m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(image + i * 4));
+		__m256i rb = _mm256_and_si256(v, pair_mask);
+		__m256i ga = _mm256_and_si256(_mm256_srli_epi32(v, 8), pair_mask);
+		__m256i c0 = matrix_row_fixed_rgba_avx2(&matrix, 0, rb, ga);
+		__m256i c1 = matrix.uniform ? c0 : matrix_row_fixed_rgba_avx2(&matrix, 1, rb, ga);
+		__m256i c2 = matrix.uniform ? c0 : matrix_row_fixed_rgba_avx2(&matrix, 2, rb, ga);
+		__m256i c3 = matrix.alpha_passthrough ? _mm256_and_si256(v, alpha) : _mm256_slli_epi32(matrix_row_fixed_rgba_avx2(&matrix, 3, rb, ga), 24);
+		__m256i result = _mm256_or_si256(_mm256_or_si256(c0, _mm256_slli_epi32(c1, 8)), _mm256_or_si256(_mm256_slli_epi32(c2, 16), c3));
+		_mm256_storeu_si256((__m256i*)(output + i * 4), result);
+	}
+	_mm256_zeroupper();
+	matrix_fixed_pixels((const Color_Matrix*)work->params, image + i * 4, output + i * 4, count - i, 4);
+}
+
+// Two 16-pixel RGB blocks fill one register of 32 words, the row comes back as 32 words in pixel order
+KERNEL_AVX512 static inline __m512i u8_to_words_avx512(__m128i low, __m128i high) {
+	return _mm512_cvtepu8_epi16(_mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1));
+}
+
+KERNEL_AVX512 static inline __m512i matrix_row_fixed_avx512(const Color_Matrix* matrix, int c, __m512i r, __m512i g, __m512i b, __m512i a) {
+	const int16_t* weights = matrix->weights[c];
+	__m512i w_rg = _mm512_set1_epi32(weight_pair(weights[0], weights[1]));
+	__m512i w_ba = _mm512_set1_epi32(weight_pair(weights[2], weights[3]));
+	__m512i offset = _mm512_set1_epi32(matrix->offsets[c]);
+	__m128i shift = _mm_cvtsi32_si128((int)matrix->shift);
+	__m512i low = _mm512_add_epi32(_mm512_madd_epi16(_mm512_unpacklo_epi16(r, g), w_rg), _mm512_madd_epi16(_mm512_unpacklo_epi16(b, a), w_ba));
+	__m512i high = _mm512_add_epi32(_mm512_madd_epi16(_mm512_unpackhi_epi16(r, g), w_rg), _mm512_madd_epi16(_mm512_unpackhi_epi16(b, a), w_ba));
+
+	return _mm512_packs_epi32(_mm512_sra_epi32(_mm512_add_epi32(low, offset), shift), _mm512_sra_epi32(_mm512_add_epi32(high, offset), shift));
+}
+
+// 32 words back to two registers of 16 saturated bytes
+KERNEL_AVX512 static inline void words_to_u8_avx512(__m512i words, __m128i bytes[2]) {
+	__m256i packed = _mm512_cvtusepi16_epi8(_mm512_max_epi16(words, _mm512_setzero_si512()));
+	bytes[0] = _mm256_castsi256_si128(packed);
+	bytes[1] = _mm256_extracti128_si256(packed, 1);
+}
+
+KERNEL_AVX512 static inline __m512i matrix_row_fixed_rgba_avx512(const Color_Matrix* matrix, int c, __m512i rb, __m512i ga) {
+	const int16_t* weights = matrix->weights[c];
+	__m512i sum = _mm512_add_epi32(_mm512_madd_epi16(rb, _mm512_set1_epi32(weight_pair(weights[0], weights[2]))), _mm512_madd_epi16(ga, _mm512_set1_epi32(weight_pair(weights[1], weights[3]))));
+	sum = _mm512_sra_epi32(_mm512_add_epi32(sum, _mm512_set1_epi32(matrix->offsets[c])), _mm_cvtsi32_si128((int)matrix->shift));
+
+	return _mm512_min_epi32(_mm512_max_epi32(sum, _mm512_setzero_si512()), _mm512_set1_epi32(255));
+}
+
+KERNEL_AVX512 static void matrix_fixed_work_3channel_avx512(Work_Item* work) {
+	Color_Matrix matrix = *(const Color_Matrix*)work->params;
+	const unsigned char* image = work->image;
+	unsigned char* output = work->output;
+	size_t count = (size_t)work->width * work->height;
+	__m512i a = _mm512_set1_epi16(255);
+	size_t i = 0;
+	for (; i + 32 <= count; i += 32) {
+		__m128i r[2], g[2], b[2], c0[2], c1[2], c2[2];
+		rgb_deinterleave_16(image + i * 3, &r[0], &g[0], &b[0]);
+		rgb_deinterleave_16(image + i * 3 + 48, &r[1], &g[1], &b[1]);
+		__m512i wr = u8_to_words_avx512(r[0], r[1]), wg = u8_to_words_avx512(g[0], g[1]), wb = u8_to_words_avx512(b[0], b[1]);
+		words_to_u8_avx512(matrix_row_fixed_avx512(&matrix, 0, wr, wg, wb, a), c0);
+		if (matrix.uniform) {
+			rgb_interleave_16(output + i * 3, c0[0], c0[0], c0[0]);
+			rgb_interleave_16(output + i * 3 + 48, c0[1], c0[1], c0[1]);
+			continue;
+		}
+		words_to_u8_avx512(matrix_row_fixed_avx512(&matrix, 1, wr, wg, wb, a), c1);
+		words_to_u8_avx512(matrix_row_fixed_avx512(&matrix, 2, wr, wg, wb, a), c2);
+		rgb_interleave_16(output + i * 3, c0[0], c1[0], c2[0]);
+		rgb_interleave_16(output + i * 3 + 48, c0[1], c1[1], c2[1]);
+	}
+	_mm256_zeroupper();
+	matrix_fixed_pixels((const Color_Matrix*)work->params, image + i * 3, output + i * 3, count - i, 3);
+}
+
+KERNEL_AVX512 static void matrix_fixed_work_4channel_avx512(Work_Item* work) {
+	Color_Matrix matrix = *(const Color_Matrix*)work->params;
+	const unsigned char* image = work->image;
+	unsigned char* output = work->output;
+	size_t count = (size_t)work->width * work->height;
+	__m512i pair_mask = _mm512_set1_epi32(0x00FF00FF);
+	__m512i alpha = _mm512_set1_epi32((int)0xFF000000);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m512i v = _mm512_loadu_si512((const void*)(image + i * 4));
+		__m512i rb = _mm512_and_si512(v, pair_mask);
+		__m512i ga = _mm512_and_si512(_mm512_srli_epi32(v, 8), pair_mask);
+		__m512i c0 = matrix_row_fixed_rgba_avx512(&matrix, 0, rb, ga);
+		__m512i c1 = matrix.uniform ? c0 : matrix_row_fixed_rgba_avx512(&matrix, 1, rb, ga);
+		__m512i c2 = matrix.uniform ? c0 : matrix_row_fixed_rgba_avx512(&matrix, 2, rb, ga);
+		__m512i c3 = matrix.alpha_passthrough ? _mm512_and_si512(v, alpha) : _mm512_slli_epi32(matrix_row_fixed_rgba_avx512(&matrix, 3, rb, ga), 24);
+		__m512i result = _mm512_or_si512(_mm512_or_si512(c0, _mm512_slli_epi32(c1, 8)), _mm512_or_si512(_mm512_slli_epi32(c2, 16), c3));
+		_mm512_storeu_si512((void*)(output + i * 4), result);
+	}
+	_mm256_zeroupper();
+	matrix_fixed_pixels((const Color_Matrix*)work->params, image + i * 4, output + i * 4, count - i, 4);
+}
+
+// --- Lookup tables. A 256-entry table does not fit pshufb, splitting it by the high nibble into sixteen lookups
+// came out slower than the scalar loads on SSE4.1 and no faster on AVX2, so only VBMI gets vector kernels. ---
+
+// Tail of a flat run, which need not end on a pixel
+static void lut_bytes(const uint8_t table[256], const unsigned char* image, unsigned char* output, size_t bytes) {
+	for (size_t i = 0; i < bytes; ++i) {
+		output[i] = table[image[i]];
+	}
+}
+
+// vpermi2b indexes 128 bytes with the low 7 bits, the top bit picks the half of the table
+KERNEL_AVX512VBMI static inline void lut_load_vbmi(const uint8_t table[256], __m512i quarters[4]) {
+	for (int q = 0; q < 4; ++q) {
+		quarters[q] = _mm512_loadu_si512((const void*)(table + q * 64));
+	}
+}
+
+KERNEL_AVX512VBMI static inline __m512i lut_lookup_vbmi(const __m512i quarters[4], __m512i x) {
+	__m512i low = _mm512_permutex2var_epi8(quarters[0], x, quarters[1]);
+	__m512i high = _mm512_permutex2var_epi8(quarters[2], x, quarters[3]);
+
+	return _mm512_mask_blend_epi8(_mm512_movepi8_mask(x), low, high);
+}
+
+// The lookup is cheap enough to run every table over the interleaved bytes and blend by channel,
+// so no deinterleaving. Lane j of register v of a 192-byte RGB block holds channel (64 * v + j) % 3.
+KERNEL_AVX512VBMI static void lut_work_3channel_vbmi(Work_Item* work) {
+	const Lut* lut = (const Lut*)work->params;
+	const unsigned char* image = work->image;
+	unsigned char* output = work->output;
+	size_t count = (size_t)work->width * work->height;
+	size_t i = 0;
+	if (lut->flat) {
+		__m512i quarters[4];
+		lut_load_vbmi(lut->tables[0], quarters);
+		for (; i + 64 <= count * 3; i += 64) {
+			_mm512_storeu_si512((void*)(output + i), lut_lookup_vbmi(quarters, _mm512_loadu_si512((const void*)(image + i))));
+		}
+		_mm256_zeroupper();
+		lut_bytes(lut->tables[0], image + i, output + i, count * 3 - i);
+		return;
+	}
+	__m512i quarters[3][4];
+	__mmask64 channel_masks[3][3] = { { 0 } };
+	for (int c = 0; c < 3; ++c) {
+		lut_load_vbmi(lut->tables[c], quarters[c]);
+	}
+	for (int v = 0; v < 3; ++v) {
+		for (int j = 0; j < 64; ++j) {
+			channel_masks[v][(64 * v + j) % 3] |= (__mmask64)1 << j;
+		}
+	}
+	for (; i + 64 <= count; i += 64) {
+		for (int v = 0; v < 3; ++v) {
+			const unsigned char* source = image + i * 3 + v * 64;
+			__m512i x = _mm512_loadu_si512((const void*)source);
+			__m512i result = lut_lookup_vbmi(quarters[0], x);
+			result = _mm512_mask_blend_epi8(channel_masks[v][1], result, lut_lookup_vbmi(quarters[1], x));
+			result = _mm512_mask_blend_epi8(channel_masks[v][2], result, lut_lookup_vbmi(quarters[2], x));
+			_mm512_storeu_si512((void*)(output + i * 3 + v * 64), result);
+		}
+	}
+	_mm256_zeroupper();
+	lut_pixels(lut, image + i * 3, output + i * 3, count - i, 3);
+}
+
+KERNEL_AVX512VBMI static void lut_work_4channel_vbmi(Work_Item* work) {
+	const Lut* lut = (const Lut*)work->params;
+	const unsigned char* image = work->image;
+	unsigned char* output = work->output;
+	size_t count = (size_t)work->width * work->height;
+	const __mmask64 first_channel = 0x1111111111111111ull;
+	__m512i quarters[4][4];
+	int table_count = lut->flat || lut->keep_alpha ? 1 : 4;
+	for (int c = 0; c < table_count; ++c) {
+		lut_load_vbmi(lut->tables[c], quarters[c]);
+	}
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m512i x = _mm512_loadu_si512((const void*)(image + i * 4));
+		__m512i result = lut_lookup_vbmi(quarters[0], x);
+		if (lut->keep_alpha && !lut->flat) {
+			result = _mm512_mask_blend_epi8(first_channel << 3, result, x);
+		}
+		else if (table_count == 4) {
+			for (int c = 1; c < 4; ++c) {
+				result = _mm512_mask_blend_epi8(first_channel << c, result, lut_lookup_vbmi(quarters[c], x));
+			}
+		}
+		_mm512_storeu_si512((void*)(output + i * 4), result);
+	}
+	_mm256_zeroupper();
+	lut_pixels(lut, image + i * 4, output + i * 4, count - i, 4);
+}
+#endif
+
+Filter_Simd_Level filter_kernels_select(Filter_Kernels* kernels, Filter_Simd_Level max_level) {
+	Filter_Simd_Level level = SIMD_SCALAR;
+#ifdef FILTER_KERNELS_X86
+	uint32_t features = platform_cpu_features();
+	if (max_level == SIMD_AUTO) max_level = SIMD_AVX512;
+	if (max_level >= SIMD_SSE41 && (features & PLATFORM_CPU_SSE41)) level = SIMD_SSE41;
+	if (max_level >= SIMD_AVX2 && (features & PLATFORM_CPU_AVX2)) level = SIMD_AVX2;
+	if (max_level >= SIMD_AVX512 && (features & PLATFORM_CPU_AVX512)) level = SIMD_AVX512;
+#endif
+	switch (level) {
+#ifdef FILTER_KERNELS_X86
+	case SIMD_SSE41:
+		kernels->invert[0] = invert_color_work_3channel_sse41;
+		kernels->invert[1] = invert_color_work_4channel_sse41;
+		kernels->matrix[0] = matrix_work_3channel_sse41;
+		kernels->matrix[1] = matrix_work_4channel_sse41;
+		kernels->matrix_fixed[0] = matrix_fixed_work_3channel_sse41;
+		kernels->matrix_fixed[1] = matrix_fixed_work_4channel_sse41;
+		kernels->lut[0] = lut_work_3channel;
+		kernels->lut[1] = lut_work_4channel;
+		break;
+	case SIMD_AVX2:
+		kernels->invert[0] = invert_color_work_3channel_avx2;
+		kernels->invert[1] = invert_color_work_4channel_avx2;
+		kernels->matrix[0] = matrix_work_3channel_avx2;
+		kernels->matrix[1] = matrix_work_4channel_avx2;
+		kernels->matrix_fixed[0] = matrix_fixed_work_3channel_avx2;
+		kernels->matrix_fixed[1] = matrix_fixed_work_4channel_avx2;
+		kernels->lut[0] = lut_work_3channel;
+		kernels->lut[1] = lut_work_4channel;
+		break;
+	case SIMD_AVX512:
+		kernels->invert[0] = invert_color_work_3channel_avx512;
+		kernels->invert[1] = invert_color_work_4channel_avx512;
+		kernels->matrix[0] = matrix_work_3channel_avx512;
+		kernels->matrix[1] = matrix_work_4channel_avx512;
+		kernels->matrix_fixed[0] = matrix_fixed_work_3channel_avx512;
+		kernels->matrix_fixed[1] = matrix_fixed_work_4channel_avx512;
+		kernels->lut[0] = (features & PLATFORM_CPU_AVX512VBMI) ? lut_work_3channel_vbmi : lut_work_3channel;
+		kernels->lut[1] = (features & PLATFORM_CPU_AVX512VBMI) ? lut_work_4channel_vbmi : lut_work_4channel;
+		break;
+#endif
+	default:
+		kernels->invert[0] = invert_color_work_3channel;
+		kernels->invert[1] = invert_color_work_4channel;
+		kernels->matrix[0] = matrix_work_3channel;
+		kernels->matrix[1] = matrix_work_4channel;
+		kernels->matrix_fixed[0] = matrix_fixed_work_3channel;
+		kernels->matrix_fixed[1] = matrix_fixed_work_4channel;
+		kernels->lut[0] = lut_work_3channel;
+		kernels->lut[1] = lut_work_4channel;
+		break;
+	}
+
+	return level;
+}
+
+bool color_matrix_prepare(Color_Matrix* prepared, const float matrix[20], const Filter_Kernels* kernels, Filter_Color_Math color_math) {
+	float max_weight = 0.0f;
+	for (int c = 0; c < 4; ++c) {
+		for (int k = 0; k < 5; ++k) {
+			float value = matrix[c * 5 + k];
+			float limit = k < 4 ? MATRIX_MAX_WEIGHT : MATRIX_MAX_OFFSET;
+			if (!(fabsf(value) <= limit)) return false; // Also catches NaN
+			prepared->rows[c][k] = value;
+			if (k < 4 && fabsf(value) > max_weight) max_weight = fabsf(value);
+		}
+	}
+	const float* r = prepared->rows[0];
+	const float* g = prepared->rows[1];
+	const float* b = prepared->rows[2];
+	const float* a = prepared->rows[3];
+	prepared->uniform = true;
+	for (int k = 0; k < 5; ++k) {
+		if (r[k] != g[k] || r[k] != b[k]) prepared->uniform = false;
+	}
+	prepared->alpha_passthrough = a[0] == 0.0f && a[1] == 0.0f && a[2] == 0.0f && a[3] == 1.0f && a[4] == 0.0f;
+
+	uint32_t shift = FIXED_MAX_SHIFT;
+	while (shift > FIXED_MIN_SHIFT && max_weight * (float)(1 << shift) > 32767.0f) shift--;
+	// Matrices with weights too large for 16 bits at the minimum shift stay on the float kernels
+	bool fixed = color_math == COLOR_MATH_FAST && max_weight * (float)(1 << shift) <= 32767.0f;
+	prepared->shift = shift;
+	for (int c = 0; c < 4; ++c) {
+		for (int k = 0; k < 4; ++k) {
+			prepared->weights[c][k] = fixed ? (int16_t)lrintf(prepared->rows[c][k] * (float)(1 << shift)) : 0;
+		}
+		prepared->offsets[c] = fixed ? (int32_t)lrintf(prepared->rows[c][4] * (float)(1 << shift)) : 0;
+	}
+	prepared->function[0] = fixed ? kernels->matrix_fixed[0] : kernels->matrix[0];
+	prepared->function[1] = fixed ? kernels->matrix_fixed[1] : kernels->matrix[1];
+
+	return true;
+}
+
+void lut_prepare(Lut* prepared, const uint8_t tables[][256], uint32_t channels) {
+	for (uint32_t c = 0; c < 4; ++c) {
+		for (int x = 0; x < 256; ++x) {
+			prepared->tables[c][x] = c < channels ? tables[c][x] : (uint8_t)x;
+		}
+	}
+	bool colors_shared = memcmp(prepared->tables[0], prepared->tables[1], 256) == 0 && memcmp(prepared->tables[0], prepared->tables[2], 256) == 0;
+	bool alpha_identity = true;
+	for (int x = 0; x < 256; ++x) {
+		if (prepared->tables[3][x] != x) alpha_identity = false;
+	}
+	prepared->flat = colors_shared && (channels == 3 || memcmp(prepared->tables[0], prepared->tables[3], 256) == 0);
+	prepared->keep_alpha = colors_shared && alpha_identity;
+}
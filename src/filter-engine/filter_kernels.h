@@ -0,0 +1,181 @@
+#ifndef FILTER_KERNELS_H
+#define FILTER_KERNELS_H
+#include "filter.h"
+
+// Internal to the filter engine: the work item a worker runs and the kernels that process it.
+
+struct Work_Item;
+struct Work_Context_Node;
+struct Resample_Cache;
+// Generic filter function type
+typedef void (*Filter_Function)(Work_Item* work);
+
+typedef struct Work_Item {
+	unsigned char* image;
+	unsigned char* output;
+	uint32_t width, height;
+	Filter_Function function;
+	const void* params; // Filter parameters for kernels that take any, owned by the engine or the job's node
+	Work_Context_Node* node; // Owning context, set when the items are handed to the workers
+	size_t stride; // Bytes from one row of image to the next
+	uint32_t halo_top, halo_bottom; // Rows above and below its own that an area filter item may read, 0 at the image edges
+	uint32_t row; // Index of the item's first row in the whole output, resizing maps it back to the input rows
+	uint32_t column; // Index of the item's first column, only tiled items start anywhere but 0
+} Work_Item;
+
+// A color matrix prepared for the kernels. The float rows drive the exact kernels, the fast kernels use the
+// fixed point copy: floor((weights . (r, g, b, a) + offsets) / 2^shift), both clamped to a byte.
+typedef struct Color_Matrix {
+	float rows[4][5];
+	int16_t weights[4][4];
+	int32_t offsets[4];
+	uint32_t shift;
+	bool uniform; // Rows r, g and b are equal, the kernels compute the sum once (grayscale)
+	bool alpha_passthrough; // Row a is (0, 0, 0, 1, 0), RGBA alpha is copied
+	Filter_Function function[2]; // Kernel picked for this matrix, RGB and RGBA
+} Color_Matrix;
+
+// One lookup table per channel, prepared for the kernels. RGB images have an identity table for alpha.
+typedef struct Lut {
+	uint8_t tables[4][256];
+	bool flat;		 // Every byte of the image goes through tables[0], the kernels look up plain byte runs
+	bool keep_alpha; // Colors share tables[0] and alpha is the identity, RGBA alpha is copied
+} Lut;
+
+// Mean of the (2 * radius + 1)^2 box around each pixel, rounded. The image edge repeats outwards.
+typedef struct Box_Blur {
+	uint32_t radius;
+	uint32_t area;
+	uint64_t reciprocal; // Divides by area with a multiply, see box_mean
+} Box_Blur;
+
+// Largest FIR radius, the recursive filter takes over well before it
+const uint32_t GAUSSIAN_FIR_MAX_RADIUS = 32;
+
+// Gaussian blur, either as a FIR with the normalized weights out to 3 sigma or as a recursive filter whose cost
+// does not depend on sigma. The image edge repeats outwards.
+typedef struct Gaussian_Blur {
+	float sigma;
+	bool recursive;
+	uint32_t halo; // FIR radius, or the rows the recursive filter runs in from a band edge before its values settle
+	float weights[GAUSSIAN_FIR_MAX_RADIUS + 1]; // FIR, weights[k] for the pixels k before and after, weights[0] for the center
+	double coefficients[4]; // Recursive, out[n] = c0 * in[n] + c1 * out[n - 1] + c2 * out[n - 2] + c3 * out[n - 3] in each direction.
+							// Double, as in float the poles close to 1 of large sigmas drift several steps off.
+} Gaussian_Blur;
+
+// Gradient magnitude of a 3x3 operator, smoothing across the gradient with outer, center, outer
+typedef struct Edge {
+	int32_t outer, center; // 1, 2 for Sobel and 3, 10 for Scharr
+	float scale; // Scharr's weights add up to four times Sobel's, this brings its magnitude to the same range
+	bool luma; // Takes the gradient of the luma and writes it to r, g and b, otherwise every color channel gets its own
+} Edge;
+
+// Resampling weights of one axis for one pair of sizes and one filter. Shared through the engine's cache,
+// every job that holds an axis has a reference to it.
+typedef struct Resample_Axis {
+	uint32_t source_size, target_size;
+	Filter_Resample filter;
+	uint32_t taps; // Weights per output pixel, the same for every pixel of the axis
+	uint32_t* first; // Input index of each output pixel's first tap, its taps never run past the input.
+	float* weights; // taps weights per output pixel, they add up to one. Taps outside the input are folded onto the edge pixel.
+	uint32_t references; // Under the cache lock
+	uint64_t last_used;
+	bool cached; // False when every cache slot was in use, the last reference frees it
+} Resample_Axis;
+
+// Separable resampling, the vertical pass reads the input and the horizontal one writes the item's output rows
+typedef struct Resize {
+	Resample_Axis* horizontal;
+	Resample_Axis* vertical;
+	Resample_Cache* cache;
+	uint32_t source_width, source_height;
+	Filter_Resample filter;
+} Resize;
+
+// Most levels a reduce job writes, enough to take any 32-bit size down to one pixel
+const uint32_t REDUCE_MAX_LEVELS = 32;
+
+// Means of factor x factor blocks, each level reduced from the one before it. The last block of a row or
+// column also takes in the remainder, so every input pixel counts. A pyramid has several levels of factor 2.
+typedef struct Reduce {
+	uint32_t factor;
+	uint32_t level_count;
+	uint32_t source_width, source_height;
+	Image levels[REDUCE_MAX_LEVELS];
+} Reduce;
+
+struct Convolve_Fft; // Transform sizes, tables and the kernel's spectrum, filter_convolve.cpp
+
+// Any kernel, a copy the job owns. A rank-1 kernel also keeps its factors, the kernel is vertical[y] * horizontal[x].
+// Large kernels run through the FFT instead.
+typedef struct Convolve {
+	float* weights; // kernel_height rows of kernel_width, then horizontal and vertical in the same block
+	float* horizontal;
+	float* vertical;
+	uint32_t kernel_width, kernel_height;
+	uint32_t anchor_x, anchor_y; // Kernel tap over the output pixel
+	uint32_t image_width, image_height; // What the border modes map into
+	uint32_t tile_rows, tile_columns; // Output pixels per FFT tile, 0 on the other paths. The items are rectangles of whole tiles.
+	Filter_Border border;
+	bool separable;
+	Convolve_Fft* fft; // NULL unless the kernel is large enough to go through the FFT
+} Convolve;
+
+// Parameters a job carries in its context node
+typedef union Filter_Params {
+	Color_Matrix matrix;
+	Lut lut;
+	Box_Blur box_blur;
+	Gaussian_Blur gaussian_blur;
+	Edge edge;
+	Resize resize;
+	Reduce reduce;
+	Convolve convolve;
+} Filter_Params;
+
+// Kernels of one instruction set level, index 0 takes RGB and index 1 RGBA.
+// Every level writes the same bytes as the scalar kernels, output may be the same buffer as image.
+typedef struct Filter_Kernels {
+	Filter_Function invert[2];
+	Filter_Function matrix[2];		// Float math, bit-exact with the reference kernels
+	Filter_Function matrix_fixed[2];	// COLOR_MATH_FAST
+	Filter_Function lut[2];
+} Filter_Kernels;
+
+Filter_Simd_Level filter_kernels_select(Filter_Kernels* kernels, Filter_Simd_Level max_level); // Fills kernels with the widest level up to max_level the CPU supports and returns that level.
+bool color_matrix_prepare(Color_Matrix* prepared, const float matrix[20], const Filter_Kernels* kernels, Filter_Color_Math color_math); // False if the matrix is out of range.
+void lut_prepare(Lut* prepared, const uint8_t tables[][256], uint32_t channels);
+
+// Area filters, filter_blur.cpp. Their items are bands of whole rows, see halo_top and halo_bottom.
+void box_blur_work_3channel(Work_Item* work);
+void box_blur_work_4channel(Work_Item* work);
+bool box_blur_prepare(Box_Blur* prepared, uint32_t radius); // False if the radius is over 1024.
+void gaussian_blur_work_3channel(Work_Item* work);
+void gaussian_blur_work_4channel(Work_Item* work);
+bool gaussian_blur_prepare(Gaussian_Blur* prepared, float sigma); // False unless 0 < sigma <= 256.
+void edge_work_3channel(Work_Item* work);
+void edge_work_4channel(Work_Item* work);
+bool edge_prepare(Edge* prepared, Filter_Edge_Operator edge_operator, bool luma); // False for an unknown operator.
+
+// Resampling, filter_resize.cpp. Items are bands of output rows starting at row, image is the whole input.
+void resize_work_3channel(Work_Item* work);
+void resize_work_4channel(Work_Item* work);
+Resample_Cache* resample_cache_create();
+void resample_cache_destroy(Resample_Cache* cache); // Every job must be done, their axes are freed too.
+bool resize_prepare(Resize* prepared, Resample_Cache* cache, const Image* input, const Image* output, Filter_Resample filter); // False for an unknown filter. Holds both axes until resize_release.
+void resize_release(Resize* prepared);
+// Items are bands of rows of the last level, image is the whole input. Each band writes the rows of every level that
+// come from its own input rows, so a band must end on a row of the last level.
+void reduce_work_3channel(Work_Item* work);
+void reduce_work_4channel(Work_Item* work);
+bool reduce_prepare(Reduce* prepared, const Image* input, const Image* levels, uint32_t level_count, uint32_t factor); // False unless 1 <= factor <= 1024 and every level has the size and channels of the one before it reduced.
+
+// Convolution, filter_convolve.cpp. Items are bands of whole rows, or rectangles of whole tiles on the FFT path.
+// The border modes may map a pixel outside the item to any pixel of the input, which the kernels find from
+// work->row and work->column.
+void convolve_work_3channel(Work_Item* work);
+void convolve_work_4channel(Work_Item* work);
+bool convolve_prepare(Convolve* prepared, const Image* input, const float* kernel, uint32_t kernel_width, uint32_t kernel_height, Filter_Border border, uint32_t thread_count); // False for an empty kernel, a side over 255, a weight that is not finite or an unknown border. Copies the kernel, and its spectrum for the FFT with tiles for every worker, until convolve_release.
+void convolve_release(Convolve* prepared);
+
+#endif
@@ -0,0 +1,487 @@
+#include "filter_kernels.h"
+#include "platform.h" // for the cache lock
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Resampling. Resizing is separable, each output row is first filtered down the input columns into a float line
+// as wide as the input, then along that line into the output pixels. Both passes read precomputed weights, which
+// depend only on the sizes and the filter, so the engine keeps the axes of recent jobs. Reducing by an integer
+// factor averages whole blocks without any weights, and a pyramid reduces every level in one pass over the input.
+
+// Axes the cache keeps. A pipeline resizing to a handful of sizes computes its weights once.
+const uint32_t RESAMPLE_CACHE_SLOTS = 16;
+
+const double RESAMPLE_PI = 3.14159265358979323846;
+
+// Largest reduce factor. The last block of a row or column is under twice the factor on each side,
+// so its sum and the rounding reciprocal below stay in range.
+const uint32_t REDUCE_MAX_FACTOR = 1024;
+
+const uint32_t REDUCE_BLOCK_PIXELS = 64; // Pixels of the local blocks the pairwise loops write through
+
+// Same rounded division by multiply as the box blur: with reciprocal = ceil(2^56 / area) it is exact for every sum up to 255 * area
+const uint32_t REDUCE_SHIFT = 56;
+
+typedef struct Resample_Cache {
+	Platform_Mutex lock;
+	Resample_Axis* slots[RESAMPLE_CACHE_SLOTS];
+	uint64_t clock; // Ticks on every acquire, the least recently used unreferenced axis is evicted
+} Resample_Cache;
+
+static void* resize_allocate(size_t size) {
+	void* memory = malloc(size);
+	if (memory == NULL) {
+		fprintf(stderr, "Failed to allocate memory for the resize buffers\n");
+		exit(EXIT_FAILURE);
+	}
+
+	return memory;
+}
+
+// Half width of each filter at scale 1, in input pixels
+static inline double resample_support(Filter_Resample filter) {
+	switch (filter) {
+	case RESAMPLE_BILINEAR: return 1.0;
+	case RESAMPLE_BICUBIC: return 2.0;
+	case RESAMPLE_LANCZOS3: return 3.0;
+	default: return 0.5;
+	}
+}
+
+static inline double resample_sinc(double x) {
+	if (x == 0.0) return 1.0;
+	x *= RESAMPLE_PI;
+
+	return sin(x) / x;
+}
+
+static double resample_kernel(Filter_Resample filter, double x) {
+	const double a = -0.5; // Bicubic, matches the slope of a straight line through the samples
+	x = fabs(x);
+	switch (filter) {
+	case RESAMPLE_BILINEAR: return x < 1.0 ? 1.0 - x : 0.0;
+	case RESAMPLE_BICUBIC:
+		if (x < 1.0) return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+		if (x < 2.0) return ((a * x - 5.0 * a) * x + 8.0 * a) * x - 4.0 * a;
+		return 0.0;
+	case RESAMPLE_LANCZOS3: return x < 3.0 ? resample_sinc(x) * resample_sinc(x / 3.0) : 0.0;
+	default: return 0.0;
+	}
+}
+
+// Output pixel x covers the input from x * scale to (x + 1) * scale. When shrinking the filter is stretched by the
+// scale so it covers all of that, its taps are the input pixels whose centers fall inside its support.
+static Resample_Axis* resample_axis_create(uint32_t source_size, uint32_t target_size, Filter_Resample filter) {
+	double scale = (double)source_size / target_size;
+	double filter_scale = scale > 1.0 ? scale : 1.0;
+	double support = resample_support(filter) * filter_scale;
+	uint32_t window = filter == RESAMPLE_NEAREST ? 1 : (uint32_t)ceil(2.0 * support) + 1;
+	uint32_t taps = window < source_size ? window : source_size;
+	Resample_Axis* axis = (Resample_Axis*)resize_allocate(sizeof(Resample_Axis));
+	axis->source_size = source_size;
+	axis->target_size = target_size;
+	axis->filter = filter;
+	axis->taps = taps;
+	axis->first = (uint32_t*)resize_allocate((size_t)target_size * sizeof(uint32_t));
+	axis->weights = (float*)resize_allocate((size_t)target_size * taps * sizeof(float));
+	axis->references = 0;
+	axis->last_used = 0;
+	axis->cached = false;
+	double* sums = (double*)resize_allocate((size_t)taps * sizeof(double));
+	for (uint32_t x = 0; x < target_size; ++x) {
+		double center = (x + 0.5) * scale;
+		float* weights = axis->weights + (size_t)x * taps;
+		if (filter == RESAMPLE_NEAREST) {
+			uint32_t index = (uint32_t)center;
+			axis->first[x] = index < source_size ? index : source_size - 1;
+			weights[0] = 1.0f;
+			continue;
+		}
+		int64_t raw_first = (int64_t)floor(center - support + 0.5);
+		int64_t first = raw_first < 0 ? 0 : raw_first;
+		first = first > (int64_t)(source_size - taps) ? (int64_t)(source_size - taps) : first;
+		memset(sums, 0, (size_t)taps * sizeof(double));
+		double total = 0.0;
+		for (int64_t i = raw_first; i < raw_first + window; ++i) {
+			double weight = resample_kernel(filter, (i + 0.5 - center) / filter_scale);
+			int64_t index = i < 0 ? 0 : (i >= (int64_t)source_size ? source_size - 1 : i); // The edge repeats outwards
+			sums[index - first] += weight;
+			total += weight;
+		}
+		axis->first[x] = (uint32_t)first;
+		for (uint32_t k = 0; k < taps; ++k) {
+			weights[k] = (float)(sums[k] / total);
+		}
+	}
+	free(sums);
+
+	return axis;
+}
+
+static void resample_axis_free(Resample_Axis* axis) {
+	if (axis == NULL) return;
+	free(axis->first);
+	free(axis->weights);
+	free(axis);
+}
+
+// A cached axis, or a new one put in the least recently used slot nobody holds. With every slot held the axis
+// is left out of the cache and freed with its last reference.
+static Resample_Axis* resample_axis_acquire(Resample_Cache* cache, uint32_t source_size, uint32_t target_size, Filter_Resample filter) {
+	platform_mutex_lock(&cache->lock);
+	cache->clock++;
+	Resample_Axis* axis = NULL;
+	uint32_t victim = RESAMPLE_CACHE_SLOTS;
+	for (uint32_t s = 0; s < RESAMPLE_CACHE_SLOTS; ++s) {
+		Resample_Axis* slot = cache->slots[s];
+		if (slot == NULL) {
+			if (victim == RESAMPLE_CACHE_SLOTS || cache->slots[victim] != NULL) victim = s;
+			continue;
+		}
+		if (slot->source_size == source_size && slot->target_size == target_size && slot->filter == filter) {
+			axis = slot;
+			break;
+		}
+		if (slot->references > 0) continue;
+		if (victim == RESAMPLE_CACHE_SLOTS || (cache->slots[victim] != NULL && slot->last_used < cache->slots[victim]->last_used)) victim = s;
+	}
+	// Built under the lock, it takes a small fraction of the resize that asks for it
+	if (axis == NULL) {
+		axis = resample_axis_create(source_size, target_size, filter);
+		axis->cached = victim < RESAMPLE_CACHE_SLOTS;
+		if (axis->cached) {
+			resample_axis_free(cache->slots[victim]);
+			cache->slots[victim] = axis;
+		}
+	}
+	axis->references++;
+	axis->last_used = cache->clock;
+	platform_mutex_unlock(&cache->lock);
+
+	return axis;
+}
+
+static void resample_axis_release(Resample_Cache* cache, Resample_Axis* axis) {
+	platform_mutex_lock(&cache->lock);
+	axis->references--;
+	bool unused = !axis->cached && axis->references == 0;
+	platform_mutex_unlock(&cache->lock);
+	if (unused) resample_axis_free(axis);
+}
+
+// Clamps after the conversion so the loops stay free of float selects
+static inline unsigned char resample_round(float value) {
+	int rounded = (int)(value + 0.5f);
+	rounded = rounded < 0 ? 0 : rounded;
+	rounded = rounded > 255 ? 255 : rounded;
+
+	return (unsigned char)rounded;
+}
+
+// Weighted sum of taps input rows into line, a multiply-add per byte that vectorizes across the whole row
+static void resample_vertical(float* line, const unsigned char* source, size_t stride, const float* weights, uint32_t taps, size_t bytes) {
+	float weight = weights[0];
+	for (size_t i = 0; i < bytes; ++i) {
+		line[i] = weight * source[i];
+	}
+	for (uint32_t k = 1; k < taps; ++k) {
+		const unsigned char* row = source + k * stride;
+		weight = weights[k];
+		for (size_t i = 0; i < bytes; ++i) {
+			line[i] += weight * row[i];
+		}
+	}
+}
+
+// The channels of a pixel are summed side by side, with a constant channel count they fill one vector
+template <uint32_t channels>
+static void resample_horizontal(unsigned char* output, const float* line, const Resample_Axis* axis, uint32_t width) {
+	uint32_t taps = axis->taps;
+	for (uint32_t x = 0; x < width; ++x) {
+		const float* weights = axis->weights + (size_t)x * taps;
+		const float* pixel = line + (size_t)axis->first[x] * channels;
+		float sums[channels] = { 0 };
+		for (uint32_t k = 0; k < taps; ++k) {
+			for (uint32_t c = 0; c < channels; ++c) {
+				sums[c] += weights[k] * pixel[k * channels + c];
+			}
+		}
+		for (uint32_t c = 0; c < channels; ++c) {
+			output[x * channels + c] = resample_round(sums[c]);
+		}
+	}
+}
+
+template <uint32_t channels>
+static void resample_nearest(Work_Item* work, const Resize* resize) {
+	size_t source_stride = (size_t)resize->source_width * channels;
+	const uint32_t* columns = resize->horizontal->first;
+	for (uint32_t y = 0; y < work->height; ++y) {
+		const unsigned char* source = work->image + resize->vertical->first[work->row + y] * source_stride;
+		unsigned char* output = work->output + y * work->stride;
+		for (uint32_t x = 0; x < work->width; ++x) {
+			for (uint32_t c = 0; c < channels; ++c) {
+				output[x * channels + c] = source[columns[x] * channels + c];
+			}
+		}
+	}
+}
+
+template <uint32_t channels>
+static void resize_rows(Work_Item* work) {
+	const Resize* resize = (const Resize*)work->params;
+	if (resize->filter == RESAMPLE_NEAREST) {
+		resample_nearest<channels>(work, resize);
+		return;
+	}
+	const Resample_Axis* vertical = resize->vertical;
+	size_t source_stride = (size_t)resize->source_width * channels;
+	float* line = (float*)resize_allocate(source_stride * sizeof(float));
+	for (uint32_t y = 0; y < work->height; ++y) {
+		uint32_t row = work->row + y;
+		const unsigned char* source = work->image + vertical->first[row] * source_stride;
+		resample_vertical(line, source, source_stride, vertical->weights + (size_t)row * vertical->taps, vertical->taps, source_stride);
+		resample_horizontal<channels>(work->output + y * work->stride, line, resize->horizontal, work->width);
+	}
+	free(line);
+}
+
+void resize_work_3channel(Work_Item* work) {
+	resize_rows<3>(work);
+}
+
+void resize_work_4channel(Work_Item* work) {
+	resize_rows<4>(work);
+}
+
+Resample_Cache* resample_cache_create() {
+	Resample_Cache* cache = (Resample_Cache*)calloc(1, sizeof(Resample_Cache));
+	if (cache == NULL) {
+		fprintf(stderr, "Failed to allocate memory for the resample cache\n");
+		exit(EXIT_FAILURE);
+	}
+	platform_mutex_initialize(&cache->lock);
+
+	return cache;
+}
+
+void resample_cache_destroy(Resample_Cache* cache) {
+	if (cache == NULL) return;
+	for (uint32_t s = 0; s < RESAMPLE_CACHE_SLOTS; ++s) {
+		resample_axis_free(cache->slots[s]);
+	}
+	platform_mutex_destroy(&cache->lock);
+	free(cache);
+}
+
+bool resize_prepare(Resize* prepared, Resample_Cache* cache, const Image* input, const Image* output, Filter_Resample filter) {
+	switch (filter) {
+	case RESAMPLE_BILINEAR:
+	case RESAMPLE_NEAREST:
+	case RESAMPLE_BICUBIC:
+	case RESAMPLE_LANCZOS3: break;
+	default: return false;
+	}
+	prepared->horizontal = resample_axis_acquire(cache, input->width, output->width, filter);
+	prepared->vertical = resample_axis_acquire(cache, input->height, output->height, filter);
+	prepared->cache = cache;
+	prepared->source_width = input->width;
+	prepared->source_height = input->height;
+	prepared->filter = filter;
+
+	return true;
+}
+
+void resize_release(Resize* prepared) {
+	resample_axis_release(prepared->cache, prepared->horizontal);
+	resample_axis_release(prepared->cache, prepared->vertical);
+	prepared->horizontal = NULL;
+	prepared->vertical = NULL;
+}
+
+static inline uint64_t reduce_reciprocal(uint32_t area) {
+	return (((uint64_t)1 << REDUCE_SHIFT) + area - 1) / area;
+}
+
+static inline unsigned char reduce_mean(uint32_t sum, uint32_t area, uint64_t reciprocal) {
+	return (unsigned char)(((uint64_t)(sum + area / 2) * reciprocal) >> REDUCE_SHIFT);
+}
+
+// 2x2 blocks, the exact rounded mean. Averaging pairs twice would round up twice. The pairs of rows are added
+// into a 16-bit line first, and the pairs of pixels go through a local block the compiler knows aliases nothing,
+// so both loops vectorize.
+template <uint32_t channels>
+static void reduce_pairs(const unsigned char* top, const unsigned char* bottom, unsigned char* output, uint32_t count, uint16_t* line) {
+	size_t bytes = (size_t)count * 2 * channels;
+	for (size_t i = 0; i < bytes; ++i) {
+		line[i] = (uint16_t)(top[i] + bottom[i]);
+	}
+	for (uint32_t x = 0; x < count; x += REDUCE_BLOCK_PIXELS) {
+		uint32_t pixels = count - x < REDUCE_BLOCK_PIXELS ? count - x : REDUCE_BLOCK_PIXELS;
+		const uint16_t* pairs = line + (size_t)x * 2 * channels;
+		unsigned char block[REDUCE_BLOCK_PIXELS * channels];
+		for (uint32_t i = 0; i < pixels; ++i) {
+			for (uint32_t c = 0; c < channels; ++c) {
+				block[i * channels + c] = (unsigned char)((pairs[i * 2 * channels + c] + pairs[i * 2 * channels + channels + c] + 2) >> 2);
+			}
+		}
+		memcpy(output + (size_t)x * channels, block, (size_t)pixels * channels);
+	}
+}
+
+// Adds the column sums of neighbouring pixels, halving pixels sums in place. Power of two factors repeat this
+// until one sum per block is left. Each pass writes behind what it reads, through a local block so it vectorizes.
+template <uint32_t channels>
+static void reduce_halve(uint32_t* sums, uint32_t pixels) {
+	uint32_t count = pixels / 2;
+	for (uint32_t x = 0; x < count; x += REDUCE_BLOCK_PIXELS) {
+		uint32_t block_pixels = count - x < REDUCE_BLOCK_PIXELS ? count - x : REDUCE_BLOCK_PIXELS;
+		const uint32_t* pairs = sums + (size_t)x * 2 * channels;
+		uint32_t block[REDUCE_BLOCK_PIXELS * channels];
+		for (uint32_t i = 0; i < block_pixels; ++i) {
+			for (uint32_t c = 0; c < channels; ++c) {
+				block[i * channels + c] = pairs[i * 2 * channels + c] + pairs[i * 2 * channels + channels + c];
+			}
+		}
+		memcpy(sums + (size_t)x * channels, block, (size_t)block_pixels * channels * sizeof(uint32_t));
+	}
+}
+
+// One output row from rows input rows. The blocks before the last are factor wide, the last one takes the rest of the row.
+template <uint32_t channels>
+static void reduce_row(const unsigned char* source, size_t stride, uint32_t rows, uint32_t source_width, unsigned char* output, uint32_t width, uint32_t factor, uint32_t* sums) {
+	uint32_t blocks = width - 1;
+	if (factor == 2 && rows == 2) reduce_pairs<channels>(source, source + stride, output, blocks, (uint16_t*)sums);
+	else {
+		size_t bytes = (size_t)blocks * factor * channels;
+		for (size_t i = 0; i < bytes; ++i) {
+			sums[i] = source[i];
+		}
+		for (uint32_t r = 1; r < rows; ++r) {
+			const unsigned char* row = source + r * stride;
+			for (size_t i = 0; i < bytes; ++i) {
+				sums[i] += row[i];
+			}
+		}
+		uint32_t area = factor * rows;
+		uint64_t reciprocal = reduce_reciprocal(area);
+		uint32_t step = factor; // Sums per block still to add
+		if ((factor & (factor - 1)) == 0) {
+			for (; step > 1; step /= 2) {
+				reduce_halve<channels>(sums, blocks * step);
+			}
+		}
+		for (uint32_t x = 0; x < blocks; ++x) {
+			const uint32_t* block = sums + (size_t)x * step * channels;
+			for (uint32_t c = 0; c < channels; ++c) {
+				uint32_t sum = 0;
+				for (uint32_t k = 0; k < step; ++k) {
+					sum += block[k * channels + c];
+				}
+				output[x * channels + c] = reduce_mean(sum, area, reciprocal);
+			}
+		}
+	}
+	uint32_t columns = source_width - blocks * factor;
+	uint32_t area = columns * rows;
+	uint64_t reciprocal = reduce_reciprocal(area);
+	for (uint32_t c = 0; c < channels; ++c) {
+		uint32_t sum = 0;
+		for (uint32_t r = 0; r < rows; ++r) {
+			const unsigned char* pixel = source + r * stride + (size_t)blocks * factor * channels + c;
+			for (uint32_t k = 0; k < columns; ++k) {
+				sum += pixel[k * channels];
+			}
+		}
+		output[(size_t)blocks * channels + c] = reduce_mean(sum, area, reciprocal);
+	}
+}
+
+// Row y of level k, reduced from source, which is the input for level 0 and the level before otherwise
+template <uint32_t channels>
+static void reduce_level_row(const Reduce* reduce, uint32_t k, uint32_t y, const unsigned char* source, uint32_t* sums) {
+	uint32_t source_width = k == 0 ? reduce->source_width : reduce->levels[k - 1].width;
+	uint32_t source_height = k == 0 ? reduce->source_height : reduce->levels[k - 1].height;
+	const Image* level = &reduce->levels[k];
+	size_t stride = (size_t)source_width * channels;
+	uint32_t first = y * reduce->factor;
+	uint32_t rows = y == level->height - 1 ? source_height - first : reduce->factor;
+	reduce_row<channels>(source + first * stride, stride, rows, source_width, level->data + (size_t)y * level->width * channels, level->width, reduce->factor, sums);
+}
+
+// Walks the band's rows of the first level. Every row that completes a block of the next level gets that row reduced
+// right away, from rows that are still in cache, and so on down, so the input is read once for all levels.
+template <uint32_t channels>
+static void reduce_rows(Work_Item* work) {
+	const Reduce* reduce = (const Reduce*)work->params;
+	uint32_t depth = reduce->level_count;
+	uint32_t* sums = (uint32_t*)resize_allocate((size_t)reduce->source_width * channels * sizeof(uint32_t));
+	uint64_t scale = 1; // Rows of the first level per row of the last
+	for (uint32_t k = 1; k < depth; ++k) {
+		scale *= reduce->factor;
+	}
+	bool last_band = work->row + work->height == reduce->levels[depth - 1].height;
+	uint32_t first = (uint32_t)(work->row * scale);
+	uint32_t end = last_band ? reduce->levels[0].height : (uint32_t)((work->row + work->height) * scale);
+	for (uint32_t y = first; y < end; ++y) {
+		reduce_level_row<channels>(reduce, 0, y, work->image, sums);
+		uint32_t row = y;
+		for (uint32_t k = 1; k < depth; ++k) {
+			const Image* above = &reduce->levels[k - 1];
+			uint32_t height = reduce->levels[k].height;
+			if (row == above->height - 1) row = height - 1;
+			else if ((row + 1) % reduce->factor == 0 && row / reduce->factor < height - 1) row /= reduce->factor;
+			else break;
+			reduce_level_row<channels>(reduce, k, row, above->data, sums);
+		}
+	}
+	free(sums);
+}
+
+void reduce_work_3channel(Work_Item* work) {
+	reduce_rows<3>(work);
+}
+
+void reduce_work_4channel(Work_Item* work) {
+	reduce_rows<4>(work);
+}
+
+bool reduce_prepare(Reduce* prepared, const Image* input, const Image* levels, uint32_t level_count, uint32_t factor) {
+	if (factor == 0 || factor > REDUCE_MAX_FACTOR || level_count == 0 || level_count > REDUCE_MAX_LEVELS) return false;
+	const Image* above = input;
+	for (uint32_t k = 0; k < level_count; ++k) {
+		uint32_t width = above->width / factor > 0 ? above->width / factor : 1;
+		uint32_t height = above->height / factor > 0 ? above->height / factor : 1;
+		if (levels[k].width != width || levels[k].height != height || levels[k].channels != input->channels) return false;
+		prepared->levels[k] = levels[k];
+		above = &levels[k];
+	}
+	prepared->factor = factor;
+	prepared->level_count = level_count;
+	prepared->source_width = input->width;
+	prepared->source_height = input->height;
+
+	return true;
+}
+
+size_t filter_pyramid_level_count(uint32_t width, uint32_t height) {
+	size_t count = 1;
+	while (width > 1 || height > 1) {
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+		count++;
+	}
+
+	return count;
+}
+
+void filter_pyramid_level_size(uint32_t width, uint32_t height, size_t level, uint32_t* level_width, uint32_t* level_height) {
+	for (size_t k = 0; k < level; ++k) {
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+	*level_width = width;
+	*level_height = height;
+}
@@ -0,0 +1,182 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+#include <stdint.h>
+#include <stddef.h>
+
+// Thin layer over the OS threading primitives used by the filter engine.
+// Win32 uses CRITICAL_SECTION/CONDITION_VARIABLE/Interlocked*, everything else uses pthreads and GCC atomics.
+#ifdef _WIN32
+#include <windows.h>
+
+typedef HANDLE Platform_Thread;
+typedef CRITICAL_SECTION Platform_Mutex;
+typedef CONDITION_VARIABLE Platform_Condition;
+typedef DWORD Platform_Thread_Result;
+#define PLATFORM_THREAD_CALL __stdcall
+#else
+#include <pthread.h>
+
+typedef pthread_t Platform_Thread;
+typedef pthread_mutex_t Platform_Mutex;
+typedef pthread_cond_t Platform_Condition;
+typedef void* Platform_Thread_Result;
+#define PLATFORM_THREAD_CALL
+#endif
+
+typedef Platform_Thread_Result (PLATFORM_THREAD_CALL *Platform_Thread_Function)(void* params);
+
+bool platform_thread_create(Platform_Thread* thread, Platform_Thread_Function function, void* params); // Returns false if the thread could not be started.
+void platform_thread_join(Platform_Thread thread);														// Waits for the thread to exit and releases its handle.
+void platform_thread_yield();																			// Gives the rest of the time slice to another ready thread.
+size_t platform_processor_count();
+uint64_t platform_time_microseconds();																	// Monotonic clock for short intervals.
+
+// One hardware thread as the OS reports it. core, socket and node are dense indices starting at 0.
+typedef struct Platform_Processor {
+	uint32_t os_index;	// What platform_thread_pin takes
+	uint32_t core;		// SMT siblings share the core
+	uint32_t smt;		// 0 for the first hardware thread of a core, 1 for its sibling and so on
+	uint32_t socket;
+	uint32_t node;		// NUMA node
+} Platform_Processor;
+
+typedef struct Platform_Topology {
+	Platform_Processor* processors; // Processors this process may run on, in OS order
+	size_t processor_count;
+	size_t core_count;
+	size_t socket_count;
+	size_t node_count;
+	uint32_t* node_ids; // OS id of every dense node index, platform_memory_node returns these
+} Platform_Topology;
+
+void platform_topology_query(Platform_Topology* topology);												// Falls back to one node of single-threaded cores if the OS will not tell.
+void platform_topology_free(Platform_Topology* topology);
+bool platform_thread_pin(Platform_Thread thread, uint32_t os_index);									// Returns false if the OS does not support pinning.
+bool platform_memory_node(const void* address, uint32_t* node_id);									// OS id of the node holding the page, false if the OS cannot tell.
+
+// Instruction set extensions that both the CPU and the OS support, for picking SIMD kernels at runtime
+enum Platform_Cpu_Feature {
+	PLATFORM_CPU_SSE41 = 1 << 0,
+	PLATFORM_CPU_AVX2 = 1 << 1,
+	PLATFORM_CPU_AVX512 = 1 << 2,	// AVX-512 F and BW
+	PLATFORM_CPU_AVX512VBMI = 1 << 3	// Byte permutes, only set together with PLATFORM_CPU_AVX512
+};
+
+uint32_t platform_cpu_features();																		// Platform_Cpu_Feature bits, 0 on CPUs other than x86.
+
+void platform_mutex_initialize(Platform_Mutex* mutex);
+void platform_mutex_destroy(Platform_Mutex* mutex);
+void platform_mutex_lock(Platform_Mutex* mutex);
+void platform_mutex_unlock(Platform_Mutex* mutex);
+
+void platform_condition_initialize(Platform_Condition* condition);
+void platform_condition_destroy(Platform_Condition* condition);
+void platform_condition_sleep(Platform_Condition* condition, Platform_Mutex* mutex); // Mutex must be held, may wake spuriously.
+void platform_condition_wake_one(Platform_Condition* condition);
+void platform_condition_wake_all(Platform_Condition* condition);
+
+// Spin-wait hint, lets the sibling hyperthread run and saves power while a worker polls for work
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+static inline void platform_cpu_pause() {
+	_mm_pause();
+}
+#elif defined(__aarch64__) || defined(__arm__)
+static inline void platform_cpu_pause() {
+	__asm__ __volatile__("yield");
+}
+#else
+static inline void platform_cpu_pause() {
+}
+#endif
+
+// Atomics follow Interlocked* semantics: increment/decrement/add return the new value,
+// compare_exchange stores exchange if *destination == comparand and returns the previous value.
+// Everything is sequentially consistent, the engine relies on store-then-load ordering between threads.
+// On Windows every operation, loads included, is an Interlocked* call, which is a full barrier on x86, x64
+// and ARM64 alike. A plain volatile read would only be ordered on x86 and x64, and on ARM64 MSVC not at all.
+#ifdef _WIN32
+static inline uint32_t platform_atomic_load(volatile uint32_t* value) {
+	return (uint32_t)InterlockedCompareExchange((volatile LONG*)value, 0, 0);
+}
+
+static inline void platform_atomic_store(volatile uint32_t* value, uint32_t new_value) {
+	InterlockedExchange((volatile LONG*)value, (LONG)new_value);
+}
+
+static inline uint32_t platform_atomic_increment(volatile uint32_t* value) {
+	return (uint32_t)InterlockedIncrement((volatile LONG*)value);
+}
+
+static inline uint32_t platform_atomic_decrement(volatile uint32_t* value) {
+	return (uint32_t)InterlockedDecrement((volatile LONG*)value);
+}
+
+static inline uint32_t platform_atomic_add(volatile uint32_t* value, uint32_t addend) {
+	return (uint32_t)InterlockedExchangeAdd((volatile LONG*)value, (LONG)addend) + addend;
+}
+
+static inline uint32_t platform_atomic_compare_exchange(volatile uint32_t* destination, uint32_t exchange, uint32_t comparand) {
+	return (uint32_t)InterlockedCompareExchange((volatile LONG*)destination, (LONG)exchange, (LONG)comparand);
+}
+
+static inline uint64_t platform_atomic_load64(volatile uint64_t* value) {
+	return (uint64_t)InterlockedCompareExchange64((volatile LONG64*)value, 0, 0); // Also atomic on 32-bit builds
+}
+
+static inline void platform_atomic_store64(volatile uint64_t* value, uint64_t new_value) {
+	InterlockedExchange64((volatile LONG64*)value, (LONG64)new_value);
+}
+
+static inline uint64_t platform_atomic_compare_exchange64(volatile uint64_t* destination, uint64_t exchange, uint64_t comparand) {
+	return (uint64_t)InterlockedCompareExchange64((volatile LONG64*)destination, (LONG64)exchange, (LONG64)comparand);
+}
+
+static inline uint64_t platform_atomic_add64(volatile uint64_t* value, uint64_t addend) {
+	return (uint64_t)InterlockedExchangeAdd64((volatile LONG64*)value, (LONG64)addend) + addend;
+}
+#else
+static inline uint32_t platform_atomic_load(volatile uint32_t* value) {
+	return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+}
+
+static inline void platform_atomic_store(volatile uint32_t* value, uint32_t new_value) {
+	__atomic_store_n(value, new_value, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t platform_atomic_increment(volatile uint32_t* value) {
+	return __atomic_add_fetch(value, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t platform_atomic_decrement(volatile uint32_t* value) {
+	return __atomic_sub_fetch(value, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t platform_atomic_add(volatile uint32_t* value, uint32_t addend) {
+	return __atomic_add_fetch(value, addend, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t platform_atomic_compare_exchange(volatile uint32_t* destination, uint32_t exchange, uint32_t comparand) {
+	__atomic_compare_exchange_n(destination, &comparand, exchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return comparand;
+}
+
+static inline uint64_t platform_atomic_load64(volatile uint64_t* value) {
+	return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+}
+
+static inline void platform_atomic_store64(volatile uint64_t* value, uint64_t new_value) {
+	__atomic_store_n(value, new_value, __ATOMIC_SEQ_CST);
+}
+
+static inline uint64_t platform_atomic_compare_exchange64(volatile uint64_t* destination, uint64_t exchange, uint64_t comparand) {
+	__atomic_compare_exchange_n(destination, &comparand, exchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return comparand;
+}
+
+static inline uint64_t platform_atomic_add64(volatile uint64_t* value, uint64_t addend) {
+	return __atomic_add_fetch(value, addend, __ATOMIC_SEQ_CST);
+}
+#endif
+
+#endif
@@ -0,0 +1,223 @@
+#ifndef _WIN32
+#include "platform.h"
+#include <unistd.h> // for sysconf
+#include <sched.h> // for sched_yield
+#include <time.h> // for clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <dirent.h> // for the NUMA node entries in sysfs
+#ifdef __linux__
+#include <sys/syscall.h> // for get_mempolicy without linking libnuma
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h> // for __get_cpuid_count
+#endif
+
+bool platform_thread_create(Platform_Thread* thread, Platform_Thread_Function function, void* params) {
+	return pthread_create(thread, NULL, function, params) == 0;
+}
+
+void platform_thread_join(Platform_Thread thread) {
+	pthread_join(thread, NULL);
+}
+
+void platform_thread_yield() {
+	sched_yield();
+}
+
+size_t platform_processor_count() {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return count > 0 ? (size_t)count : 1;
+}
+
+uint64_t platform_time_microseconds() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+// Reads one number from a sysfs file, returns fallback if the file is missing
+static uint32_t read_sysfs_uint(const char* path, uint32_t fallback) {
+	FILE* file = fopen(path, "r");
+	if (file == NULL) return fallback;
+	unsigned int value;
+	if (fscanf(file, "%u", &value) != 1) value = fallback;
+	fclose(file);
+
+	return (uint32_t)value;
+}
+
+// Maps an OS id to a dense index in ids, appending it when it is new
+static uint32_t dense_index(uint32_t* ids, size_t* count, uint32_t id) {
+	for (size_t i = 0; i < *count; ++i) {
+		if (ids[i] == id) return (uint32_t)i;
+	}
+	ids[*count] = id;
+
+	return (uint32_t)(*count)++;
+}
+
+// Linux reads the topology from sysfs, other systems get the single node fallback
+void platform_topology_query(Platform_Topology* topology) {
+	size_t count = platform_processor_count();
+	size_t capacity = count;
+#ifdef __linux__
+	if (capacity < CPU_SETSIZE) capacity = CPU_SETSIZE;
+#endif
+	uint32_t* os_indices = (uint32_t*)calloc(capacity, sizeof(uint32_t));
+	if (os_indices == NULL) {
+		fprintf(stderr, "Failed to allocate memory for processor topology\n");
+		exit(EXIT_FAILURE);
+	}
+	for (size_t i = 0; i < count; ++i) os_indices[i] = (uint32_t)i;
+#ifdef __linux__
+	cpu_set_t allowed;
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+		count = 0;
+		for (uint32_t cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+			if (CPU_ISSET(cpu, &allowed)) os_indices[count++] = cpu;
+		}
+	}
+#endif
+	topology->processors = (Platform_Processor*)calloc(count, sizeof(Platform_Processor));
+	topology->node_ids = (uint32_t*)calloc(count, sizeof(uint32_t));
+	uint32_t* core_ids = (uint32_t*)calloc(count, sizeof(uint32_t));
+	uint32_t* socket_ids = (uint32_t*)calloc(count, sizeof(uint32_t));
+	if (topology->processors == NULL || topology->node_ids == NULL || core_ids == NULL || socket_ids == NULL) {
+		fprintf(stderr, "Failed to allocate memory for processor topology\n");
+		exit(EXIT_FAILURE);
+	}
+	topology->processor_count = count;
+	topology->core_count = 0;
+	topology->socket_count = 0;
+	topology->node_count = 0;
+	for (size_t i = 0; i < count; ++i) {
+		Platform_Processor* processor = &topology->processors[i];
+		uint32_t cpu = os_indices[i];
+		char path[128];
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/physical_package_id", cpu);
+		uint32_t socket_id = read_sysfs_uint(path, 0);
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/core_id", cpu);
+		uint32_t core_id = read_sysfs_uint(path, cpu);
+		uint32_t node_id = 0;
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u", cpu);
+		DIR* directory = opendir(path);
+		if (directory != NULL) {
+			struct dirent* entry;
+			while ((entry = readdir(directory)) != NULL) {
+				if (sscanf(entry->d_name, "node%u", &node_id) == 1) break;
+			}
+			closedir(directory);
+		}
+		processor->os_index = cpu;
+		processor->socket = dense_index(socket_ids, &topology->socket_count, socket_id);
+		processor->node = dense_index(topology->node_ids, &topology->node_count, node_id);
+		// core_id is only unique within a socket
+		processor->core = dense_index(core_ids, &topology->core_count, processor->socket << 16 | core_id);
+		processor->smt = 0;
+		for (size_t j = 0; j < i; ++j) {
+			if (topology->processors[j].core == processor->core) processor->smt++;
+		}
+	}
+	free(os_indices);
+	free(core_ids);
+	free(socket_ids);
+
+	return;
+}
+
+void platform_topology_free(Platform_Topology* topology) {
+	free(topology->processors);
+	free(topology->node_ids);
+	topology->processors = NULL;
+	topology->node_ids = NULL;
+	topology->processor_count = 0;
+	topology->node_count = 0;
+}
+
+bool platform_thread_pin(Platform_Thread thread, uint32_t os_index) {
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(os_index, &set);
+
+	return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+#else
+	return false;
+#endif
+}
+
+bool platform_memory_node(const void* address, uint32_t* node_id) {
+#ifdef __linux__
+	const unsigned long MPOL_F_NODE = 1, MPOL_F_ADDR = 2; // From numaif.h
+	int node = -1;
+	if (syscall(SYS_get_mempolicy, &node, NULL, 0, address, MPOL_F_NODE | MPOL_F_ADDR) != 0 || node < 0) return false;
+	*node_id = (uint32_t)node;
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+uint32_t platform_cpu_features() {
+	uint32_t features = 0;
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid_count(1, 0, &eax, &ebx, &ecx, &edx)) return 0;
+	if (ecx & bit_SSE4_1) features |= PLATFORM_CPU_SSE41;
+	if (!(ecx & bit_OSXSAVE)) return features;
+	// The OS has to save the YMM (and for AVX-512 the opmask and ZMM) registers on a context switch
+	unsigned int xcr0_low, xcr0_high;
+	__asm__ __volatile__("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+	unsigned int leaf7_ebx = 0, leaf7_ecx = 0;
+	if (__get_cpuid_count(7, 0, &eax, &leaf7_ebx, &leaf7_ecx, &edx) == 0) leaf7_ebx = leaf7_ecx = 0;
+	if ((xcr0_low & 0x06) == 0x06 && (leaf7_ebx & bit_AVX2)) features |= PLATFORM_CPU_AVX2;
+	if ((xcr0_low & 0xE6) == 0xE6 && (leaf7_ebx & bit_AVX512F) && (leaf7_ebx & bit_AVX512BW)) {
+		features |= PLATFORM_CPU_AVX512;
+		if (leaf7_ecx & bit_AVX512VBMI) features |= PLATFORM_CPU_AVX512VBMI;
+	}
+#endif
+
+	return features;
+}
+
+void platform_mutex_initialize(Platform_Mutex* mutex) {
+	pthread_mutex_init(mutex, NULL);
+}
+
+void platform_mutex_destroy(Platform_Mutex* mutex) {
+	pthread_mutex_destroy(mutex);
+}
+
+void platform_mutex_lock(Platform_Mutex* mutex) {
+	pthread_mutex_lock(mutex);
+}
+
+void platform_mutex_unlock(Platform_Mutex* mutex) {
+	pthread_mutex_unlock(mutex);
+}
+
+void platform_condition_initialize(Platform_Condition* condition) {
+	pthread_cond_init(condition, NULL);
+}
+
+void platform_condition_destroy(Platform_Condition* condition) {
+	pthread_cond_destroy(condition);
+}
+
+void platform_condition_sleep(Platform_Condition* condition, Platform_Mutex* mutex) {
+	pthread_cond_wait(condition, mutex);
+}
+
+void platform_condition_wake_one(Platform_Condition* condition) {
+	pthread_cond_signal(condition);
+}
+
+void platform_condition_wake_all(Platform_Condition* condition) {
+	pthread_cond_broadcast(condition);
+}
+
+#endif
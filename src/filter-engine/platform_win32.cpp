@@ -0,0 +1,209 @@
+#ifdef _WIN32
+#include "platform.h"
+#include <psapi.h> // for QueryWorkingSetEx
+#include <intrin.h> // for __cpuidex and _xgetbv
+#include <stdio.h>
+#include <stdlib.h>
+
+bool platform_thread_create(Platform_Thread* thread, Platform_Thread_Function function, void* params) {
+	*thread = CreateThread(NULL, 0, function, params, 0, NULL);
+
+	return *thread != NULL;
+}
+
+void platform_thread_join(Platform_Thread thread) {
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+}
+
+void platform_thread_yield() {
+	SwitchToThread();
+}
+
+size_t platform_processor_count() {
+	SYSTEM_INFO sys_info;
+	GetSystemInfo(&sys_info);
+
+	return sys_info.dwNumberOfProcessors;
+}
+
+uint64_t platform_time_microseconds() {
+	static LARGE_INTEGER frequency = { 0 };
+	LARGE_INTEGER counter;
+	if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+
+	return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000 + (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+}
+
+// Finds the processor with the given group and bit, processors are numbered group * 64 + bit
+static Platform_Processor* find_processor(Platform_Topology* topology, WORD group, DWORD bit) {
+	for (size_t i = 0; i < topology->processor_count; ++i) {
+		if (topology->processors[i].os_index == (uint32_t)group * 64 + bit) return &topology->processors[i];
+	}
+
+	return NULL;
+}
+
+void platform_topology_query(Platform_Topology* topology) {
+	DWORD length = 0;
+	GetLogicalProcessorInformationEx(RelationAll, NULL, &length);
+	char* buffer = (char*)malloc(length);
+	size_t count = platform_processor_count();
+	if (count < 64 * GetActiveProcessorGroupCount()) count = 64 * GetActiveProcessorGroupCount();
+	topology->processors = (Platform_Processor*)calloc(count, sizeof(Platform_Processor));
+	topology->node_ids = (uint32_t*)calloc(count, sizeof(uint32_t));
+	if (topology->processors == NULL || topology->node_ids == NULL) {
+		fprintf(stderr, "Failed to allocate memory for processor topology\n");
+		exit(EXIT_FAILURE);
+	}
+	topology->processor_count = 0;
+	topology->core_count = 0;
+	topology->socket_count = 0;
+	topology->node_count = 0;
+	if (buffer != NULL && GetLogicalProcessorInformationEx(RelationAll, (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)buffer, &length)) {
+		// Cores come first so every processor exists before packages and nodes refer to it
+		for (int pass = 0; pass < 2; ++pass) {
+			for (DWORD offset = 0; offset < length;) {
+				PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX info = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)(buffer + offset);
+				offset += info->Size;
+				if (pass == 0 && info->Relationship == RelationProcessorCore) {
+					uint32_t smt = 0;
+					for (WORD g = 0; g < info->Processor.GroupCount; ++g) {
+						for (DWORD bit = 0; bit < 64; ++bit) {
+							if ((info->Processor.GroupMask[g].Mask & ((KAFFINITY)1 << bit)) == 0) continue;
+							Platform_Processor* processor = &topology->processors[topology->processor_count++];
+							processor->os_index = (uint32_t)info->Processor.GroupMask[g].Group * 64 + bit;
+							processor->core = (uint32_t)topology->core_count;
+							processor->smt = smt++;
+						}
+					}
+					topology->core_count++;
+				}
+				else if (pass == 1 && info->Relationship == RelationProcessorPackage) {
+					for (WORD g = 0; g < info->Processor.GroupCount; ++g) {
+						for (DWORD bit = 0; bit < 64; ++bit) {
+							if ((info->Processor.GroupMask[g].Mask & ((KAFFINITY)1 << bit)) == 0) continue;
+							Platform_Processor* processor = find_processor(topology, info->Processor.GroupMask[g].Group, bit);
+							if (processor != NULL) processor->socket = (uint32_t)topology->socket_count;
+						}
+					}
+					topology->socket_count++;
+				}
+				else if (pass == 1 && info->Relationship == RelationNumaNode) {
+					for (DWORD bit = 0; bit < 64; ++bit) {
+						if ((info->NumaNode.GroupMask.Mask & ((KAFFINITY)1 << bit)) == 0) continue;
+						Platform_Processor* processor = find_processor(topology, info->NumaNode.GroupMask.Group, bit);
+						if (processor != NULL) processor->node = (uint32_t)topology->node_count;
+					}
+					topology->node_ids[topology->node_count++] = info->NumaNode.NodeNumber;
+				}
+			}
+		}
+	}
+	free(buffer);
+	if (topology->processor_count == 0) {
+		topology->processor_count = platform_processor_count();
+		for (size_t i = 0; i < topology->processor_count; ++i) {
+			topology->processors[i].os_index = (uint32_t)i;
+			topology->processors[i].core = (uint32_t)i;
+		}
+		topology->core_count = topology->processor_count;
+	}
+	if (topology->socket_count == 0) topology->socket_count = 1;
+	if (topology->node_count == 0) topology->node_count = 1;
+
+	return;
+}
+
+void platform_topology_free(Platform_Topology* topology) {
+	free(topology->processors);
+	free(topology->node_ids);
+	topology->processors = NULL;
+	topology->node_ids = NULL;
+	topology->processor_count = 0;
+	topology->node_count = 0;
+}
+
+bool platform_thread_pin(Platform_Thread thread, uint32_t os_index) {
+	GROUP_AFFINITY affinity = { 0 };
+	affinity.Group = (WORD)(os_index / 64);
+	affinity.Mask = (KAFFINITY)1 << (os_index % 64);
+
+	return SetThreadGroupAffinity(thread, &affinity, NULL) != 0;
+}
+
+bool platform_memory_node(const void* address, uint32_t* node_id) {
+	PSAPI_WORKING_SET_EX_INFORMATION info = { 0 };
+	info.VirtualAddress = (PVOID)address;
+	if (!QueryWorkingSetEx(GetCurrentProcess(), &info, sizeof(info)) || !info.VirtualAttributes.Valid) return false;
+	*node_id = (uint32_t)info.VirtualAttributes.Node;
+
+	return true;
+}
+
+uint32_t platform_cpu_features() {
+	uint32_t features = 0;
+#if defined(_M_X64) || defined(_M_IX86)
+	int regs[4]; // eax, ebx, ecx, edx
+	__cpuidex(regs, 0, 0);
+	int max_leaf = regs[0];
+	__cpuidex(regs, 1, 0);
+	if (regs[2] & (1 << 19)) features |= PLATFORM_CPU_SSE41;
+	if (!(regs[2] & (1 << 27))) return features; // OSXSAVE
+	// The OS has to save the YMM (and for AVX-512 the opmask and ZMM) registers on a context switch
+	unsigned long long xcr0 = _xgetbv(0);
+	int leaf7_ebx = 0, leaf7_ecx = 0;
+	if (max_leaf >= 7) {
+		__cpuidex(regs, 7, 0);
+		leaf7_ebx = regs[1];
+		leaf7_ecx = regs[2];
+	}
+	if ((xcr0 & 0x06) == 0x06 && (leaf7_ebx & (1 << 5))) features |= PLATFORM_CPU_AVX2;
+	if ((xcr0 & 0xE6) == 0xE6 && (leaf7_ebx & (1 << 16)) && (leaf7_ebx & (1 << 30))) {
+		features |= PLATFORM_CPU_AVX512;
+		if (leaf7_ecx & (1 << 1)) features |= PLATFORM_CPU_AVX512VBMI;
+	}
+#endif
+
+	return features;
+}
+
+void platform_mutex_initialize(Platform_Mutex* mutex) {
+	InitializeCriticalSection(mutex);
+}
+
+void platform_mutex_destroy(Platform_Mutex* mutex) {
+	DeleteCriticalSection(mutex);
+}
+
+void platform_mutex_lock(Platform_Mutex* mutex) {
+	EnterCriticalSection(mutex);
+}
+
+void platform_mutex_unlock(Platform_Mutex* mutex) {
+	LeaveCriticalSection(mutex);
+}
+
+void platform_condition_initialize(Platform_Condition* condition) {
+	InitializeConditionVariable(condition);
+}
+
+// Win32 condition variables own no resources
+void platform_condition_destroy(Platform_Condition* condition) {
+	(void)condition;
+}
+
+void platform_condition_sleep(Platform_Condition* condition, Platform_Mutex* mutex) {
+	SleepConditionVariableCS(condition, mutex, INFINITE);
+}
+
+void platform_condition_wake_one(Platform_Condition* condition) {
+	WakeConditionVariable(condition);
+}
+
+void platform_condition_wake_all(Platform_Condition* condition) {
+	WakeAllConditionVariable(condition);
+}
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "filter.h"
+
+// C++ specific libraries
+#include <chrono> // For high-resolution timing
+#include <vector>
+
+// Fixture shared by the benches: engines, deterministic input and the helpers of the naive references.
+
+typedef std::chrono::steady_clock Clock;
+
+const size_t CHECK_THREADS = 4;
+
+static inline Filter_Engine bench_engine_create(size_t thread_count, size_t min_chunk_bytes) {
+	Filter_Engine engine = filter_engine_create();
+	Filter_Engine_Options options = { 0 };
+	options.thread_count = thread_count;
+	options.min_chunk_bytes = min_chunk_bytes;
+	filter_engine_initialize_with_options(engine, &options);
+
+	return engine;
+}
+
+// The check engine cuts even the small check frames into several items, so halos and items starting mid image are covered too
+static inline Filter_Engine bench_check_engine_create() {
+	return bench_engine_create(CHECK_THREADS, 1024);
+}
+
+// Xorshift, the same bytes on every run and every platform
+static inline void fill_random(std::vector<unsigned char>& data) {
+	uint32_t state = 2463534242u;
+	for (size_t i = 0; i < data.size(); ++i) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		data[i] = (unsigned char)state;
+	}
+}
+
+// Touch the pages before timing, so the first pass does not pay for the page faults
+static inline void touch_pages(std::vector<unsigned char>& data) {
+	memset(data.data(), 0, data.size());
+}
+
+static inline int64_t clamp_index(int64_t value, int64_t size) {
+	return value < 0 ? 0 : (value >= size ? size - 1 : value);
+}
+
+#endif
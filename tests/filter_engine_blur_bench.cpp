@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "bench_common.h"
+
+// 24 MP frame, 72 MiB as RGB
+const uint32_t BENCH_WIDTH = 6000;
+const uint32_t BENCH_HEIGHT = 4000;
+const int BENCH_REPEATS = 3;
+
+const uint32_t RADII[] = { 1, 2, 3, 5, 8, 12, 20, 30, 50, 75, 100 };
+const int RADIUS_COUNT = sizeof(RADII) / sizeof(RADII[0]);
+
+// Both sides of the switch from the FIR to the recursive filter at sigma 4, up to the limit
+const float SIGMAS[] = { 0.5f, 1.0f, 2.0f, 3.0f, 3.9f, 4.0f, 6.0f, 10.0f, 25.0f, 60.0f, 256.0f };
+const int SIGMA_COUNT = sizeof(SIGMAS) / sizeof(SIGMAS[0]);
+
+// Largest difference from the exact Gaussian, the FIR only rounds twice, the recursive filter approximates the shape
+const int GAUSSIAN_FIR_TOLERANCE = 1;
+const int GAUSSIAN_IIR_TOLERANCE = 3;
+const float GAUSSIAN_IIR_MIN_SIGMA = 4.0f; // Where filter_blur.cpp switches to the recursive filter
+
+// Small frame for the correctness check against a brute force box sum. Odd sizes so the bands split unevenly,
+// and narrower than the largest boxes so those repeat the edges on both sides.
+const uint32_t CHECK_WIDTH = 97;
+const uint32_t CHECK_HEIGHT = 61;
+
+// Every pixel sums its whole box, the edges repeat outwards like the engine's
+static void box_blur_reference(const unsigned char* image, unsigned char* output, int64_t width, int64_t height, int64_t channels, int64_t radius) {
+	int64_t area = (2 * radius + 1) * (2 * radius + 1);
+	for (int64_t y = 0; y < height; ++y) {
+		for (int64_t x = 0; x < width; ++x) {
+			for (int64_t c = 0; c < channels; ++c) {
+				int64_t sum = 0;
+				for (int64_t dy = -radius; dy <= radius; ++dy) {
+					for (int64_t dx = -radius; dx <= radius; ++dx) {
+						sum += image[(clamp_index(y + dy, height) * width + clamp_index(x + dx, width)) * channels + c];
+					}
+				}
+				output[(y * width + x) * channels + c] = (unsigned char)((sum + area / 2) / area);
+			}
+		}
+	}
+}
+
+// Both passes in double with the sampled Gaussian out to 6 sigma, rounded once at the end
+static void gaussian_blur_reference(const unsigned char* image, unsigned char* output, int64_t width, int64_t height, int64_t channels, double sigma) {
+	int64_t radius = (int64_t)ceil(6.0 * sigma);
+	std::vector<double> weights(radius + 1), columns(width * height * channels);
+	double total = 0.0;
+	for (int64_t k = 0; k <= radius; ++k) {
+		weights[k] = exp(-0.5 * (double)(k * k) / (sigma * sigma));
+		total += k == 0 ? weights[k] : 2.0 * weights[k];
+	}
+	for (int64_t y = 0; y < height; ++y) {
+		for (int64_t i = 0; i < width * channels; ++i) {
+			double sum = 0.0;
+			for (int64_t k = -radius; k <= radius; ++k) {
+				sum += weights[k < 0 ? -k : k] * image[clamp_index(y + k, height) * width * channels + i];
+			}
+			columns[y * width * channels + i] = sum / total;
+		}
+	}
+	for (int64_t y = 0; y < height; ++y) {
+		for (int64_t x = 0; x < width; ++x) {
+			for (int64_t c = 0; c < channels; ++c) {
+				double sum = 0.0;
+				for (int64_t k = -radius; k <= radius; ++k) {
+					sum += weights[k < 0 ? -k : k] * columns[(y * width + clamp_index(x + k, width)) * channels + c];
+				}
+				sum /= total;
+				output[(y * width + x) * channels + c] = (unsigned char)(sum >= 255.0 ? 255 : floor(sum + 0.5));
+			}
+		}
+	}
+}
+
+// Checks the engine against the reference, separate output and in place. Returns the number of bytes that differ.
+static size_t check_radius(Filter_Engine engine, uint32_t channels, uint32_t radius) {
+	size_t size = (size_t)CHECK_WIDTH * CHECK_HEIGHT * channels;
+	std::vector<unsigned char> input_data(size), expected_data(size), output_data(size);
+	fill_random(input_data);
+	box_blur_reference(input_data.data(), expected_data.data(), CHECK_WIDTH, CHECK_HEIGHT, channels, radius);
+	Image input = { input_data.data(), CHECK_WIDTH, CHECK_HEIGHT, channels };
+	Image output = { output_data.data(), CHECK_WIDTH, CHECK_HEIGHT, channels };
+	filter_engine_submit_box_blur(engine, &input, &output, radius, PRIORITY_INTERACTIVE);
+	filter_engine_wait(engine);
+	filter_engine_submit_box_blur(engine, &input, &input, radius, PRIORITY_INTERACTIVE);
+	filter_engine_wait(engine);
+	size_t mismatches = 0;
+	for (size_t i = 0; i < size; ++i) {
+		if (output_data[i] != expected_data[i]) mismatches++;
+		if (input_data[i] != expected_data[i]) mismatches++;
+	}
+
+	return mismatches;
+}
+
+// Same for the Gaussian, returns the number of bytes further from the reference than the tolerance of the path sigma picks
+static size_t check_sigma(Filter_Engine engine, uint32_t channels, float sigma) {
+	size_t size = (size_t)CHECK_WIDTH * CHECK_HEIGHT * channels;
+	std::vector<unsigned char> input_data(size), expected_data(size), output_data(size);
+	fill_random(input_data);
+	gaussian_blur_reference(input_data.data(), expected_data.data(), CHECK_WIDTH, CHECK_HEIGHT, channels, sigma);
+	Image input = { input_data.data(), CHECK_WIDTH, CHECK_HEIGHT, channels };
+	Image output = { output_data.data(), CHECK_WIDTH, CHECK_HEIGHT, channels };
+	filter_engine_submit_gaussian_blur(engine, &input, &output, sigma, PRIORITY_INTERACTIVE);
+	filter_engine_wait(engine);
+	filter_engine_submit_gaussian_blur(engine, &input, &input, sigma, PRIORITY_INTERACTIVE);
+	filter_engine_wait(engine);
+	int tolerance = sigma >= GAUSSIAN_IIR_MIN_SIGMA ? GAUSSIAN_IIR_TOLERANCE : GAUSSIAN_FIR_TOLERANCE;
+	size_t mismatches = 0;
+	for (size_t i = 0; i < size; ++i) {
+		if (abs((int)output_data[i] - (int)expected_data[i]) > tolerance) mismatches++;
+		if (abs((int)input_data[i] - (int)expected_data[i]) > tolerance) mismatches++;
+	}
+
+	return mismatches;
+}
+
+// Best of repeats blurs of the frame, in milliseconds. A sigma above 0 runs the Gaussian, otherwise the box of radius.
+static double blur_bench(Filter_Engine engine, Image* input, Image* output, uint32_t radius, float sigma) {
+	double best_ms = 1e30;
+	for (int r = 0; r < BENCH_REPEATS; ++r) {
+		Clock::time_point start_time = Clock::now();
+		if (sigma > 0.0f) filter_engine_submit_gaussian_blur(engine, input, output, sigma, PRIORITY_INTERACTIVE);
+		else filter_engine_submit_box_blur(engine, input, output, radius, PRIORITY_INTERACTIVE);
+		filter_engine_wait(engine);
+		double elapsed_ms = std::chrono::duration<double, std::milli>(Clock::now() - start_time).count();
+		if (elapsed_ms < best_ms) best_ms = elapsed_ms;
+	}
+
+	return best_ms;
+}
+
+// Times the box blur over a range of radii on one worker and on every processor. The running sums keep
+// the time per pixel flat, a naive box would grow with the square of the radius.
+// Then the Gaussian over a range of sigmas, the FIR grows with sigma until the recursive filter takes over at a flat cost.
+// Fails if any radius differs from the brute force reference, or any sigma is further from the exact Gaussian than its tolerance.
+// With --check only the comparisons run, so ctest can run them without the timing.
+int main(int argc, char** argv) {
+	bool check_only = argc > 1 && strcmp(argv[1], "--check") == 0;
+	Filter_Engine check_engine = bench_check_engine_create();
+	Filter_Engine engines[2] = { bench_engine_create(1, DEFAULT), bench_engine_create(DEFAULT, DEFAULT) };
+	bool passed = true;
+	for (uint32_t channels = 3; channels <= 4; ++channels) {
+		for (int i = 0; i < RADIUS_COUNT; ++i) {
+			size_t mismatches = check_radius(check_engine, channels, RADII[i]);
+			if (mismatches != 0) {
+				printf("Radius %u, %u channels differs from the reference in %zu bytes\n", RADII[i], channels, mismatches);
+				passed = false;
+			}
+		}
+		for (int i = 0; i < SIGMA_COUNT; ++i) {
+			size_t mismatches = check_sigma(check_engine, channels, SIGMAS[i]);
+			if (mismatches != 0) {
+				printf("Sigma %.1f, %u channels is off the reference by more than the tolerance in %zu bytes\n", SIGMAS[i], channels, mismatches);
+				passed = false;
+			}
+		}
+	}
+
+	if (check_only) {
+		filter_engine_destroy(check_engine);
+		filter_engine_destroy(engines[0]);
+		filter_engine_destroy(engines[1]);
+
+		return passed ? 0 : 1;
+	}
+
+	for (uint32_t channels = 3; channels <= 4; ++channels) {
+		size_t size = (size_t)BENCH_WIDTH * BENCH_HEIGHT * channels;
+		std::vector<unsigned char> input_data(size), output_data(size);
+		fill_random(input_data);
+		touch_pages(output_data);
+		Image input = { input_data.data(), BENCH_WIDTH, BENCH_HEIGHT, channels };
+		Image output = { output_data.data(), BENCH_WIDTH, BENCH_HEIGHT, channels };
+
+		printf("\n-- Box blur (%ux%u, %u channels) --\n", BENCH_WIDTH, BENCH_HEIGHT, channels);
+		printf("%8s %12s %10s %12s %10s\n", "radius", "1 thread ms", "MP/s", "all ms", "MP/s");
+		for (int i = 0; i < RADIUS_COUNT; ++i) {
+			double single_ms = blur_bench(engines[0], &input, &output, RADII[i], 0.0f);
+			double all_ms = blur_bench(engines[1], &input, &output, RADII[i], 0.0f);
+			double megapixels = (double)BENCH_WIDTH * BENCH_HEIGHT / 1e6;
+			printf("%8u %12.1f %10.1f %12.1f %10.1f\n", RADII[i], single_ms, megapixels / single_ms * 1e3, all_ms, megapixels / all_ms * 1e3);
+		}
+
+		printf("\n-- Gaussian blur (%ux%u, %u channels) --\n", BENCH_WIDTH, BENCH_HEIGHT, channels);
+		printf("%8s %5s %12s %10s %12s %10s\n", "sigma", "path", "1 thread ms", "MP/s", "all ms", "MP/s");
+		for (int i = 0; i < SIGMA_COUNT; ++i) {
+			double single_ms = blur_bench(engines[0], &input, &output, 0, SIGMAS[i]);
+			double all_ms = blur_bench(engines[1], &input, &output, 0, SIGMAS[i]);
+			double megapixels = (double)BENCH_WIDTH * BENCH_HEIGHT / 1e6;
+			const char* path = SIGMAS[i] >= GAUSSIAN_IIR_MIN_SIGMA ? "IIR" : "FIR";
+			printf("%8.1f %5s %12.1f %10.1f %12.1f %10.1f\n", SIGMAS[i], path, single_ms, megapixels / single_ms * 1e3, all_ms, megapixels / all_ms * 1e3);
+		}
+	}
+	filter_engine_destroy(check_engine);
+	filter_engine_destroy(engines[0]);
+	filter_engine_destroy(engines[1]);
+
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "bench_common.h"
+
+// 24 MP frame, 72 MiB as RGB
+const uint32_t BENCH_WIDTH = 6000;
+const uint32_t BENCH_HEIGHT = 4000;
+const int BENCH_REPEATS = 3;
+
+// Small frame for large kernels, a few FFT tiles
+const uint32_t SMALL_WIDTH = 1000;
+const uint32_t SMALL_HEIGHT = 1000;
+
+// Small frame for the correctness check, odd sizes so the bands split unevenly
+const uint32_t CHECK_WIDTH = 97;
+const uint32_t CHECK_HEIGHT = 61;
+
+// The engine sums in float, the double reference may round the other way where a sum lands on .5
+const int CHECK_TOLERANCE = 1;
+
+const char* BORDER_NAMES[] = { "clamp", "mirror", "wrap", "constant" };
+
+typedef struct Check_Kernel {
+	const char* name;
+	uint32_t width, height;
+	std::vector<float> weights;
+} Check_Kernel;
+
+// Weights in -1..1 that add up to 1, so the output keeps the brightness and a rank-1 kernel is unlikely
+static std::vector<float> random_kernel(uint32_t width, uint32_t height, uint32_t seed) {
+	std::vector<float> weights((size_t)width * height);
+	uint32_t state = seed;
+	double sum = 0.0;
+	for (size_t i = 0; i < weights.size(); ++i) {
+		state = state * 1664525u + 1013904223u;
+		weights[i] = (float)(state >> 8) / (float)(1 << 23) - 1.0f;
+		sum += weights[i];
+	}
+	weights[weights.size() / 2] += (float)(1.0 - sum);
+
+	return weights;
+}
+
+// Flat disc, the lens blur kernel. Its corners are zero, so it is never rank-1.
+static std::vector<float> disc_kernel(uint32_t size) {
+	std::vector<float> weights((size_t)size * size);
+	float radius = size / 2.0f, sum = 0.0f;
+	for (uint32_t y = 0; y < size; ++y) {
+		for (uint32_t x = 0; x < size; ++x) {
+			float dx = x + 0.5f - radius, dy = y + 0.5f - radius;
+			weights[(size_t)y * size + x] = dx * dx + dy * dy <= radius * radius ? 1.0f : 0.0f;
+			sum += weights[(size_t)y * size + x];
+		}
+	}
+	for (size_t i = 0; i < weights.size(); ++i) {
+		weights[i] /= sum;
+	}
+
+	return weights;
+}
+
+// Outer product of two sampled Gaussians, exactly rank-1
+static std::vector<float> gaussian_kernel(uint32_t size, float sigma) {
+	std::vector<float> line(size), weights((size_t)size * size);
+	float sum = 0.0f;
+	for (uint32_t i = 0; i < size; ++i) {
+		float x = (float)i - (float)(size / 2);
+		line[i] = expf(-x * x / (2.0f * sigma * sigma));
+		sum += line[i];
+	}
+	for (uint32_t y = 0; y < size; ++y) {
+		for (uint32_t x = 0; x < size; ++x) {
+			weights[(size_t)y * size + x] = line[y] * line[x] / (sum * sum);
+		}
+	}
+
+	return weights;
+}
+
+static std::vector<Check_Kernel> check_kernels() {
+	std::vector<Check_Kernel> kernels;
+	kernels.push_back({ "identity 1x1", 1, 1, { 1.0f } });
+	kernels.push_back({ "sharpen 3x3", 3, 3, { 0, -1, 0, -1, 5, -1, 0, -1, 0 } });
+	kernels.push_back({ "emboss 3x3", 3, 3, { -2, -1, 0, -1, 1, 1, 0, 1, 2 } });
+	kernels.push_back({ "motion 9x1", 9, 1, std::vector<float>(9, 1.0f / 9.0f) });
+	kernels.push_back({ "gaussian 7x7", 7, 7, gaussian_kernel(7, 1.5f) });
+	kernels.push_back({ "random 5x5", 5, 5, random_kernel(5, 5, 7) });
+	kernels.push_back({ "random 4x6", 4, 6, random_kernel(4, 6, 11) });
+	// Wider and taller than the check frame, so mirror and wrap go round the image more than once
+	kernels.push_back({ "random 211x3", 211, 3, random_kernel(211, 3, 13) });
+	kernels.push_back({ "random 5x151", 5, 151, random_kernel(5, 151, 17) });
+	kernels.push_back({ "gaussian 75x75", 75, 75, gaussian_kernel(75, 12.0f) });
+	// Large enough for the FFT
+	kernels.push_back({ "disc 45x45", 45, 45, disc_kernel(45) });
+	kernels.push_back({ "disc 151x151", 151, 151, disc_kernel(151) });
+	kernels.push_back({ "gaussian 131x131", 131, 131, gaussian_kernel(131, 20.0f) });
+
+	return kernels;
+}
+
+static int64_t border_index(int64_t index, int64_t size, int border) {
+	if (index >= 0 && index < size) return index;
+	switch (border) {
+	case BORDER_MIRROR:
+		if (size == 1) return 0;
+		while (index < 0 || index >= size) index = index < 0 ? -index : 2 * (size - 1) - index;
+		return index;
+	case BORDER_WRAP: return ((index % size) + size) % size;
+	case BORDER_CONSTANT: return -1;
+	default: return index < 0 ? 0 : size - 1;
+	}
+}
+
+// The naive way, and the reference: every tap of every pixel in double, alpha copied
+static void convolve_naive(const unsigned char* image, unsigned char* output, int64_t width, int64_t height, int64_t channels, const Check_Kernel& kernel, int border) {
+	int64_t anchor_x = kernel.width / 2, anchor_y = kernel.height / 2;
+	for (int64_t y = 0; y < height; ++y) {
+		for (int64_t x = 0; x < width; ++x) {
+			for (int64_t c = 0; c < channels; ++c) {
+				if (c == 3) {
+					output[(y * width + x) * channels + c] = image[(y * width + x) * channels + c];
+					continue;
+				}
+				double sum = 0.0;
+				for (int64_t ky = 0; ky < kernel.height; ++ky) {
+					int64_t row = border_index(y + ky - anchor_y, height, border);
+					if (row < 0) continue;
+					for (int64_t kx = 0; kx < kernel.width; ++kx) {
+						int64_t column = border_index(x + kx - anchor_x, width, border);
+						if (column < 0) continue;
+						sum += kernel.weights[ky * kernel.width + kx] * image[(row * width + column) * channels + c];
+					}
+				}
+				double rounded = floor(sum + 0.5);
+				output[(y * width + x) * channels + c] = (unsigned char)(rounded < 0.0 ? 0.0 : (rounded > 255.0 ? 255.0 : rounded));
+			}
+		}
+	}
+}
+
+// Checks the engine against the naive sums, separate output and in place. Returns the number of bytes more than the tolerance off.
+static size_t check_convolve(Filter_Engine engine, uint32_t channels, const Check_Kernel& kernel, int border) {
+	size_t size = (size_t)CHECK_WIDTH * CHECK_HEIGHT * channels;
+	std::vector<unsigned char> input_data(size), expected_data(size), output_data(size);
+	fill_random(input_data);
+	convolve_naive(input_data.data(), expected_data.data(), CHECK_WIDTH, CHECK_HEIGHT, channels, kernel, border);
+	Image input = { input_data.data(), CHECK_WIDTH, CHECK_HEIGHT, channels };
+	Image output = { output_data.data(), CHECK_WIDTH, CHECK_HEIGHT, channels };
+	filter_engine_submit_convolve(engine, &input, &output, kernel.weights.data(), kernel.width, kernel.height, (Filter_Border)border, PRIORITY_INTERACTIVE);
+	filter_engine_wait(engine);
+	filter_engine_submit_convolve(engine, &input, &input, kernel.weights.data(), kernel.width, kernel.height, (Filter_Border)border, PRIORITY_INTERACTIVE);
+	filter_engine_wait(engine);
+	size_t mismatches = 0;
+	for (size_t i = 0; i < size; ++i) {
+		if (abs(output_data[i] - expected_data[i]) > CHECK_TOLERANCE) mismatches++;
+		if (abs(input_data[i] - expected_data[i]) > CHECK_TOLERANCE) mismatches++;
+	}
+
+	return mismatches;
+}
+
+// Best of repeats convolutions of the frame, in milliseconds
+static double convolve_bench(Filter_Engine engine, Image* input, Image* output, const std::vector<float>& kernel, uint32_t size) {
+	double best_ms = 1e30;
+	for (int r = 0; r < BENCH_REPEATS; ++r) {
+		Clock::time_point start_time = Clock::now();
+		filter_engine_submit_convolve(engine, input, output, kernel.data(), size, size, BORDER_CLAMP, PRIORITY_INTERACTIVE);
+		filter_engine_wait(engine);
+		double elapsed_ms = std::chrono::duration<double, std::milli>(Clock::now() - start_time).count();
+		if (elapsed_ms < best_ms) best_ms = elapsed_ms;
+	}
+
+	return best_ms;
+}
+
+// Both shapes of every size on one frame, one worker against all of them
+static void bench_frame(Filter_Engine engines[2], uint32_t width, uint32_t height, const uint32_t* sizes, size_t count) {
+	size_t size = (size_t)width * height * 3;
+	std::vector<unsigned char> input_data(size), output_data(size);
+	fill_random(input_data);
+	touch_pages(output_data);
+	Image input = { input_data.data(), width, height, 3 };
+	Image output = { output_data.data(), width, height, 3 };
+	double megapixels = (double)width * height / 1e6;
+
+	printf("\n-- Convolve (%ux%u, 3 channels) --\n", width, height);
+	printf("%8s %9s %12s %8s %10s %8s %8s\n", "kernel", "shape", "1 thread ms", "MP/s", "all ms", "MP/s", "speedup");
+	for (size_t s = 0; s < count; ++s) {
+		for (int shape = 0; shape < 2; ++shape) {
+			std::vector<float> kernel = shape == 0 ? gaussian_kernel(sizes[s], sizes[s] / 6.0f) : disc_kernel(sizes[s]);
+			double single_ms = convolve_bench(engines[0], &input, &output, kernel, sizes[s]);
+			double all_ms = convolve_bench(engines[1], &input, &output, kernel, sizes[s]);
+			printf("%3ux%-4u %9s %12.1f %8.1f %10.1f %8.1f %7.2fx\n", sizes[s], sizes[s], shape == 0 ? "gaussian" : "disc",
+				single_ms, megapixels / single_ms * 1e3, all_ms, megapixels / all_ms * 1e3, single_ms / all_ms);
+		}
+	}
+}
+
+// Times square Gaussians, which are rank-1, and flat discs, which are not, from 3x3 to 255x255 on one worker and on
+// every processor. Below the FFT crossover the Gaussians run as two 1D passes and the discs as a direct 2D sum.
+// Then large kernels on a small image, where the speedup shows whether the FFT tiles still use the whole pool.
+// Fails if the engine is more than one off the naive sums in any byte, for any kernel and border.
+// With --check only the comparisons run, so ctest can run them without the timing.
+int main(int argc, char** argv) {
+	bool check_only = argc > 1 && strcmp(argv[1], "--check") == 0;
+	// Its four workers also split the large check kernels into FFT tiles, so the tile edges are covered too
+	Filter_Engine check_engine = bench_check_engine_create();
+	Filter_Engine engines[2] = { bench_engine_create(1, DEFAULT), bench_engine_create(DEFAULT, DEFAULT) };
+	bool passed = true;
+	std::vector<Check_Kernel> kernels = check_kernels();
+	for (uint32_t channels = 3; channels <= 4; ++channels) {
+		for (size_t k = 0; k < kernels.size(); ++k) {
+			for (int border = BORDER_CLAMP; border <= BORDER_CONSTANT; ++border) {
+				size_t mismatches = check_convolve(check_engine, channels, kernels[k], border);
+				if (mismatches != 0) {
+					printf("%s, %s border, %u channels differs from the naive sums in %zu bytes\n", kernels[k].name, BORDER_NAMES[border], channels, mismatches);
+					passed = false;
+				}
+			}
+		}
+	}
+
+	if (check_only) {
+		filter_engine_destroy(check_engine);
+		filter_engine_destroy(engines[0]);
+		filter_engine_destroy(engines[1]);
+
+		return passed ? 0 : 1;
+	}
+
+	const uint32_t frame_sizes[] = { 3, 7, 15, 31, 63, 127, 255 };
+	bench_frame(engines, BENCH_WIDTH, BENCH_HEIGHT, frame_sizes, sizeof(frame_sizes) / sizeof(frame_sizes[0]));
+	// A large kernel on a small image is only a few tiles, they must still spread over the workers
+	const uint32_t small_sizes[] = { 101, 151 };
+	bench_frame(engines, SMALL_WIDTH, SMALL_HEIGHT, small_sizes, sizeof(small_sizes) / sizeof(small_sizes[0]));
+	filter_engine_destroy(check_engine);
+	filter_engine_destroy(engines[0]);
+	filter_engine_destroy(engines[1]);
+
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "bench_common.h"
+
+// 24 MP frame, 72 MiB as RGB
+const uint32_t BENCH_WIDTH = 6000;
+const uint32_t BENCH_HEIGHT = 4000;
+const int BENCH_REPEATS = 3;
+
+// Small frame for the correctness check, odd sizes so the bands split unevenly
+const uint32_t CHECK_WIDTH = 97;
+const uint32_t CHECK_HEIGHT = 61;
+
+const char* OPERATOR_NAMES[] = { "Sobel", "Scharr" };
+const int OPERATOR_WEIGHTS[][2] = { { 1, 2 }, { 3, 10 } }; // Outer and center weight across the gradient
+const float OPERATOR_SCALES[] = { 1.0f, 0.25f };
+
+// The naive way, and the reference the engine must match byte for byte: a luma plane first when asked for,
+// then whole Gx and Gy images from all nine taps of every pixel, then a second pass for the magnitude.
+static void edge_naive(const unsigned char* image, unsigned char* output, int64_t width, int64_t height, int64_t channels, int edge_operator, bool luma) {
+	int64_t planes = luma ? 1 : channels;
+	std::vector<unsigned char> gray;
+	const unsigned char* source = image;
+	if (luma) {
+		gray.resize(width * height);
+		for (int64_t i = 0; i < width * height; ++i) {
+			const unsigned char* pixel = image + i * channels;
+			gray[i] = (unsigned char)((77 * pixel[0] + 150 * pixel[1] + 29 * pixel[2] + 128) >> 8);
+		}
+		source = gray.data();
+	}
+	int outer = OPERATOR_WEIGHTS[edge_operator][0], center = OPERATOR_WEIGHTS[edge_operator][1];
+	int kernel_x[3][3] = { { -outer, 0, outer }, { -center, 0, center }, { -outer, 0, outer } };
+	int kernel_y[3][3] = { { -outer, -center, -outer }, { 0, 0, 0 }, { outer, center, outer } };
+	std::vector<int16_t> gx(width * height * planes), gy(width * height * planes);
+	for (int64_t y = 0; y < height; ++y) {
+		for (int64_t x = 0; x < width; ++x) {
+			for (int64_t p = 0; p < planes; ++p) {
+				int sum_x = 0, sum_y = 0;
+				for (int64_t dy = -1; dy <= 1; ++dy) {
+					for (int64_t dx = -1; dx <= 1; ++dx) {
+						int value = source[(clamp_index(y + dy, height) * width + clamp_index(x + dx, width)) * planes + p];
+						sum_x += kernel_x[dy + 1][dx + 1] * value;
+						sum_y += kernel_y[dy + 1][dx + 1] * value;
+					}
+				}
+				gx[(y * width + x) * planes + p] = (int16_t)sum_x;
+				gy[(y * width + x) * planes + p] = (int16_t)sum_y;
+			}
+		}
+	}
+	for (int64_t i = 0; i < width * height; ++i) {
+		for (int64_t c = 0; c < channels; ++c) {
+			int64_t p = luma ? i : i * channels + c;
+			if (c == 3) {
+				output[i * channels + c] = image[i * channels + c]; // Alpha is kept
+				continue;
+			}
+			int32_t magnitude = (int32_t)(sqrtf((float)(gx[p] * gx[p] + gy[p] * gy[p])) * OPERATOR_SCALES[edge_operator] + 0.5f);
+			output[i * channels + c] = (unsigned char)(magnitude > 255 ? 255 : magnitude);
+		}
+	}
+}
+
+// Checks the engine against the naive passes, separate output and in place. Returns the number of bytes that differ.
+static size_t check_edge(Filter_Engine engine, uint32_t channels, int edge_operator, bool luma) {
+	size_t size = (size_t)CHECK_WIDTH * CHECK_HEIGHT * channels;
+	std::vector<unsigned char> input_data(size), expected_data(size), output_data(size);
+	fill_random(input_data);
+	edge_naive(input_data.data(), expected_data.data(), CHECK_WIDTH, CHECK_HEIGHT, channels, edge_operator, luma);
+	Image input = { input_data.data(), CHECK_WIDTH, CHECK_HEIGHT, channels };
+	Image output = { output_data.data(), CHECK_WIDTH, CHECK_HEIGHT, channels };
+	filter_engine_submit_edge(engine, &input, &output, (Filter_Edge_Operator)edge_operator, luma, PRIORITY_INTERACTIVE);
+	filter_engine_wait(engine);
+	filter_engine_submit_edge(engine, &input, &input, (Filter_Edge_Operator)edge_operator, luma, PRIORITY_INTERACTIVE);
+	filter_engine_wait(engine);
+	size_t mismatches = 0;
+	for (size_t i = 0; i < size; ++i) {
+		if (output_data[i] != expected_data[i]) mismatches++;
+		if (input_data[i] != expected_data[i]) mismatches++;
+	}
+
+	return mismatches;
+}
+
+// Best of repeats edge maps of the frame, in milliseconds. Without an engine it times the naive passes.
+static double edge_bench(Filter_Engine engine, Image* input, Image* output, int edge_operator, bool luma) {
+	double best_ms = 1e30;
+	for (int r = 0; r < BENCH_REPEATS; ++r) {
+		Clock::time_point start_time = Clock::now();
+		if (engine == NULL) edge_naive(input->data, output->data, input->width, input->height, input->channels, edge_operator, luma);
+		else {
+			filter_engine_submit_edge(engine, input, output, (Filter_Edge_Operator)edge_operator, luma, PRIORITY_INTERACTIVE);
+			filter_engine_wait(engine);
+		}
+		double elapsed_ms = std::chrono::duration<double, std::milli>(Clock::now() - start_time).count();
+		if (elapsed_ms < best_ms) best_ms = elapsed_ms;
+	}
+
+	return best_ms;
+}
+
+// Times the fused edge kernels, one pass over a sliding window of three rows, against the naive passes with
+// their whole gradient images, for both operators with and without luma. The naive passes run on this thread,
+// the engine on one worker and on every processor.
+// Fails if the engine differs from the naive passes in any byte.
+// With --check only the comparisons run, so ctest can run them without the timing.
+int main(int argc, char** argv) {
+	bool check_only = argc > 1 && strcmp(argv[1], "--check") == 0;
+	Filter_Engine check_engine = bench_check_engine_create();
+	Filter_Engine engines[2] = { bench_engine_create(1, DEFAULT), bench_engine_create(DEFAULT, DEFAULT) };
+	bool passed = true;
+	for (uint32_t channels = 3; channels <= 4; ++channels) {
+		for (int edge_operator = EDGE_SOBEL; edge_operator <= EDGE_SCHARR; ++edge_operator) {
+			for (int luma = 0; luma <= 1; ++luma) {
+				size_t mismatches = check_edge(check_engine, channels, edge_operator, luma != 0);
+				if (mismatches != 0) {
+					printf("%s%s, %u channels differs from the naive passes in %zu bytes\n", OPERATOR_NAMES[edge_operator], luma ? " on luma" : "", channels, mismatches);
+					passed = false;
+				}
+			}
+		}
+	}
+
+	if (check_only) {
+		filter_engine_destroy(check_engine);
+		filter_engine_destroy(engines[0]);
+		filter_engine_destroy(engines[1]);
+
+		return passed ? 0 : 1;
+	}
+
+	for (uint32_t channels = 3; channels <= 4; ++channels) {
+		size_t size = (size_t)BENCH_WIDTH * BENCH_HEIGHT * channels;
+		std::vector<unsigned char> input_data(size), output_data(size);
+		fill_random(input_data);
+		touch_pages(output_data);
+		Image input = { input_data.data(), BENCH_WIDTH, BENCH_HEIGHT, channels };
+		Image output = { output_data.data(), BENCH_WIDTH, BENCH_HEIGHT, channels };
+		double megapixels = (double)BENCH_WIDTH * BENCH_HEIGHT / 1e6;
+
+		printf("\n-- Edge (%ux%u, %u channels) --\n", BENCH_WIDTH, BENCH_HEIGHT, channels);
+		printf("%8s %5s %10s %8s %12s %8s %8s %10s %8s\n", "operator", "luma", "naive ms", "MP/s", "1 thread ms", "MP/s", "speedup", "all ms", "MP/s");
+		for (int edge_operator = EDGE_SOBEL; edge_operator <= EDGE_SCHARR; ++edge_operator) {
+			for (int luma = 0; luma <= 1; ++luma) {
+				double naive_ms = edge_bench(NULL, &input, &output, edge_operator, luma != 0);
+				double single_ms = edge_bench(engines[0], &input, &output, edge_operator, luma != 0);
+				double all_ms = edge_bench(engines[1], &input, &output, edge_operator, luma != 0);
+				printf("%8s %5s %10.1f %8.1f %12.1f %8.1f %7.2fx %10.1f %8.1f\n", OPERATOR_NAMES[edge_operator], luma ? "yes" : "no",
+					naive_ms, megapixels / naive_ms * 1e3, single_ms, megapixels / single_ms * 1e3, naive_ms / single_ms, all_ms, megapixels / all_ms * 1e3);
+			}
+		}
+	}
+	filter_engine_destroy(check_engine);
+	filter_engine_destroy(engines[0]);
+	filter_engine_destroy(engines[1]);
+
+	return passed ? 0 : 1;
+}
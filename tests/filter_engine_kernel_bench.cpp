@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench_common.h"
+
+// 12 MP frame, 36 MiB as RGB, so every pass streams from memory instead of the caches
+const uint32_t BENCH_WIDTH = 4000;
+const uint32_t BENCH_HEIGHT = 3000;
+const int BENCH_REPEATS = 10;
+
+// Tile that stays in L2, shows the arithmetic of the kernels without the memory bound
+const uint32_t CACHED_SIZE = 256;
+const int CACHED_REPEATS = 500;
+
+// Odd width so every kernel also runs its scalar tail on each row-sized run
+const uint32_t CHECK_WIDTH = 1023;
+const uint32_t CHECK_HEIGHT = 17;
+
+const char* LEVEL_NAMES[] = { "auto", "scalar", "SSE4.1", "AVX2", "AVX-512" };
+const char* MATH_NAMES[] = { "exact", "fast" };
+const char* FILTER_NAMES[] = { "invert", "grayscale", "sepia", "matrix", "lut", "curves" };
+const Work_Type FILTER_TYPES[] = { INVERT, GRAYSCALE, SEPIA, COLOR_MATRIX, LUT, LUT };
+const int FILTER_COUNT = 6;
+const int CURVES_FILTER = 5;
+const int GRADE_STEPS = 3;
+
+// A three step grade: more saturation, more contrast, then a little brighter and alpha at 80%.
+// The "matrix" column applies all of it, so it also covers negative weights, offsets and the alpha row.
+static float grade_steps[GRADE_STEPS][20];
+static float grade_matrix[20];
+
+// "lut" is one gamma table for the colors and leaves alpha alone, the common case the kernels run as a plain byte run.
+// "curves" gives every channel its own table.
+static uint8_t gamma_luts[4][256];
+static uint8_t curve_luts[4][256];
+
+static void grade_build() {
+	filter_color_matrix_saturation(grade_steps[0], 1.3f);
+	filter_color_matrix_contrast(grade_steps[1], 1.1f);
+	filter_color_matrix_brightness(grade_steps[2], 8.0f);
+	grade_steps[2][18] = 0.8f;
+	filter_color_matrix_identity(grade_matrix);
+	for (int s = 0; s < GRADE_STEPS; ++s) {
+		filter_color_matrix_concat(grade_matrix, grade_matrix, grade_steps[s]);
+	}
+	const uint8_t points[][2] = { { 0, 10 }, { 64, 50 }, { 192, 220 }, { 255, 240 } };
+	for (int c = 0; c < 3; ++c) {
+		filter_lut_gamma(gamma_luts[c], 1.8f);
+	}
+	filter_lut_identity(gamma_luts[3]);
+	filter_lut_levels(curve_luts[0], 16, 235, 1.2f, 0, 255);
+	filter_lut_curve(curve_luts[1], points, 4);
+	filter_lut_gamma(curve_luts[2], 0.8f);
+	filter_lut_brightness_contrast(curve_luts[3], -20.0f, 1.3f);
+}
+
+static void filter_run(Filter_Engine engine, Image* input, Image* output, int filter) {
+	Work_Type type = FILTER_TYPES[filter];
+	if (type == COLOR_MATRIX) filter_engine_submit_color_matrix(engine, input, output, grade_matrix, PRIORITY_INTERACTIVE);
+	else if (type == LUT) filter_engine_submit_lut(engine, input, output, filter == CURVES_FILTER ? curve_luts : gamma_luts, PRIORITY_INTERACTIVE);
+	else filter_engine_submit(engine, input, output, type, PRIORITY_INTERACTIVE);
+}
+
+// One worker and a minimum chunk size no image reaches, so every call runs inline on this thread
+// and the numbers are the kernel alone, without the scheduler.
+static Filter_Engine kernel_engine_create(Filter_Simd_Level level, Filter_Color_Math color_math) {
+	Filter_Engine engine = filter_engine_create();
+	Filter_Engine_Options options = { 0 };
+	options.thread_count = 1;
+	options.min_chunk_bytes = SIZE_MAX;
+	options.simd_level = level;
+	options.color_math = color_math;
+	filter_engine_initialize_with_options(engine, &options);
+
+	return engine;
+}
+
+// Compares the output of two engines. Returns the number of bytes that differ by more than tolerance.
+static size_t check_level(Filter_Engine engine, Filter_Engine reference, uint32_t channels, int filter, int tolerance) {
+	size_t size = (size_t)CHECK_WIDTH * CHECK_HEIGHT * channels;
+	std::vector<unsigned char> input_data(size), expected_data(size), output_data(size);
+	fill_random(input_data);
+	Image input = { input_data.data(), CHECK_WIDTH, CHECK_HEIGHT, channels };
+	Image expected = { expected_data.data(), CHECK_WIDTH, CHECK_HEIGHT, channels };
+	Image output = { output_data.data(), CHECK_WIDTH, CHECK_HEIGHT, channels };
+	filter_run(reference, &input, &expected, filter);
+	filter_run(engine, &input, &output, filter);
+	size_t mismatches = 0;
+	for (size_t i = 0; i < size; ++i) {
+		if (abs((int)expected_data[i] - (int)output_data[i]) > tolerance) mismatches++;
+	}
+
+	return mismatches;
+}
+
+// Best of repeats passes over the frame, in megapixels per second
+static double kernel_bench(Filter_Engine engine, Image* input, Image* output, int filter, int repeats) {
+	double best_ms = 1e30;
+	for (int r = 0; r < repeats; ++r) {
+		Clock::time_point start_time = Clock::now();
+		filter_run(engine, input, output, filter);
+		double elapsed_ms = std::chrono::duration<double, std::milli>(Clock::now() - start_time).count();
+		if (elapsed_ms < best_ms) best_ms = elapsed_ms;
+	}
+
+	return (double)input->width * input->height / 1e3 / best_ms;
+}
+
+// Compares the point filter kernels of every instruction set level the CPU supports against the scalar ones,
+// single-threaded on a frame streamed from memory and on one that stays in cache. Speedups are against the exact scalar kernels.
+// Fails if an exact level differs from the scalar exact kernels, if a fast level differs from the scalar fast
+// kernels, or if fast is ever more than one off exact.
+// Then times the grade as three passes against the one pass of the concatenated matrix.
+// With --check only the comparisons run, so ctest can run them without the timing.
+int main(int argc, char** argv) {
+	bool check_only = argc > 1 && strcmp(argv[1], "--check") == 0;
+	grade_build();
+	Filter_Engine probe = kernel_engine_create(SIMD_AUTO, COLOR_MATH_EXACT);
+	Filter_Simd_Level best_level = filter_engine_simd_level(probe);
+	filter_engine_destroy(probe);
+	Filter_Engine scalar[2] = { kernel_engine_create(SIMD_SCALAR, COLOR_MATH_EXACT), kernel_engine_create(SIMD_SCALAR, COLOR_MATH_FAST) };
+	printf("Widest supported level: %s\n", LEVEL_NAMES[best_level]);
+
+	bool passed = true;
+	for (uint32_t channels = 3; channels <= 4; ++channels) {
+		for (int math = COLOR_MATH_EXACT; math <= COLOR_MATH_FAST; ++math) {
+			for (int level = SIMD_SCALAR; level <= best_level; ++level) {
+				Filter_Engine engine = kernel_engine_create((Filter_Simd_Level)level, (Filter_Color_Math)math);
+				for (int f = 0; f < FILTER_COUNT; ++f) {
+					size_t mismatches = check_level(engine, scalar[math], channels, f, 0);
+					size_t off_by_more = check_level(engine, scalar[COLOR_MATH_EXACT], channels, f, 1);
+					if (mismatches != 0 || off_by_more != 0) {
+						printf("%s %s %s, %u channels differs from scalar in %zu bytes, %zu bytes more than one off exact\n", LEVEL_NAMES[level], MATH_NAMES[math], FILTER_NAMES[f], channels, mismatches, off_by_more);
+						passed = false;
+					}
+				}
+				filter_engine_destroy(engine);
+			}
+		}
+	}
+	filter_engine_destroy(scalar[0]);
+	filter_engine_destroy(scalar[1]);
+	if (check_only) return passed ? 0 : 1;
+
+	for (int frame = 0; frame < 4; ++frame) {
+		uint32_t channels = 3 + frame % 2;
+		bool cached = frame >= 2;
+		uint32_t width = cached ? CACHED_SIZE : BENCH_WIDTH;
+		uint32_t height = cached ? CACHED_SIZE : BENCH_HEIGHT;
+		int repeats = cached ? CACHED_REPEATS : BENCH_REPEATS;
+		size_t size = (size_t)width * height * channels;
+		std::vector<unsigned char> input_data(size), output_data(size);
+		fill_random(input_data);
+		touch_pages(output_data);
+		Image input = { input_data.data(), width, height, channels };
+		Image output = { output_data.data(), width, height, channels };
+
+		printf("\n-- Kernels (%ux%u, %u channels, %s, 1 thread) --\n", width, height, channels, cached ? "in cache" : "from memory");
+		printf("%8s %6s", "level", "math");
+		for (int f = 0; f < FILTER_COUNT; ++f) printf(" %11s MP/s %7s", FILTER_NAMES[f], "speedup");
+		printf("\n");
+		double scalar_mps[FILTER_COUNT] = { 0 };
+		for (int math = COLOR_MATH_EXACT; math <= COLOR_MATH_FAST; ++math) {
+			for (int level = SIMD_SCALAR; level <= best_level; ++level) {
+				Filter_Engine engine = kernel_engine_create((Filter_Simd_Level)level, (Filter_Color_Math)math);
+				printf("%8s %6s", LEVEL_NAMES[level], MATH_NAMES[math]);
+				for (int f = 0; f < FILTER_COUNT; ++f) {
+					double mps = kernel_bench(engine, &input, &output, f, repeats);
+					if (level == SIMD_SCALAR && math == COLOR_MATH_EXACT) scalar_mps[f] = mps;
+					printf(" %16.1f %6.2fx", mps, mps / scalar_mps[f]);
+				}
+				printf("\n");
+				filter_engine_destroy(engine);
+			}
+		}
+	}
+
+	Filter_Engine engine = kernel_engine_create(SIMD_AUTO, COLOR_MATH_EXACT);
+	size_t size = (size_t)BENCH_WIDTH * BENCH_HEIGHT * 3;
+	std::vector<unsigned char> input_data(size), output_data(size);
+	fill_random(input_data);
+	touch_pages(output_data);
+	Image input = { input_data.data(), BENCH_WIDTH, BENCH_HEIGHT, 3 };
+	Image output = { output_data.data(), BENCH_WIDTH, BENCH_HEIGHT, 3 };
+	double separate_ms = 1e30, fused_ms = 1e30;
+	for (int r = 0; r < BENCH_REPEATS; ++r) {
+		Clock::time_point start_time = Clock::now();
+		filter_engine_submit_color_matrix(engine, &input, &output, grade_steps[0], PRIORITY_INTERACTIVE);
+		for (int s = 1; s < GRADE_STEPS; ++s) {
+			filter_engine_submit_color_matrix(engine, &output, &output, grade_steps[s], PRIORITY_INTERACTIVE);
+		}
+		double elapsed_ms = std::chrono::duration<double, std::milli>(Clock::now() - start_time).count();
+		if (elapsed_ms < separate_ms) separate_ms = elapsed_ms;
+		start_time = Clock::now();
+		filter_engine_submit_color_matrices(engine, &input, &output, grade_steps, GRADE_STEPS, PRIORITY_INTERACTIVE);
+		elapsed_ms = std::chrono::duration<double, std::milli>(Clock::now() - start_time).count();
+		if (elapsed_ms < fused_ms) fused_ms = elapsed_ms;
+	}
+	printf("\n-- %d step grade (%ux%u, 3 channels, %s, 1 thread) --\n", GRADE_STEPS, BENCH_WIDTH, BENCH_HEIGHT, LEVEL_NAMES[best_level]);
+	printf("%16s %10.2f ms\n%16s %10.2f ms %6.2fx\n", "separate passes", separate_ms, "one fused pass", fused_ms, separate_ms / fused_ms);
+	filter_engine_destroy(engine);
+
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,359 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "bench_common.h"
+
+// 24 MP frame, 72 MiB as RGB
+const uint32_t BENCH_WIDTH = 6000;
+const uint32_t BENCH_HEIGHT = 4000;
+const int BENCH_REPEATS = 3;
+
+// Target sizes of the timing runs, the last one enlarges a quarter of the frame back to full size
+const uint32_t BENCH_SIZES[][4] = {
+	{ BENCH_WIDTH, BENCH_HEIGHT, 1500, 1000 },
+	{ BENCH_WIDTH, BENCH_HEIGHT, 1920, 1080 },
+	{ BENCH_WIDTH, BENCH_HEIGHT, 256, 171 },
+	{ 1500, 1000, BENCH_WIDTH, BENCH_HEIGHT },
+};
+
+// Small frames for the correctness check, odd sizes so the bands split unevenly. Up, down, and each axis its own way.
+const uint32_t CHECK_SIZES[][4] = {
+	{ 97, 61, 211, 133 },
+	{ 97, 61, 37, 23 },
+	{ 97, 61, 150, 40 },
+	{ 61, 97, 7, 300 },
+	{ 5, 3, 1, 1 },
+};
+const int CHECK_TOLERANCE = 1; // Float weights and sums against double, nearest must match exactly
+
+const char* FILTER_NAMES[] = { "bilinear", "nearest", "bicubic", "lanczos3" };
+
+// Reduce checks, input size and factor. The pyramid frames are tall enough that the check engine's bands
+// hold several levels, and the last levels are reduced after the banded pass.
+const uint32_t REDUCE_CHECKS[][3] = { { 97, 61, 2 }, { 97, 61, 3 }, { 61, 97, 5 }, { 4, 3, 7 }, { 1, 1, 2 } };
+const uint32_t PYRAMID_CHECKS[][2] = { { 301, 203 }, { 640, 480 }, { 5, 3 }, { 1, 77 } };
+const uint32_t BENCH_REDUCE_FACTORS[] = { 2, 4, 8 };
+
+static double reference_kernel(int filter, double x) {
+	x = fabs(x);
+	switch (filter) {
+	case RESAMPLE_BILINEAR: return x < 1.0 ? 1.0 - x : 0.0;
+	case RESAMPLE_BICUBIC:
+		if (x < 1.0) return 1.5 * x * x * x - 2.5 * x * x + 1.0;
+		if (x < 2.0) return -0.5 * x * x * x + 2.5 * x * x - 4.0 * x + 2.0;
+		return 0.0;
+	case RESAMPLE_LANCZOS3:
+		if (x == 0.0) return 1.0;
+		if (x >= 3.0) return 0.0;
+		return 3.0 * sin(M_PI * x) * sin(M_PI * x / 3.0) / (M_PI * M_PI * x * x);
+	default: return 0.0;
+	}
+}
+
+// Weights of one output pixel over the whole input axis. The filter is stretched by the scale when shrinking,
+// taps past the edge land on the edge pixel, and the weights are normalized to add up to one.
+static void reference_weights(int filter, uint32_t source_size, uint32_t target_size, uint32_t x, std::vector<double>& weights) {
+	weights.assign(source_size, 0.0);
+	double scale = (double)source_size / target_size;
+	double center = (x + 0.5) * scale;
+	if (filter == RESAMPLE_NEAREST) {
+		uint32_t index = (uint32_t)center;
+		weights[index < source_size ? index : source_size - 1] = 1.0;
+		return;
+	}
+	double filter_scale = scale > 1.0 ? scale : 1.0;
+	double support = (filter == RESAMPLE_BILINEAR ? 1.0 : (filter == RESAMPLE_BICUBIC ? 2.0 : 3.0)) * filter_scale;
+	double total = 0.0;
+	for (int64_t i = (int64_t)floor(center - support - 1.0); i <= (int64_t)ceil(center + support + 1.0); ++i) {
+		double weight = reference_kernel(filter, (i + 0.5 - center) / filter_scale);
+		int64_t index = i < 0 ? 0 : (i >= (int64_t)source_size ? (int64_t)source_size - 1 : i);
+		weights[index] += weight;
+		total += weight;
+	}
+	for (uint32_t i = 0; i < source_size; ++i) {
+		weights[i] /= total;
+	}
+}
+
+// Straight from the definition in double, every output pixel sums all its taps in both directions at once
+static void resize_reference(const unsigned char* image, uint32_t width, uint32_t height, unsigned char* output, uint32_t target_width, uint32_t target_height, uint32_t channels, int filter) {
+	std::vector<double> weights_x, weights_y;
+	for (uint32_t y = 0; y < target_height; ++y) {
+		reference_weights(filter, height, target_height, y, weights_y);
+		for (uint32_t x = 0; x < target_width; ++x) {
+			reference_weights(filter, width, target_width, x, weights_x);
+			for (uint32_t c = 0; c < channels; ++c) {
+				double sum = 0.0;
+				for (uint32_t sy = 0; sy < height; ++sy) {
+					if (weights_y[sy] == 0.0) continue;
+					for (uint32_t sx = 0; sx < width; ++sx) {
+						sum += weights_y[sy] * weights_x[sx] * image[((size_t)sy * width + sx) * channels + c];
+					}
+				}
+				long value = lround(sum);
+				output[((size_t)y * target_width + x) * channels + c] = (unsigned char)(value < 0 ? 0 : (value > 255 ? 255 : value));
+			}
+		}
+	}
+}
+
+// Rounded mean of every factor x factor block, the last block of each row and column takes in the remainder
+static void reduce_reference(const unsigned char* image, uint32_t width, uint32_t height, unsigned char* output, uint32_t target_width, uint32_t target_height, uint32_t channels, uint32_t factor) {
+	for (uint32_t y = 0; y < target_height; ++y) {
+		uint32_t y_end = y == target_height - 1 ? height : (y + 1) * factor;
+		for (uint32_t x = 0; x < target_width; ++x) {
+			uint32_t x_end = x == target_width - 1 ? width : (x + 1) * factor;
+			uint32_t area = (y_end - y * factor) * (x_end - x * factor);
+			for (uint32_t c = 0; c < channels; ++c) {
+				uint32_t sum = 0;
+				for (uint32_t sy = y * factor; sy < y_end; ++sy) {
+					for (uint32_t sx = x * factor; sx < x_end; ++sx) {
+						sum += image[((size_t)sy * width + sx) * channels + c];
+					}
+				}
+				output[((size_t)y * target_width + x) * channels + c] = (unsigned char)((sum + area / 2) / area);
+			}
+		}
+	}
+}
+
+// Checks the engine against the reference, separate output and in place in one buffer big enough for either image.
+// Returns the largest difference.
+static int check_resize(Filter_Engine engine, const uint32_t sizes[4], uint32_t channels, int filter) {
+	size_t input_size = (size_t)sizes[0] * sizes[1] * channels;
+	size_t output_size = (size_t)sizes[2] * sizes[3] * channels;
+	std::vector<unsigned char> input_data(input_size), expected_data(output_size), output_data(output_size);
+	std::vector<unsigned char> shared_data(input_size > output_size ? input_size : output_size);
+	fill_random(input_data);
+	memcpy(shared_data.data(), input_data.data(), input_size);
+	resize_reference(input_data.data(), sizes[0], sizes[1], expected_data.data(), sizes[2], sizes[3], channels, filter);
+	Image input = { input_data.data(), sizes[0], sizes[1], channels };
+	Image output = { output_data.data(), sizes[2], sizes[3], channels };
+	Image shared_input = { shared_data.data(), sizes[0], sizes[1], channels };
+	Image shared_output = { shared_data.data(), sizes[2], sizes[3], channels };
+	filter_engine_submit_resize(engine, &input, &output, (Filter_Resample)filter, PRIORITY_INTERACTIVE);
+	filter_engine_submit_resize(engine, &shared_input, &shared_output, (Filter_Resample)filter, PRIORITY_INTERACTIVE);
+	filter_engine_wait(engine);
+	int worst = 0;
+	for (size_t i = 0; i < output_size; ++i) {
+		int difference = abs((int)output_data[i] - (int)expected_data[i]);
+		int shared_difference = abs((int)shared_data[i] - (int)expected_data[i]);
+		if (difference > worst) worst = difference;
+		if (shared_difference > worst) worst = shared_difference;
+	}
+
+	return worst;
+}
+
+// Reduces must match the reference exactly, separate output and in place. Returns the number of bytes that differ.
+static size_t check_reduce(Filter_Engine engine, const uint32_t check[3], uint32_t channels) {
+	uint32_t factor = check[2];
+	uint32_t target_width = check[0] / factor > 0 ? check[0] / factor : 1;
+	uint32_t target_height = check[1] / factor > 0 ? check[1] / factor : 1;
+	size_t input_size = (size_t)check[0] * check[1] * channels;
+	size_t output_size = (size_t)target_width * target_height * channels;
+	std::vector<unsigned char> input_data(input_size), expected_data(output_size), output_data(output_size), shared_data(input_size);
+	fill_random(input_data);
+	memcpy(shared_data.data(), input_data.data(), input_size);
+	reduce_reference(input_data.data(), check[0], check[1], expected_data.data(), target_width, target_height, channels, factor);
+	Image input = { input_data.data(), check[0], check[1], channels };
+	Image output = { output_data.data(), target_width, target_height, channels };
+	Image shared_input = { shared_data.data(), check[0], check[1], channels };
+	Image shared_output = { shared_data.data(), target_width, target_height, channels };
+	filter_engine_submit_reduce(engine, &input, &output, factor, PRIORITY_INTERACTIVE);
+	filter_engine_submit_reduce(engine, &shared_input, &shared_output, factor, PRIORITY_INTERACTIVE);
+	filter_engine_wait(engine);
+	size_t mismatches = 0;
+	for (size_t i = 0; i < output_size; ++i) {
+		if (output_data[i] != expected_data[i]) mismatches++;
+		if (shared_data[i] != expected_data[i]) mismatches++;
+	}
+
+	return mismatches;
+}
+
+// Every pyramid level must match halving the level before it with the reference. Returns the number of bytes that differ.
+static size_t check_pyramid(Filter_Engine engine, const uint32_t check[2], uint32_t channels) {
+	size_t count = filter_pyramid_level_count(check[0], check[1]) - 1;
+	std::vector<unsigned char> input_data((size_t)check[0] * check[1] * channels);
+	fill_random(input_data);
+	std::vector<std::vector<unsigned char> > level_data(count), expected_data(count);
+	std::vector<Image> levels(count);
+	for (size_t k = 0; k < count; ++k) {
+		filter_pyramid_level_size(check[0], check[1], k + 1, &levels[k].width, &levels[k].height);
+		level_data[k].resize((size_t)levels[k].width * levels[k].height * channels);
+		expected_data[k].resize(level_data[k].size());
+		levels[k].data = level_data[k].data();
+		levels[k].channels = channels;
+		const unsigned char* above = k == 0 ? input_data.data() : expected_data[k - 1].data();
+		uint32_t above_width = k == 0 ? check[0] : levels[k - 1].width;
+		uint32_t above_height = k == 0 ? check[1] : levels[k - 1].height;
+		reduce_reference(above, above_width, above_height, expected_data[k].data(), levels[k].width, levels[k].height, channels, 2);
+	}
+	Image input = { input_data.data(), check[0], check[1], channels };
+	filter_engine_build_pyramid(engine, &input, levels.data(), count);
+	size_t mismatches = 0;
+	for (size_t k = 0; k < count; ++k) {
+		for (size_t i = 0; i < level_data[k].size(); ++i) {
+			if (level_data[k][i] != expected_data[k][i]) mismatches++;
+		}
+	}
+
+	return mismatches;
+}
+
+// Best of repeats resizes, in milliseconds. first_ms gets the first call, which also computes the weights.
+static double resize_bench(Filter_Engine engine, Image* input, Image* output, int filter, double* first_ms) {
+	double best_ms = 1e30;
+	for (int r = 0; r < BENCH_REPEATS; ++r) {
+		Clock::time_point start_time = Clock::now();
+		filter_engine_submit_resize(engine, input, output, (Filter_Resample)filter, PRIORITY_INTERACTIVE);
+		filter_engine_wait(engine);
+		double elapsed_ms = std::chrono::duration<double, std::milli>(Clock::now() - start_time).count();
+		if (r == 0 && first_ms != NULL) *first_ms = elapsed_ms;
+		if (elapsed_ms < best_ms) best_ms = elapsed_ms;
+	}
+
+	return best_ms;
+}
+
+// Checks every filter against a double precision reference, then times down and up scaling of a 24 MP frame on one
+// worker and on every processor. The first call of each size pair computes the weights, later ones take them from
+// the engine's cache. Then times reducing by integer factors against bilinear to the same size, and a whole mip
+// pyramid in one pass against reducing level by level.
+// Fails if a filtered output is more than one step off the reference, or nearest, a reduce or a pyramid level differs at all.
+// Best of repeats reduces, in milliseconds
+static double reduce_bench(Filter_Engine engine, Image* input, Image* output, uint32_t factor) {
+	double best_ms = 1e30;
+	for (int r = 0; r < BENCH_REPEATS; ++r) {
+		Clock::time_point start_time = Clock::now();
+		filter_engine_submit_reduce(engine, input, output, factor, PRIORITY_INTERACTIVE);
+		filter_engine_wait(engine);
+		double elapsed_ms = std::chrono::duration<double, std::milli>(Clock::now() - start_time).count();
+		if (elapsed_ms < best_ms) best_ms = elapsed_ms;
+	}
+
+	return best_ms;
+}
+
+// Best of repeats pyramids, in milliseconds. chained reduces one level at a time from the level before,
+// as a caller without filter_engine_build_pyramid would, instead of all levels in one pass.
+static double pyramid_bench(Filter_Engine engine, Image* input, Image* levels, size_t count, bool chained) {
+	double best_ms = 1e30;
+	for (int r = 0; r < BENCH_REPEATS; ++r) {
+		Clock::time_point start_time = Clock::now();
+		if (!chained) filter_engine_build_pyramid(engine, input, levels, count);
+		else {
+			for (size_t k = 0; k < count; ++k) {
+				filter_engine_submit_reduce(engine, k == 0 ? input : &levels[k - 1], &levels[k], 2, PRIORITY_INTERACTIVE);
+				filter_engine_wait(engine);
+			}
+		}
+		double elapsed_ms = std::chrono::duration<double, std::milli>(Clock::now() - start_time).count();
+		if (elapsed_ms < best_ms) best_ms = elapsed_ms;
+	}
+
+	return best_ms;
+}
+
+// With --check only the comparisons run, so ctest can run them without the timing.
+int main(int argc, char** argv) {
+	bool check_only = argc > 1 && strcmp(argv[1], "--check") == 0;
+	Filter_Engine check_engine = bench_check_engine_create();
+	Filter_Engine engines[2] = { bench_engine_create(1, DEFAULT), bench_engine_create(DEFAULT, DEFAULT) };
+	bool passed = true;
+	for (const uint32_t* sizes : CHECK_SIZES) {
+		for (uint32_t channels = 3; channels <= 4; ++channels) {
+			for (int filter = RESAMPLE_BILINEAR; filter <= RESAMPLE_LANCZOS3; ++filter) {
+				int worst = check_resize(check_engine, sizes, channels, filter);
+				if (worst > (filter == RESAMPLE_NEAREST ? 0 : CHECK_TOLERANCE)) {
+					printf("%s %ux%u to %ux%u, %u channels is up to %d off the reference\n", FILTER_NAMES[filter], sizes[0], sizes[1], sizes[2], sizes[3], channels, worst);
+					passed = false;
+				}
+			}
+		}
+	}
+	for (uint32_t channels = 3; channels <= 4; ++channels) {
+		for (const uint32_t* check : REDUCE_CHECKS) {
+			size_t mismatches = check_reduce(check_engine, check, channels);
+			if (mismatches != 0) {
+				printf("Reduce %ux%u by %u, %u channels differs from the reference in %zu bytes\n", check[0], check[1], check[2], channels, mismatches);
+				passed = false;
+			}
+		}
+		for (const uint32_t* check : PYRAMID_CHECKS) {
+			size_t mismatches = check_pyramid(check_engine, check, channels);
+			if (mismatches != 0) {
+				printf("Pyramid of %ux%u, %u channels differs from the reference in %zu bytes\n", check[0], check[1], channels, mismatches);
+				passed = false;
+			}
+		}
+	}
+
+	if (check_only) {
+		filter_engine_destroy(check_engine);
+		filter_engine_destroy(engines[0]);
+		filter_engine_destroy(engines[1]);
+
+		return passed ? 0 : 1;
+	}
+
+	for (uint32_t channels = 3; channels <= 4; ++channels) {
+		for (const uint32_t* sizes : BENCH_SIZES) {
+			std::vector<unsigned char> input_data((size_t)sizes[0] * sizes[1] * channels), output_data((size_t)sizes[2] * sizes[3] * channels);
+			fill_random(input_data);
+			touch_pages(output_data);
+			Image input = { input_data.data(), sizes[0], sizes[1], channels };
+			Image output = { output_data.data(), sizes[2], sizes[3], channels };
+			double megapixels = (double)sizes[2] * sizes[3] / 1e6;
+
+			printf("\n-- Resize %ux%u to %ux%u, %u channels (output MP/s) --\n", sizes[0], sizes[1], sizes[2], sizes[3], channels);
+			printf("%9s %10s %12s %8s %10s %8s\n", "filter", "first ms", "1 thread ms", "MP/s", "all ms", "MP/s");
+			for (int filter = RESAMPLE_BILINEAR; filter <= RESAMPLE_LANCZOS3; ++filter) {
+				double first_ms = 0.0;
+				double single_ms = resize_bench(engines[0], &input, &output, filter, &first_ms);
+				double all_ms = resize_bench(engines[1], &input, &output, filter, NULL);
+				printf("%9s %10.1f %12.1f %8.1f %10.1f %8.1f\n", FILTER_NAMES[filter], first_ms, single_ms, megapixels / single_ms * 1e3, all_ms, megapixels / all_ms * 1e3);
+			}
+		}
+	}
+	for (uint32_t channels = 3; channels <= 4; ++channels) {
+		std::vector<unsigned char> input_data((size_t)BENCH_WIDTH * BENCH_HEIGHT * channels);
+		fill_random(input_data);
+		Image input = { input_data.data(), BENCH_WIDTH, BENCH_HEIGHT, channels };
+
+		printf("\n-- Reduce %ux%u, %u channels (input MP/s) --\n", BENCH_WIDTH, BENCH_HEIGHT, channels);
+		printf("%7s %12s %8s %10s %8s %14s\n", "factor", "1 thread ms", "MP/s", "all ms", "MP/s", "bilinear ms");
+		double megapixels = (double)BENCH_WIDTH * BENCH_HEIGHT / 1e6;
+		for (uint32_t factor : BENCH_REDUCE_FACTORS) {
+			std::vector<unsigned char> output_data((size_t)(BENCH_WIDTH / factor) * (BENCH_HEIGHT / factor) * channels);
+			touch_pages(output_data);
+			Image output = { output_data.data(), BENCH_WIDTH / factor, BENCH_HEIGHT / factor, channels };
+			double single_ms = reduce_bench(engines[0], &input, &output, factor);
+			double all_ms = reduce_bench(engines[1], &input, &output, factor);
+			double bilinear_ms = resize_bench(engines[0], &input, &output, RESAMPLE_BILINEAR, NULL);
+			printf("%7u %12.1f %8.1f %10.1f %8.1f %14.1f\n", factor, single_ms, megapixels / single_ms * 1e3, all_ms, megapixels / all_ms * 1e3, bilinear_ms);
+		}
+
+		size_t count = filter_pyramid_level_count(BENCH_WIDTH, BENCH_HEIGHT) - 1;
+		std::vector<std::vector<unsigned char> > level_data(count);
+		std::vector<Image> levels(count);
+		for (size_t k = 0; k < count; ++k) {
+			filter_pyramid_level_size(BENCH_WIDTH, BENCH_HEIGHT, k + 1, &levels[k].width, &levels[k].height);
+			level_data[k].assign((size_t)levels[k].width * levels[k].height * channels, 0);
+			levels[k].data = level_data[k].data();
+			levels[k].channels = channels;
+		}
+		printf("\n-- Pyramid of %ux%u, %zu levels, %u channels --\n", BENCH_WIDTH, BENCH_HEIGHT, count, channels);
+		printf("%10s %12s %10s\n", "", "1 thread ms", "all ms");
+		printf("%10s %12.1f %10.1f\n", "one pass", pyramid_bench(engines[0], &input, levels.data(), count, false), pyramid_bench(engines[1], &input, levels.data(), count, false));
+		printf("%10s %12.1f %10.1f\n", "chained", pyramid_bench(engines[0], &input, levels.data(), count, true), pyramid_bench(engines[1], &input, levels.data(), count, true));
+	}
+	filter_engine_destroy(check_engine);
+	filter_engine_destroy(engines[0]);
+	filter_engine_destroy(engines[1]);
+
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,445 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "filter.h"
+#include "platform.h" // For the topology summary
+
+#ifdef _WIN32
+#include <windows.h> // For GetProcessTimes
+#else
+#include <time.h> // For clock_gettime
+#endif
+
+// C++ specific libraries
+#include <chrono> // For high-resolution timing
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+typedef std::chrono::steady_clock Clock;
+
+// Synthetic 24 MP RGB frame so the numbers do not depend on image decoding or disk speed
+const uint32_t BENCH_WIDTH = 6000;
+const uint32_t BENCH_HEIGHT = 4000;
+const uint32_t BENCH_CHANNELS = 3;
+const int BENCH_REPEATS = 10;
+
+// Many small images queued back to back, job boundaries dominate here
+const uint32_t SMALL_WIDTH = 512;
+const uint32_t SMALL_HEIGHT = 384;
+const uint32_t SMALL_JOBS = 200;
+
+// Minimal jobs (two work items each) submitted from several producer threads at once
+const uint32_t TINY_WIDTH = 64;
+const uint32_t TINY_HEIGHT = 128;
+const uint32_t TINY_JOBS_PER_PRODUCER = 2000;
+
+// Interactive-size job (2 MP) submitted one at a time with a pause in between, like a UI applying a
+// filter to a preview. Workers go idle between jobs so every job starts with a wakeup.
+const uint32_t INTERACTIVE_WIDTH = 1920;
+const uint32_t INTERACTIVE_HEIGHT = 1080;
+const uint32_t INTERACTIVE_JOBS = 200;
+const int INTERACTIVE_GAP_US = 200;
+
+// Background batch export of full frames with interactive jobs arriving every INTERACTIVE_PERIOD_MS
+const uint32_t BATCH_JOBS = 50;
+const uint32_t BATCH_IN_FLIGHT = 4;
+const uint32_t PRIORITY_INTERACTIVE_JOBS = 20;
+const int INTERACTIVE_PERIOD_MS = 20;
+
+// Full frame sepia jobs cancelled a quarter of the way through
+const uint32_t CANCEL_QUEUED_FRAMES = 8;
+
+// Thumbnail workload, every image is below the minimum chunk size and would run inline on its own
+const uint32_t THUMBNAIL_SIZE = 256;
+const uint32_t THUMBNAIL_JOBS = 10000;
+const uint32_t THUMBNAIL_BUFFERS = 64; // Distinct images in the frame buffers, the jobs cycle through them
+
+static double elapsed_ms_since(Clock::time_point start_time) {
+	return std::chrono::duration<double, std::milli>(Clock::now() - start_time).count();
+}
+
+// Thread count scaling: same image, same filters, only the pool size changes.
+// Prints the best of BENCH_REPEATS runs in megapixels per second.
+static void thread_scaling_bench(Image* input, Image* output, const size_t* thread_counts, int thread_count_count) {
+	printf("\n-- Thread scaling (%ux%u, %u channels) --\n", input->width, input->height, input->channels);
+	printf("%8s %12s %12s %12s\n", "threads", "invert MP/s", "gray MP/s", "sepia MP/s");
+	double megapixels = (double)input->width * input->height / 1e6;
+	for (int t = 0; t < thread_count_count; ++t) {
+		Filter_Engine engine = filter_engine_create();
+		filter_engine_initialize(engine, DEFAULT, thread_counts[t]);
+		double best_ms[3] = { 1e30, 1e30, 1e30 };
+		for (int r = 0; r < BENCH_REPEATS; ++r) {
+			for (int f = 0; f < 3; ++f) {
+				Clock::time_point start_time = Clock::now();
+				if (f == 0) filter_engine_invert(engine, input, output);
+				else if (f == 1) filter_engine_grayscale(engine, input, output);
+				else filter_engine_sepia(engine, input, output);
+				filter_engine_wait(engine);
+				double elapsed_ms = elapsed_ms_since(start_time);
+				if (elapsed_ms < best_ms[f]) best_ms[f] = elapsed_ms;
+			}
+		}
+		printf("%8zu %12.1f %12.1f %12.1f\n", thread_counts[t],
+			megapixels / (best_ms[0] / 1000.0), megapixels / (best_ms[1] / 1000.0), megapixels / (best_ms[2] / 1000.0));
+		filter_engine_destroy(engine);
+	}
+}
+
+// Queues SMALL_JOBS small images before waiting, reports jobs per second
+static void small_jobs_bench(Image* input, Image* output, size_t thread_count) {
+	Image small_input = *input;
+	small_input.width = SMALL_WIDTH;
+	small_input.height = SMALL_HEIGHT;
+	Image small_output = *output;
+	small_output.width = SMALL_WIDTH;
+	small_output.height = SMALL_HEIGHT;
+	size_t small_size = (size_t)SMALL_WIDTH * SMALL_HEIGHT * input->channels;
+
+	Filter_Engine engine = filter_engine_create();
+	filter_engine_initialize(engine, SMALL_JOBS + 1, thread_count);
+	double best_ms = 1e30;
+	for (int r = 0; r < BENCH_REPEATS; ++r) {
+		Clock::time_point start_time = Clock::now();
+		for (uint32_t j = 0; j < SMALL_JOBS; ++j) {
+			// Different slices of the big frame so jobs do not share cache lines
+			Image job_input = small_input;
+			Image job_output = small_output;
+			job_input.data += (j % 64) * small_size;
+			job_output.data += (j % 64) * small_size;
+			filter_engine_grayscale(engine, &job_input, &job_output);
+		}
+		filter_engine_wait(engine);
+		double elapsed_ms = elapsed_ms_since(start_time);
+		if (elapsed_ms < best_ms) best_ms = elapsed_ms;
+	}
+	filter_engine_destroy(engine);
+	printf("\n-- Small jobs (%u x %ux%u grayscale) --\n", SMALL_JOBS, SMALL_WIDTH, SMALL_HEIGHT);
+	printf("%.3fms per batch, %.0f jobs/s\n", best_ms, SMALL_JOBS / (best_ms / 1000.0));
+}
+
+// Each producer submits a tiny job and waits for its ticket, over and over. The submit call time is the
+// queue cost under contention, the round trip adds the worker wakeup and the completion signal.
+static void submit_latency_bench(Image* input, Image* output, int producer_count) {
+	Filter_Engine engine = filter_engine_create();
+	Filter_Engine_Options options = { 0 };
+	options.min_chunk_bytes = 4096; // Tiny jobs would otherwise run inline on the producer
+	filter_engine_initialize_with_options(engine, &options);
+	std::vector<std::vector<double>> submit_us(producer_count), round_trip_us(producer_count);
+	std::vector<std::thread> producers;
+	size_t tiny_size = (size_t)TINY_WIDTH * TINY_HEIGHT * input->channels;
+	for (int p = 0; p < producer_count; ++p) {
+		producers.emplace_back([&, p]() {
+			Image job_input = *input;
+			Image job_output = *output;
+			job_input.width = job_output.width = TINY_WIDTH;
+			job_input.height = job_output.height = TINY_HEIGHT;
+			job_input.data += p * tiny_size;
+			job_output.data += p * tiny_size;
+			submit_us[p].reserve(TINY_JOBS_PER_PRODUCER);
+			round_trip_us[p].reserve(TINY_JOBS_PER_PRODUCER);
+			for (uint32_t j = 0; j < TINY_JOBS_PER_PRODUCER; ++j) {
+				Clock::time_point start_time = Clock::now();
+				Filter_Job job = filter_engine_submit_invert(engine, &job_input, &job_output);
+				Clock::time_point submit_time = Clock::now();
+				filter_engine_job_wait(engine, job);
+				Clock::time_point end_time = Clock::now();
+				submit_us[p].push_back(std::chrono::duration<double, std::micro>(submit_time - start_time).count());
+				round_trip_us[p].push_back(std::chrono::duration<double, std::micro>(end_time - start_time).count());
+			}
+		});
+	}
+	for (std::thread& producer : producers) producer.join();
+	filter_engine_destroy(engine);
+
+	std::vector<double> all_submit, all_round_trip;
+	for (int p = 0; p < producer_count; ++p) {
+		all_submit.insert(all_submit.end(), submit_us[p].begin(), submit_us[p].end());
+		all_round_trip.insert(all_round_trip.end(), round_trip_us[p].begin(), round_trip_us[p].end());
+	}
+	std::sort(all_submit.begin(), all_submit.end());
+	std::sort(all_round_trip.begin(), all_round_trip.end());
+	size_t p50 = all_submit.size() / 2, p99 = all_submit.size() * 99 / 100;
+	printf("%10d %12.2f %12.2f %12.2f %12.2f\n", producer_count,
+		all_submit[p50], all_submit[p99], all_round_trip[p50], all_round_trip[p99]);
+}
+
+// CPU time used by every thread of the process so far, in milliseconds
+static double process_cpu_ms() {
+#ifdef _WIN32
+	FILETIME creation_time, exit_time, kernel_time, user_time;
+	GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time);
+	ULARGE_INTEGER kernel, user;
+	kernel.LowPart = kernel_time.dwLowDateTime;
+	kernel.HighPart = kernel_time.dwHighDateTime;
+	user.LowPart = user_time.dwLowDateTime;
+	user.HighPart = user_time.dwHighDateTime;
+	return (double)(kernel.QuadPart + user.QuadPart) / 10000.0;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+	return (double)now.tv_sec * 1000.0 + (double)now.tv_nsec / 1e6;
+#endif
+}
+
+// Average submit-to-done latency and CPU time per job for one idle policy. The CPU time includes the
+// workers spinning through the gaps, so it shows what the lower latency costs.
+static void idle_policy_bench(Image* input, Image* output, Idle_Policy policy, const char* name) {
+	Image job_input = *input;
+	Image job_output = *output;
+	job_input.width = job_output.width = INTERACTIVE_WIDTH;
+	job_input.height = job_output.height = INTERACTIVE_HEIGHT;
+
+	Filter_Engine engine = filter_engine_create();
+	Filter_Engine_Options options = { 0 };
+	options.idle_policy = policy;
+	filter_engine_initialize_with_options(engine, &options);
+	std::vector<double> latency_us;
+	latency_us.reserve(INTERACTIVE_JOBS);
+	double start_cpu_ms = process_cpu_ms();
+	Clock::time_point bench_start = Clock::now();
+	for (uint32_t j = 0; j < INTERACTIVE_JOBS; ++j) {
+		std::this_thread::sleep_for(std::chrono::microseconds(INTERACTIVE_GAP_US));
+		Clock::time_point start_time = Clock::now();
+		Filter_Job job = filter_engine_submit_invert(engine, &job_input, &job_output);
+		filter_engine_job_wait(engine, job);
+		latency_us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start_time).count());
+	}
+	double wall_ms = elapsed_ms_since(bench_start);
+	double cpu_ms = process_cpu_ms() - start_cpu_ms;
+	filter_engine_destroy(engine);
+
+	double total_us = 0;
+	for (double us : latency_us) total_us += us;
+	std::sort(latency_us.begin(), latency_us.end());
+	printf("%16s %12.1f %12.1f %12.1f %12.2f\n", name, total_us / INTERACTIVE_JOBS, latency_us[INTERACTIVE_JOBS * 99 / 100],
+		cpu_ms / INTERACTIVE_JOBS * 1000.0, cpu_ms / wall_ms);
+}
+
+// Full frame throughput with the OS placing workers and with pinned workers and per-node queues.
+// The input is touched by the main thread, so on a NUMA machine pinned jobs stay on its node.
+static void pinning_bench(Image* input, Image* output) {
+	Platform_Topology topology;
+	platform_topology_query(&topology);
+	printf("\n-- Pinning (%ux%u, %zu processors, %zu cores, %zu sockets, %zu NUMA nodes) --\n", input->width, input->height,
+		topology.processor_count, topology.core_count, topology.socket_count, topology.node_count);
+	platform_topology_free(&topology);
+	printf("%10s %12s %12s %12s\n", "placement", "invert MP/s", "gray MP/s", "sepia MP/s");
+	double megapixels = (double)input->width * input->height / 1e6;
+	for (int pinned = 0; pinned < 2; ++pinned) {
+		Filter_Engine engine = filter_engine_create();
+		Filter_Engine_Options options = { 0 };
+		options.pin_workers = pinned != 0;
+		filter_engine_initialize_with_options(engine, &options);
+		double best_ms[3] = { 1e30, 1e30, 1e30 };
+		for (int r = 0; r < BENCH_REPEATS; ++r) {
+			for (int f = 0; f < 3; ++f) {
+				Clock::time_point start_time = Clock::now();
+				if (f == 0) filter_engine_invert(engine, input, output);
+				else if (f == 1) filter_engine_grayscale(engine, input, output);
+				else filter_engine_sepia(engine, input, output);
+				filter_engine_wait(engine);
+				double elapsed_ms = elapsed_ms_since(start_time);
+				if (elapsed_ms < best_ms[f]) best_ms[f] = elapsed_ms;
+			}
+		}
+		printf("%10s %12.1f %12.1f %12.1f\n", pinned ? "pinned" : "os",
+			megapixels / (best_ms[0] / 1000.0), megapixels / (best_ms[1] / 1000.0), megapixels / (best_ms[2] / 1000.0));
+		filter_engine_destroy(engine);
+	}
+}
+
+// Interactive 2 MP jobs while a batch export keeps the pool busy. Run once with the interactive jobs in their
+// own class and once with everything in the batch class, which is how the single FIFO queue behaved.
+static void priority_bench(Image* input, Image* output, Filter_Priority interactive_priority, const char* name) {
+	Image job_input = *input;
+	Image job_output = *output;
+	job_input.width = job_output.width = INTERACTIVE_WIDTH;
+	job_input.height = job_output.height = INTERACTIVE_HEIGHT;
+	std::vector<unsigned char> interactive_output((size_t)INTERACTIVE_WIDTH * INTERACTIVE_HEIGHT * input->channels);
+	job_output.data = interactive_output.data(); // The batch jobs own the big output buffer
+
+	Filter_Engine engine = filter_engine_create();
+	filter_engine_initialize(engine, DEFAULT, DEFAULT);
+	std::thread batch([&]() {
+		Filter_Job in_flight[BATCH_IN_FLIGHT];
+		uint32_t count = 0;
+		for (uint32_t j = 0; j < BATCH_JOBS; ++j) {
+			if (count == BATCH_IN_FLIGHT) {
+				size_t done = filter_engine_job_wait_any(engine, in_flight, count);
+				in_flight[done] = in_flight[--count];
+			}
+			in_flight[count++] = filter_engine_submit(engine, input, output, SEPIA, PRIORITY_BATCH);
+		}
+		for (uint32_t i = 0; i < count; ++i) filter_engine_job_wait(engine, in_flight[i]);
+	});
+	double total_ms = 0, max_ms = 0;
+	for (uint32_t j = 0; j < PRIORITY_INTERACTIVE_JOBS; ++j) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(INTERACTIVE_PERIOD_MS));
+		Clock::time_point start_time = Clock::now();
+		Filter_Job job = filter_engine_submit(engine, &job_input, &job_output, INVERT, interactive_priority);
+		filter_engine_job_wait(engine, job);
+		double elapsed_ms = elapsed_ms_since(start_time);
+		total_ms += elapsed_ms;
+		if (elapsed_ms > max_ms) max_ms = elapsed_ms;
+	}
+	batch.join();
+	Filter_Engine_Stats stats;
+	filter_engine_get_stats(engine, &stats);
+	filter_engine_destroy(engine);
+
+	printf("%18s %12.2f %12.2f", name, total_ms / PRIORITY_INTERACTIVE_JOBS, max_ms);
+	for (int priority = 0; priority < PRIORITY_COUNT; ++priority) {
+		double average_ms = stats.jobs[priority] ? stats.queue_us_total[priority] / 1000.0 / stats.jobs[priority] : 0.0;
+		printf(" %12.2f %12.2f", average_ms, stats.queue_us_max[priority] / 1000.0);
+	}
+	printf("\n");
+}
+
+// Time from the cancel call until the engine is idle again, next to the time the work would have taken.
+// A single cancelled job is only waited for until its running items finish, cancel_all also drops CANCEL_QUEUED_FRAMES queued frames.
+static void cancel_bench(Image* input, Image* output) {
+	Filter_Engine engine = filter_engine_create();
+	filter_engine_initialize(engine, DEFAULT, DEFAULT);
+	Clock::time_point start_time = Clock::now();
+	filter_engine_job_wait(engine, filter_engine_submit(engine, input, output, SEPIA, PRIORITY_BATCH));
+	double full_ms = elapsed_ms_since(start_time);
+	std::chrono::microseconds delay((long long)(full_ms * 250.0));
+
+	Filter_Job job = filter_engine_submit(engine, input, output, SEPIA, PRIORITY_BATCH);
+	std::this_thread::sleep_for(delay);
+	start_time = Clock::now();
+	filter_engine_cancel(engine, job);
+	filter_engine_job_wait(engine, job);
+	double single_ms = elapsed_ms_since(start_time);
+
+	for (uint32_t j = 0; j < CANCEL_QUEUED_FRAMES; ++j) filter_engine_submit(engine, input, output, SEPIA, PRIORITY_BATCH);
+	std::this_thread::sleep_for(delay);
+	start_time = Clock::now();
+	filter_engine_cancel_all(engine);
+	filter_engine_wait(engine);
+	double all_ms = elapsed_ms_since(start_time);
+	filter_engine_destroy(engine);
+
+	printf("\n-- Cancellation (%ux%u sepia, milliseconds) --\n", input->width, input->height);
+	printf("full job %.2f, idle after cancel %.2f, idle after cancel_all of %u frames %.2f\n", full_ms, single_ms, CANCEL_QUEUED_FRAMES, all_ms);
+}
+
+// THUMBNAIL_JOBS images submitted one by one and as one batch, best of BENCH_REPEATS in images per second
+static void batch_bench(Image* input, Image* output) {
+	size_t thumbnail_bytes = (size_t)THUMBNAIL_SIZE * THUMBNAIL_SIZE * input->channels;
+	std::vector<Image> inputs(THUMBNAIL_JOBS), outputs(THUMBNAIL_JOBS);
+	for (uint32_t j = 0; j < THUMBNAIL_JOBS; ++j) {
+		inputs[j] = *input;
+		inputs[j].width = inputs[j].height = THUMBNAIL_SIZE;
+		inputs[j].data += (j % THUMBNAIL_BUFFERS) * thumbnail_bytes;
+		outputs[j] = inputs[j];
+		outputs[j].data = output->data + (j % THUMBNAIL_BUFFERS) * thumbnail_bytes;
+	}
+
+	Filter_Engine engine = filter_engine_create();
+	filter_engine_initialize(engine, DEFAULT, DEFAULT);
+	double single_ms = 1e30, batch_ms = 1e30;
+	for (int r = 0; r < BENCH_REPEATS; ++r) {
+		Clock::time_point start_time = Clock::now();
+		for (uint32_t j = 0; j < THUMBNAIL_JOBS; ++j) filter_engine_grayscale(engine, &inputs[j], &outputs[j]);
+		filter_engine_wait(engine);
+		double elapsed_ms = elapsed_ms_since(start_time);
+		if (elapsed_ms < single_ms) single_ms = elapsed_ms;
+
+		start_time = Clock::now();
+		Filter_Job job = filter_engine_submit_batch(engine, inputs.data(), outputs.data(), THUMBNAIL_JOBS, GRAYSCALE, PRIORITY_BATCH);
+		filter_engine_job_wait(engine, job);
+		elapsed_ms = elapsed_ms_since(start_time);
+		if (elapsed_ms < batch_ms) batch_ms = elapsed_ms;
+	}
+	filter_engine_destroy(engine);
+	printf("\n-- Batch submit (%u x %ux%u grayscale) --\n", THUMBNAIL_JOBS, THUMBNAIL_SIZE, THUMBNAIL_SIZE);
+	printf("%10s %12s %12s\n", "submit", "ms", "images/s");
+	printf("%10s %12.2f %12.0f\n", "single", single_ms, THUMBNAIL_JOBS / (single_ms / 1000.0));
+	printf("%10s %12.2f %12.0f\n", "batch", batch_ms, THUMBNAIL_JOBS / (batch_ms / 1000.0));
+}
+
+// Odd image shapes that a row-count based split handled badly: tall strips were cut too fine,
+// wide banners were too short to be split at all
+static void shape_bench(Image* input, Image* output) {
+	const uint32_t shapes[][2] = { { 100, 20000 }, { 20000, 90 }, { 1000, 1000 }, { 6000, 4000 } };
+	printf("\n-- Image shapes (grayscale, default threads) --\n");
+	printf("%14s %12s\n", "size", "MP/s");
+	Filter_Engine engine = filter_engine_create();
+	filter_engine_initialize(engine, DEFAULT, DEFAULT);
+	for (int i = 0; i < 4; ++i) {
+		Image shape_input = *input;
+		Image shape_output = *output;
+		shape_input.width = shape_output.width = shapes[i][0];
+		shape_input.height = shape_output.height = shapes[i][1];
+		double best_ms = 1e30;
+		for (int r = 0; r < BENCH_REPEATS; ++r) {
+			Clock::time_point start_time = Clock::now();
+			filter_engine_grayscale(engine, &shape_input, &shape_output);
+			filter_engine_wait(engine);
+			double elapsed_ms = elapsed_ms_since(start_time);
+			if (elapsed_ms < best_ms) best_ms = elapsed_ms;
+		}
+		char size[32];
+		snprintf(size, sizeof(size), "%ux%u", shapes[i][0], shapes[i][1]);
+		printf("%14s %12.1f\n", size, (double)shapes[i][0] * shapes[i][1] / 1e6 / (best_ms / 1000.0));
+	}
+	filter_engine_destroy(engine);
+}
+
+// Usage: SchedulerBench [thread counts...]
+int main(int argc, char** argv) {
+	size_t thread_counts[32] = { 1, 2, 4, 8, 16, 32, 48, 64 };
+	int thread_count_count = 8;
+	if (argc > 1) {
+		thread_count_count = 0;
+		for (int i = 1; i < argc && thread_count_count < 32; ++i) thread_counts[thread_count_count++] = (size_t)atoi(argv[i]);
+	}
+
+	Image input = { 0 };
+	input.width = BENCH_WIDTH;
+	input.height = BENCH_HEIGHT;
+	input.channels = BENCH_CHANNELS;
+	size_t size = (size_t)input.width * input.height * input.channels;
+	input.data = (unsigned char*)malloc(size);
+	Image output = input;
+	output.data = (unsigned char*)malloc(size);
+	if (input.data == NULL || output.data == NULL) {
+		fprintf(stderr, "Failed to allocate benchmark images\n");
+		return -1;
+	}
+	uint32_t seed = 12345;
+	for (size_t i = 0; i < size; ++i) {
+		seed = seed * 1664525u + 1013904223u;
+		input.data[i] = (unsigned char)(seed >> 24);
+		output.data[i] = 0; // Touch the output so page faults are not part of the first run
+	}
+
+	thread_scaling_bench(&input, &output, thread_counts, thread_count_count);
+	pinning_bench(&input, &output);
+	small_jobs_bench(&input, &output, DEFAULT);
+	batch_bench(&input, &output);
+	shape_bench(&input, &output);
+	printf("\n-- Submit latency (%ux%u invert, %u jobs per producer, microseconds) --\n", TINY_WIDTH, TINY_HEIGHT, TINY_JOBS_PER_PRODUCER);
+	printf("%10s %12s %12s %12s %12s\n", "producers", "submit p50", "submit p99", "trip p50", "trip p99");
+	for (int producer_count = 1; producer_count <= 8; producer_count *= 2) {
+		submit_latency_bench(&input, &output, producer_count);
+	}
+	printf("\n-- Idle policy (%ux%u invert, %u jobs, %dus apart) --\n", INTERACTIVE_WIDTH, INTERACTIVE_HEIGHT, INTERACTIVE_JOBS, INTERACTIVE_GAP_US);
+	printf("%16s %12s %12s %12s %12s\n", "policy", "avg us", "p99 us", "cpu us/job", "cores busy");
+	idle_policy_bench(&input, &output, IDLE_PARK, "park");
+	idle_policy_bench(&input, &output, IDLE_SPIN_THEN_PARK, "spin-then-park");
+	idle_policy_bench(&input, &output, IDLE_SPIN, "spin");
+	printf("\n-- Priority classes (%ux%u invert every %dms during a %u frame sepia batch, milliseconds) --\n",
+		INTERACTIVE_WIDTH, INTERACTIVE_HEIGHT, INTERACTIVE_PERIOD_MS, BATCH_JOBS);
+	printf("%18s %12s %12s %12s %12s %12s %12s\n", "interactive class", "trip avg", "trip max", "i-queue avg", "i-queue max", "b-queue avg", "b-queue max");
+	priority_bench(&input, &output, PRIORITY_INTERACTIVE, "interactive");
+	priority_bench(&input, &output, PRIORITY_BATCH, "batch (fifo)");
+	cancel_bench(&input, &output);
+
+	free(input.data);
+	free(output.data);
+
+	return 0;
+}
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "filter.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h> // For GetProcessMemoryInfo
+#else
+#include <unistd.h> // For sysconf
+#endif
+
+// C++ specific libraries
+#include <chrono> // For high-resolution timing
+#include <thread>
+#include <vector>
+#include <atomic>
+
+typedef std::chrono::steady_clock Clock;
+
+const int PRODUCERS = 4;
+const uint32_t JOBS_PER_PRODUCER = 250000; // 1M jobs in total
+const uint32_t IN_FLIGHT_PER_PRODUCER = 64;
+const uint32_t JOB_WIDTH = 32;
+const uint32_t JOB_HEIGHT = 32;
+const size_t JOB_MIN_CHUNK_BYTES = 256; // Every job is split and goes through the pool
+const uint32_t SAMPLE_EVERY = 100000; // Jobs between two RSS samples
+const size_t MAX_RSS_GROWTH = 4 * 1024 * 1024; // Allowed growth after the first sample, allocator noise
+
+// Resident set size of the process in bytes, 0 if the OS will not tell
+static size_t resident_bytes() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+	return counters.WorkingSetSize;
+#else
+	FILE* file = fopen("/proc/self/statm", "r");
+	if (file == NULL) return 0;
+	unsigned long size = 0, resident = 0;
+	if (fscanf(file, "%lu %lu", &size, &resident) != 2) resident = 0;
+	fclose(file);
+	return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+// Keeps IN_FLIGHT_PER_PRODUCER grayscale jobs queued and resubmits every slot as soon as its ticket completes
+static void producer_run(Filter_Engine engine, int producer, std::atomic<uint32_t>* completed_total) {
+	size_t size = (size_t)JOB_WIDTH * JOB_HEIGHT * 3;
+	std::vector<unsigned char> input_data(size), output_data(size * IN_FLIGHT_PER_PRODUCER);
+	for (size_t i = 0; i < size; ++i) input_data[i] = (unsigned char)(i * 17 + producer);
+	Image input = { input_data.data(), JOB_WIDTH, JOB_HEIGHT, 3 };
+	std::vector<Image> outputs(IN_FLIGHT_PER_PRODUCER, input);
+	std::vector<Filter_Job> jobs(IN_FLIGHT_PER_PRODUCER);
+	for (uint32_t s = 0; s < IN_FLIGHT_PER_PRODUCER; ++s) {
+		outputs[s].data = &output_data[s * size];
+		jobs[s] = filter_engine_submit_grayscale(engine, &input, &outputs[s]);
+	}
+	uint32_t submitted = IN_FLIGHT_PER_PRODUCER;
+	for (uint32_t completed = 0; completed < JOBS_PER_PRODUCER; ++completed) {
+		uint32_t s = completed % IN_FLIGHT_PER_PRODUCER;
+		filter_engine_job_wait(engine, jobs[s]);
+		(*completed_total)++;
+		if (submitted < JOBS_PER_PRODUCER) {
+			jobs[s] = filter_engine_submit_grayscale(engine, &input, &outputs[s]);
+			submitted++;
+		}
+	}
+}
+
+// Runs 1M small jobs through one engine and samples RSS every SAMPLE_EVERY jobs. Fails if memory keeps
+// growing after the first sample, by then the arena and the pooled work items have reached their working size.
+int main(int argc, char** argv) {
+	Filter_Engine engine = filter_engine_create();
+	Filter_Engine_Options options = { 0 };
+	options.min_chunk_bytes = JOB_MIN_CHUNK_BYTES;
+	filter_engine_initialize_with_options(engine, &options);
+
+	std::atomic<uint32_t> completed_total(0);
+	std::vector<std::thread> producers;
+	Clock::time_point start_time = Clock::now();
+	for (int p = 0; p < PRODUCERS; ++p) {
+		producers.emplace_back(producer_run, engine, p, &completed_total);
+	}
+	size_t first_rss = 0, last_rss = 0;
+	uint32_t next_sample = SAMPLE_EVERY;
+	uint32_t total_jobs = PRODUCERS * JOBS_PER_PRODUCER;
+	printf("%10s %12s\n", "jobs", "RSS KiB");
+	while (next_sample <= total_jobs) {
+		if (completed_total.load() < next_sample) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+		last_rss = resident_bytes();
+		if (first_rss == 0) first_rss = last_rss;
+		printf("%10u %12zu\n", next_sample, last_rss / 1024);
+		next_sample += SAMPLE_EVERY;
+	}
+	for (std::thread& producer : producers) producer.join();
+	filter_engine_wait(engine);
+	double elapsed_ms = std::chrono::duration<double, std::milli>(Clock::now() - start_time).count();
+	filter_engine_destroy(engine);
+
+	bool passed = last_rss <= first_rss + MAX_RSS_GROWTH;
+	printf("Soak: %u jobs in %.1fms, RSS grew by %lld KiB after the first sample\n", total_jobs, elapsed_ms, ((long long)last_rss - (long long)first_rss) / 1024);
+
+	return passed ? 0 : 1;
+}
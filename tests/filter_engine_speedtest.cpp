@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdint.h>
-#include <windows.h> // For high-resolution timing
+#include <stdlib.h>
+#include <assert.h>
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -10,20 +11,20 @@
 // C++ specific libraries
 #include <filesystem>
 #include <string>
+#include <chrono> // For high-resolution timing
 
 namespace fs = std::filesystem;
+typedef std::chrono::steady_clock Clock;
 
 int main(int argc, char** argv) {
-	double elapsed_s, elapsed_ms;
-	uint64_t freq, start_time, end_time;
-	QueryPerformanceFrequency((LARGE_INTEGER*)&freq);
-	QueryPerformanceCounter((LARGE_INTEGER*)&start_time);
+	double elapsed_ms;
+	Clock::time_point start_time, end_time;
+	start_time = Clock::now();
 	Filter_Engine engine = filter_engine_create();
 	filter_engine_initialize(engine, DEFAULT, DEFAULT);
 	assert(engine && "There should be engine to begin.");
-	QueryPerformanceCounter((LARGE_INTEGER*)&end_time);
-	elapsed_s = ((double)end_time - start_time) / (double)freq;
-	elapsed_ms = elapsed_s * 1000.0;
+	end_time = Clock::now();
+	elapsed_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
 	printf("Filter engine initialization took %.3fms\n", elapsed_ms);
 	fs::path input_dir = "./images/input";
 	if (!fs::exists(input_dir) || !fs::is_directory(input_dir)) {
@@ -58,32 +59,29 @@ int main(int argc, char** argv) {
 
 			std::string filtered_path;
 
-			QueryPerformanceCounter((LARGE_INTEGER*)&start_time);
+			start_time = Clock::now();
 			filter_engine_invert(engine, &input_image, &output_image);
 			filter_engine_wait(engine);
-			QueryPerformanceCounter((LARGE_INTEGER*)&end_time);
-			elapsed_s = ((double)end_time - start_time) / (double)freq;
-			elapsed_ms = elapsed_s * 1000.0;
+			end_time = Clock::now();
+			elapsed_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
 			printf("Inversion of %s took %.3fms\n", filename.c_str(), elapsed_ms);
 			filtered_path = (output_dir / ("1" + filename)).string();
 			stbi_write_jpg(filtered_path.c_str(), output_image.width, output_image.height, output_image.channels, output_image.data, 100);
 
-			QueryPerformanceCounter((LARGE_INTEGER*)&start_time);
+			start_time = Clock::now();
 			filter_engine_grayscale(engine, &input_image, &output_image);
 			filter_engine_wait(engine);
-			QueryPerformanceCounter((LARGE_INTEGER*)&end_time);
-			elapsed_s = ((double)end_time - start_time) / (double)freq;
-			elapsed_ms = elapsed_s * 1000.0;
+			end_time = Clock::now();
+			elapsed_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
 			printf("Grayscale of %s took %.3fms\n", filename.c_str(), elapsed_ms);
 			filtered_path = (output_dir / ("2" + filename)).string();
 			stbi_write_jpg(filtered_path.c_str(), output_image.width, output_image.height, output_image.channels, output_image.data, 100);
 
-			QueryPerformanceCounter((LARGE_INTEGER*)&start_time);
+			start_time = Clock::now();
 			filter_engine_sepia(engine, &input_image, &output_image);
 			filter_engine_wait(engine);
-			QueryPerformanceCounter((LARGE_INTEGER*)&end_time);
-			elapsed_s = ((double)end_time - start_time) / (double)freq;
-			elapsed_ms = elapsed_s * 1000.0;
+			end_time = Clock::now();
+			elapsed_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
 			printf("Sepia of %s took %.3fms\n", filename.c_str(), elapsed_ms);
 			filtered_path = (output_dir / ("3" + filename)).string();
 			stbi_write_jpg(filtered_path.c_str(), output_image.width, output_image.height, output_image.channels, output_image.data, 100);
@@ -93,11 +91,10 @@ int main(int argc, char** argv) {
 		}
 	}
 
-	QueryPerformanceCounter((LARGE_INTEGER*)&start_time);
+	start_time = Clock::now();
 	filter_engine_destroy(engine);
-	QueryPerformanceCounter((LARGE_INTEGER*)&end_time);
-	elapsed_s = ((double)end_time - start_time) / (double)freq;
-	elapsed_ms = elapsed_s * 1000.0;
+	end_time = Clock::now();
+	elapsed_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
 	printf("Filter engine destruction took %.3fms\n", elapsed_ms);
 
 	return 0;
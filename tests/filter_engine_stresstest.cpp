@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "filter.h"
+
+// C++ specific libraries
+#include <chrono> // For high-resolution timing
+#include <thread>
+#include <vector>
+#include <atomic>
+
+typedef std::chrono::steady_clock Clock;
+
+const int PRODUCERS = 8;
+const uint32_t JOBS_PER_PRODUCER = 12500; // 100k jobs in total
+const uint32_t IN_FLIGHT_PER_PRODUCER = 256; // Well past DEFAULT_ARENA_SIZE so the arena has to grow or block
+const uint32_t JOB_WIDTH = 32;
+const uint32_t JOB_HEIGHT = 120;
+const size_t JOB_MIN_CHUNK_BYTES = 4096; // Small enough that every job is split and goes through the pool
+const uint32_t CANCEL_EVERY = 3; // In the cancellation run every third job is cancelled right after it is submitted
+
+// Each producer keeps IN_FLIGHT_PER_PRODUCER invert jobs queued, checks every output once its ticket completes
+// and resubmits into the freed slot. With cancel_every set every cancel_every-th job is cancelled, those
+// outputs are skipped. Returns the number of corrupted outputs.
+static uint32_t producer_run(Filter_Engine engine, int producer, uint32_t cancel_every) {
+	size_t size = (size_t)JOB_WIDTH * JOB_HEIGHT * 3;
+	Image input = { (unsigned char*)malloc(size), JOB_WIDTH, JOB_HEIGHT, 3 };
+	std::vector<Image> outputs(IN_FLIGHT_PER_PRODUCER);
+	std::vector<Filter_Job> jobs(IN_FLIGHT_PER_PRODUCER);
+	std::vector<bool> cancelled(IN_FLIGHT_PER_PRODUCER, false);
+	for (size_t i = 0; i < size; ++i) input.data[i] = (unsigned char)(i * 31 + producer);
+	for (uint32_t s = 0; s < IN_FLIGHT_PER_PRODUCER; ++s) {
+		outputs[s] = input;
+		outputs[s].data = (unsigned char*)malloc(size);
+	}
+
+	uint32_t errors = 0;
+	uint32_t submitted = 0;
+	for (; submitted < IN_FLIGHT_PER_PRODUCER; ++submitted) {
+		jobs[submitted] = filter_engine_submit_invert(engine, &input, &outputs[submitted]);
+		cancelled[submitted] = cancel_every != 0 && submitted % cancel_every == 0 && filter_engine_cancel(engine, jobs[submitted]);
+	}
+	for (uint32_t completed = 0; completed < JOBS_PER_PRODUCER; ++completed) {
+		uint32_t s = completed % IN_FLIGHT_PER_PRODUCER;
+		filter_engine_job_wait(engine, jobs[s]);
+		for (size_t i = 0; i < size && !cancelled[s]; ++i) {
+			if (outputs[s].data[i] != (unsigned char)(255 - input.data[i])) {
+				errors++;
+				break;
+			}
+		}
+		memset(outputs[s].data, 0, size);
+		if (submitted < JOBS_PER_PRODUCER) {
+			jobs[s] = filter_engine_submit_invert(engine, &input, &outputs[s]);
+			cancelled[s] = cancel_every != 0 && submitted % cancel_every == 0 && filter_engine_cancel(engine, jobs[s]);
+			submitted++;
+		}
+	}
+
+	for (uint32_t s = 0; s < IN_FLIGHT_PER_PRODUCER; ++s) free(outputs[s].data);
+	free(input.data);
+
+	return errors;
+}
+
+static bool stress_run(const char* name, const Filter_Engine_Options* options, uint32_t cancel_every) {
+	Filter_Engine engine = filter_engine_create();
+	filter_engine_initialize_with_options(engine, options);
+	std::atomic<uint32_t> errors(0);
+	Clock::time_point start_time = Clock::now();
+	std::vector<std::thread> producers;
+	for (int p = 0; p < PRODUCERS; ++p) {
+		producers.emplace_back([&, p]() { errors += producer_run(engine, p, cancel_every); });
+	}
+	for (std::thread& producer : producers) producer.join();
+	filter_engine_wait(engine);
+	double elapsed_ms = std::chrono::duration<double, std::milli>(Clock::now() - start_time).count();
+	filter_engine_destroy(engine);
+	printf("%s: %u jobs from %d producers in %.1fms, %u bad outputs\n", name, PRODUCERS * JOBS_PER_PRODUCER, PRODUCERS, elapsed_ms, errors.load());
+
+	return errors.load() == 0;
+}
+
+int main(int argc, char** argv) {
+	bool passed = true;
+
+	Filter_Engine_Options growing = { 0 };
+	growing.min_chunk_bytes = JOB_MIN_CHUNK_BYTES;
+	passed &= stress_run("Growing arena", &growing, 0);
+
+	Filter_Engine_Options bounded = { 0 };
+	bounded.arena_size = 16;
+	bounded.arena_max_size = 64; // Far below the 2048 jobs the producers try to keep queued
+	bounded.min_chunk_bytes = JOB_MIN_CHUNK_BYTES;
+	passed &= stress_run("Bounded arena", &bounded, 0);
+	passed &= stress_run("Cancellation", &growing, CANCEL_EVERY);
+
+	return passed ? 0 : 1;
+}